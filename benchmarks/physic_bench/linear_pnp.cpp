@@ -1,12 +1,21 @@
 #include <iostream>
 #include <fstream>
 #include <string.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
 #include <dolfin.h>
 #include <ufc.h>
 #include "pde.h"
 #include "domain.h"
 #include "dirichlet.h"
-#include "EAFE.h"
+#include "eafe_assembler.h"
+#include "bsr_assembler.h"
+#include "preconditioner_cache.h"
+#include "amg_cache.h"
+#include "pnp_jacobian_operator.h"
+#include "phase_timer.h"
 extern "C" {
   #include "fasp.h"
   #include "fasp_functs.h"
@@ -59,9 +68,21 @@ Linear_PNP::Linear_PNP (
   _amg = amg;
   _ilu = ilu;
 
+  _bsr_assembler.reset(
+    new BSR_Assembler(Linear_PNP::get_solution_dimension())
+  );
+
+  // keep the ILU factors until the Krylov iterations grow by 50%
+  _preconditioner.reset(new Preconditioner_Cache(_ilu, 1.5));
+
+  _eafe_assembler.reset(new EAFE_Assembler());
+  _jacobian_operator.reset(new PNP_Jacobian_Operator());
+
 }
 //--------------------------------------
-Linear_PNP::~Linear_PNP () {}
+Linear_PNP::~Linear_PNP () {
+  Linear_PNP::free_gummel();
+}
 //--------------------------------------
 
 
@@ -70,49 +91,104 @@ Linear_PNP::~Linear_PNP () {}
 
 //--------------------------------------
 void Linear_PNP::setup_fasp_linear_algebra () {
-  Linear_PNP::setup_linear_algebra();
+  const bool mesh_changed = _jacobian_uninitialized
+    || _jacobian_mesh_id != _function_space->mesh()->id();
+  if (_use_jfnk && mesh_changed) {
+    Linear_PNP::init_jfnk();
+    _preconditioner->reset();
+  }
 
-  if (_use_eafe) {
-    printf("Adding EAFE...\n"); fflush(stdout);
-    Linear_PNP::apply_eafe();
-    for (std::size_t i = 0; i < _dirichletBC.size(); i++) {
-      _dirichletBC[i]->apply(*_eigen_matrix);
-    }
+  // JFNK only needs the Jacobian for a preconditioner refresh
+  if (!_use_jfnk || mesh_changed || _preconditioner->needs_setup()) {
+    Linear_PNP::assemble_jacobian();
+  }
+  else {
+    printf("Skipping the Jacobian, the preconditioner is lagged\n"); fflush(stdout);
   }
 
-  std::size_t dimension = Linear_PNP::get_solution_dimension();
-  EigenMatrix_to_dCSRmat(_eigen_matrix, &_fasp_matrix);
-  _fasp_bsr_matrix = fasp_format_dcsr_dbsr(&_fasp_matrix, dimension);
+  // the right-hand side is the residual of the current solution
+  _eigen_vector.reset(new dolfin::EigenVector(*PDE::get_residual_vector()));
 
   if (_faps_soln_unallocated) {
     fasp_dvec_alloc(_eigen_vector->size(), &_fasp_soln);
     _faps_soln_unallocated = false;
   }
-  EigenVector_to_dvector(_eigen_vector, &_fasp_vector);
+  PDE::EigenVector_to_dvector(_eigen_vector, &_fasp_vector);
 
   fasp_dvec_set(_fasp_vector.row, &_fasp_soln, 0.0);
 }
 //--------------------------------------
+void Linear_PNP::assemble_jacobian () {
+  // assemble the Jacobian straight into the FASP block matrix
+  _bsr_assembler->assemble(*_bilinear_form, *_threaded_assembler);
+  _bsr_assembler->apply(_dirichletBC);
+
+  if (_use_eafe) {
+    printf("Adding EAFE...\n"); fflush(stdout);
+    Linear_PNP::apply_eafe();
+    _bsr_assembler->apply(_dirichletBC);
+  }
+
+  _jacobian_mesh_id = _function_space->mesh()->id();
+  _jacobian_uninitialized = false;
+}
+//--------------------------------------
 dolfin::Function Linear_PNP::fasp_solve () {
   Linear_PNP::setup_fasp_linear_algebra();
-  dolfin::Function solution(Linear_PNP::get_solution());
 
   printf("Solving linear system using FASP solver...\n"); fflush(stdout);
   // INT status = fasp_solver_dbsr_krylov_amg (
-  //   &_fasp_bsr_matrix,
+  //   _bsr_assembler->matrix(),
   //   &_fasp_vector,
   //   &_fasp_soln,
   //   &_itsolver,
   //   &_amg
   // );
-  INT status = fasp_solver_dbsr_krylov_ilu (
-    &_fasp_bsr_matrix,
-    &_fasp_vector,
-    &_fasp_soln,
-    &_itsolver,
-    &_ilu
-  );
+  INT status;
+  if (_use_jfnk) {
+    // finite differences are taken around the current solution
+    Linear_PNP::get_solution_function()->vector()->get_local(_jfnk_state);
+    _jfnk_base.assign(_eigen_vector->data(), _eigen_vector->data() + _eigen_vector->size());
+
+    mxv_matfree jacobian;
+    jacobian.data = this;
+    jacobian.fct = Linear_PNP::apply_jacobian;
+    if (_use_matrix_free) {
+      Linear_PNP::get_jacobian_operator()->shell_matrix(jacobian);
+    }
+    const bool lagged = !_preconditioner->needs_setup();
+    status = _preconditioner->solve(
+      &jacobian,
+      _bsr_assembler->matrix(),
+      &_fasp_vector,
+      &_fasp_soln,
+      &_itsolver
+    );
 
+    // a lagged Jacobian may be too old to precondition
+    if (status < 0 && lagged) {
+      printf("\tKrylov solver failed with a lagged Jacobian... reassembling\n");
+      Linear_PNP::assemble_jacobian();
+      fasp_dvec_set(_fasp_soln.row, &_fasp_soln, 0.0);
+      status = _preconditioner->solve(
+        &jacobian,
+        _bsr_assembler->matrix(),
+        &_fasp_vector,
+        &_fasp_soln,
+        &_itsolver
+      );
+    }
+  }
+  else {
+    status = _preconditioner->solve(
+      _bsr_assembler->matrix(),
+      &_fasp_vector,
+      &_fasp_soln,
+      &_itsolver
+    );
+  }
+
+  krylov_iterations = status;
   if (status < 0) {
     printf("\n### WARNING: FASP solver failed! Exit status = %d.\n", status);
     fflush(stdout);
@@ -120,22 +196,13 @@ dolfin::Function Linear_PNP::fasp_solve () {
   else {
     printf("Successfully solved the linear system\n");
     fflush(stdout);
-  }
 
-    dolfin::EigenVector solution_vector(_eigen_vector->mpi_comm(),_eigen_vector->size());
-    double* array = solution_vector.data();
-    for (std::size_t i = 0; i < _fasp_soln.row; ++i) {
-      array[i] = _fasp_soln.val[i];
-    }
-
-    dolfin::Function update (
-      Linear_PNP::_convert_EigenVector_to_Function(solution_vector)
-    );
-    *(solution.vector()) += *(update.vector());
-
-  Linear_PNP::set_solution(solution);
+    // block dofs are the dofs of the mixed space, so the update
+    // is added straight into the solution vector
+    PDE::add_to_solution(_fasp_soln.val);
+  }
 
-  return solution;
+  return Linear_PNP::get_solution();
 }
 //--------------------------------------
 dolfin::EigenVector Linear_PNP::fasp_test_solver (
@@ -148,21 +215,25 @@ dolfin::EigenVector Linear_PNP::fasp_test_solver (
   rhs_vector.reset( new dolfin::EigenVector(target_vector.mpi_comm(),target_vector.size()) );
 
 
-  _eigen_matrix->mult(target_vector, *rhs_vector);
+  fasp_blas_dbsr_mxv(
+    _bsr_assembler->matrix(),
+    target_vector.data(),
+    rhs_vector->data()
+  );
   EigenVector_to_dvector(rhs_vector, &_fasp_vector);
 
   dolfin::Function solution(Linear_PNP::get_solution());
 
   printf("Solving linear system using FASP solver...\n"); fflush(stdout);
   // INT status = fasp_solver_dbsr_krylov_amg (
-  //   &_fasp_bsr_matrix,
+  //   _bsr_assembler->matrix(),
   //   &_fasp_vector,
   //   &_fasp_soln,
   //   &_itsolver,
   //   &_amg
   // );
   INT status = fasp_solver_dbsr_krylov_ilu (
-    &_fasp_bsr_matrix,
+    _bsr_assembler->matrix(),
     &_fasp_vector,
     &_fasp_soln,
     &_itsolver,
@@ -188,15 +259,252 @@ dolfin::EigenVector Linear_PNP::fasp_test_solver (
   return solution_vector;
 }
 //--------------------------------------
+void Linear_PNP::set_linear_tolerance (
+  const double tolerance
+) {
+  _itsolver.tol = tolerance;
+}
+//--------------------------------------
+void Linear_PNP::set_max_krylov_iterations (
+  const INT max_iterations
+) {
+  _itsolver.maxit = max_iterations;
+}
+//--------------------------------------
 void Linear_PNP::free_fasp () {
-  fasp_dcsr_free(&_fasp_matrix);
-  fasp_dbsr_free(&_fasp_bsr_matrix);
+  _bsr_assembler->free_matrix();
+  _preconditioner->free_preconditioner();
   fasp_dvec_free(&_fasp_vector);
   fasp_dvec_free(&_fasp_soln);
+  Linear_PNP::free_gummel();
 }
 //--------------------------------------
+dolfin::Function Linear_PNP::gummel_solve () {
+  Phase_Timer timer("Linear_PNP::gummel_solve");
+  printf("Gummel sweep using FASP AMG...\n"); fflush(stdout);
+  gummel_iterations = 0;
+
+  // the Poisson block is linear in the potential, so one solve
+  // is exact for the current concentrations
+  INT status = Linear_PNP::gummel_update({0});
+
+  // the Nernst-Planck blocks only couple through the potential
+  if (status >= 0) {
+    std::vector<std::size_t> species;
+    for (std::size_t i = 1; i < Linear_PNP::get_solution_dimension(); i++) {
+      species.push_back(i);
+    }
+    status = Linear_PNP::gummel_update(species);
+  }
+
+  krylov_iterations = status < 0 ? status : gummel_iterations;
+  return Linear_PNP::get_solution();
+}
+//--------------------------------------
+INT Linear_PNP::gummel_update (
+  const std::vector<std::size_t>& components
+) {
+  Linear_PNP::assemble_jacobian();
+  if (_gummel_pattern_count != _bsr_assembler->pattern_count()) {
+    Linear_PNP::init_gummel();
+  }
+
+  std::shared_ptr<const dolfin::EigenVector> residual = PDE::get_residual_vector();
+  const double* residual_values = residual->data();
+  const Component_Split& split = Linear_PNP::get_component_split(*_function_space);
+  std::fill(_gummel_update.begin(), _gummel_update.end(), 0.0);
+
+  // the species solves are independent, but FASP keeps global
+  // allocation counters, so they run one after the other
+  for (std::size_t c = 0; c < components.size(); c++) {
+    const std::size_t k = components[c];
+    const dolfin::la_index* dofs = split.dofs[k].data();
+    const std::size_t size = split.dofs[k].size();
+    _bsr_assembler->extract_block(split.dofs[k], _gummel_matrices[k], _gummel_offsets[k]);
+
+    for (std::size_t i = 0; i < size; i++) {
+      _gummel_rhs[k].val[i] = residual_values[dofs[i]];
+    }
+    fasp_dvec_set(size, &_gummel_soln[k], 0.0);
+
+    INT status = _gummel_amg[k]->solve(
+      &_gummel_matrices[k],
+      &_gummel_rhs[k],
+      &_gummel_soln[k],
+      &_itsolver
+    );
+    if (status < 0) {
+      printf("\n### WARNING: FASP solver failed on component %lu! Exit status = %d.\n", k, status);
+      fflush(stdout);
+      return status;
+    }
+    gummel_iterations += status;
+
+    for (std::size_t i = 0; i < size; i++) {
+      _gummel_update[dofs[i]] = _gummel_soln[k].val[i];
+    }
+  }
 
+  PDE::add_to_solution(_gummel_update.data());
+  return 0;
+}
+//--------------------------------------
+void Linear_PNP::init_gummel () {
+  Linear_PNP::free_gummel();
+
+  const Component_Split& split = Linear_PNP::get_component_split(*_function_space);
+  const std::size_t eqns = split.dofs.size();
+  _gummel_matrices.resize(eqns);
+  _gummel_offsets.resize(eqns);
+  _gummel_rhs.resize(eqns);
+  _gummel_soln.resize(eqns);
+  _gummel_amg.resize(eqns);
+  for (std::size_t k = 0; k < eqns; k++) {
+    fasp_dvec_alloc(split.dofs[k].size(), &_gummel_rhs[k]);
+    fasp_dvec_alloc(split.dofs[k].size(), &_gummel_soln[k]);
+
+    // the Poisson block does not change with the solution, so its
+    // hierarchy lasts; species hierarchies lag as the ILU does
+    if (!_gummel_amg[k]) {
+      _gummel_amg[k].reset(new AMG_Cache(_amg, 1.5));
+    }
+  }
+  _gummel_update.assign(_function_space->dim(), 0.0);
 
+  _gummel_pattern_count = _bsr_assembler->pattern_count();
+}
+//--------------------------------------
+void Linear_PNP::free_gummel () {
+  for (std::size_t k = 0; k < _gummel_offsets.size(); k++) {
+    if (!_gummel_offsets[k].empty()) {
+      fasp_dcsr_free(&_gummel_matrices[k]);
+      _gummel_offsets[k].clear();
+    }
+    fasp_dvec_free(&_gummel_rhs[k]);
+    fasp_dvec_free(&_gummel_soln[k]);
+    if (_gummel_amg[k]) {
+      _gummel_amg[k]->free_preconditioner();
+    }
+  }
+  _gummel_pattern_count = 0;
+}
+//--------------------------------------
+
+
+//--------------------------------------
+void Linear_PNP::use_jfnk () {
+  _use_jfnk = true;
+  _jacobian_uninitialized = true;
+}
+//--------------------------------------
+void Linear_PNP::no_jfnk () {
+  _use_jfnk = false;
+  _use_matrix_free = false;
+}
+//--------------------------------------
+void Linear_PNP::use_matrix_free () {
+  Linear_PNP::use_jfnk();
+  _use_matrix_free = true;
+}
+//--------------------------------------
+std::shared_ptr<PNP_Jacobian_Operator> Linear_PNP::get_jacobian_operator () {
+  // the operator needs the form coefficients as constants
+  std::shared_ptr<const dolfin::Constant> permittivity, diffusivity, valency;
+  permittivity = std::dynamic_pointer_cast<const dolfin::Constant>(_bilinear_form->coefficient("permittivity"));
+  diffusivity = std::dynamic_pointer_cast<const dolfin::Constant>(_bilinear_form->coefficient("diffusivity"));
+  valency = std::dynamic_pointer_cast<const dolfin::Constant>(_bilinear_form->coefficient("valency"));
+  if (!permittivity || !diffusivity || !valency) {
+    fasp_chkerr(ERROR_INPUT_PAR, "Linear_PNP::get_jacobian_operator");
+  }
+
+  _jacobian_operator->set_coefficients(
+    permittivity->values()[0],
+    diffusivity->values(),
+    valency->values()
+  );
+  _jacobian_operator->update(*(Linear_PNP::get_solution_function()));
+
+  // Dirichlet rows as in the assembled Jacobian
+  std::vector<dolfin::la_index> dirichlet_dofs;
+  for (std::size_t i = 0; i < _dirichletBC.size(); i++) {
+    dolfin::DirichletBC::Map boundary_values;
+    _dirichletBC[i]->get_boundary_values(boundary_values);
+    dolfin::DirichletBC::Map::const_iterator bv;
+    for (bv = boundary_values.begin(); bv != boundary_values.end(); ++bv) {
+      dirichlet_dofs.push_back(bv->first);
+    }
+  }
+  _jacobian_operator->set_dirichlet_dofs(dirichlet_dofs);
+
+  return _jacobian_operator;
+}
+//--------------------------------------
+void Linear_PNP::init_jfnk () {
+  const std::size_t size = _function_space->dim();
+  _jfnk_state.resize(size);
+  _jfnk_base.resize(size);
+  _jfnk_perturbation.resize(size);
+  _jfnk_residual.reset(new dolfin::EigenVector());
+
+  _jfnk_dirichlet_dofs.clear();
+  for (std::size_t i = 0; i < _dirichletBC.size(); i++) {
+    dolfin::DirichletBC::Map boundary_values;
+    _dirichletBC[i]->get_boundary_values(boundary_values);
+    dolfin::DirichletBC::Map::const_iterator bv;
+    for (bv = boundary_values.begin(); bv != boundary_values.end(); ++bv) {
+      _jfnk_dirichlet_dofs.push_back(bv->first);
+    }
+  }
+}
+//--------------------------------------
+void Linear_PNP::jacobian_action (
+  const double* x,
+  double* y
+) {
+  Phase_Timer timer("Linear_PNP::jacobian_action");
+  const std::size_t size = _jfnk_state.size();
+  double state_norm = 0.0, direction_norm = 0.0;
+  for (std::size_t dof = 0; dof < size; dof++) {
+    state_norm += _jfnk_state[dof] * _jfnk_state[dof];
+    direction_norm += x[dof] * x[dof];
+  }
+  if (direction_norm == 0.0) {
+    std::fill(y, y + size, 0.0);
+    return;
+  }
+
+  // step of relative size sqrt(machine epsilon)
+  const double epsilon = std::sqrt(std::numeric_limits<double>::epsilon())
+    * (1.0 + std::sqrt(state_norm)) / std::sqrt(direction_norm);
+  for (std::size_t dof = 0; dof < size; dof++) {
+    _jfnk_perturbation[dof] = epsilon * x[dof];
+  }
+  PDE::add_to_solution(_jfnk_perturbation.data());
+  PDE::assemble_residual(*_jfnk_residual);
+  PDE::set_solution_values(_jfnk_state.data());
+
+  // the linear form is minus the residual: J x = -(L(u + eps x) - L(u)) / eps
+  const double* perturbed = _jfnk_residual->data();
+  for (std::size_t dof = 0; dof < size; dof++) {
+    y[dof] = (_jfnk_base[dof] - perturbed[dof]) / epsilon;
+  }
+
+  // Dirichlet rows of the Jacobian are identity rows
+  for (std::size_t i = 0; i < _jfnk_dirichlet_dofs.size(); i++) {
+    const dolfin::la_index dof = _jfnk_dirichlet_dofs[i];
+    y[dof] = x[dof];
+  }
+}
+//--------------------------------------
+void Linear_PNP::apply_jacobian (
+  const void* data,
+  const REAL* x,
+  REAL* y
+) {
+  const Linear_PNP* pnp = static_cast<const Linear_PNP*>(data);
+  const_cast<Linear_PNP*>(pnp)->jacobian_action(x, y);
+}
+//--------------------------------------
 //--------------------------------------
 void Linear_PNP::use_eafe () {
  _use_eafe = true;
@@ -206,130 +514,161 @@ void Linear_PNP::no_eafe () {
  _use_eafe = false;
 }
 //--------------------------------------
+void Linear_PNP::coefficients_changed () {
+  _eafe_uninitialized = true;
+}
+//--------------------------------------
 void Linear_PNP::apply_eafe () {
-  dolfin::Function solution_function(Linear_PNP::get_solution());
-
-  if (_eafe_uninitialized) {
+  Phase_Timer timer("Linear_PNP::apply_eafe");
+  std::size_t eqns = Linear_PNP::get_solution_dimension();
 
-    _eafe_function_space = solution_function[0].function_space()->collapse();
-    _eafe_bilinear_form.reset(
-      new EAFE::Form_a(_eafe_function_space, _eafe_function_space)
-    );
-    _eafe_matrix.reset(new dolfin::EigenMatrix());
+  if (_eafe_uninitialized || _eafe_mesh_id != _function_space->mesh()->id()) {
+    const Component_Split& split = Linear_PNP::get_component_split(*_function_space);
+    _eafe_function_space = split.spaces[0];
+
+    // match the EAFE dofs to each component through the vertices
+    std::vector<std::size_t> eafe_vertices = dolfin::dof_to_vertex_map(*_eafe_function_space);
+    _eafe_dofs.resize(eqns);
+    for (uint eqn_idx = 0; eqn_idx < eqns; eqn_idx++) {
+      std::vector<dolfin::la_index> vertex_dofs = dolfin::vertex_to_dof_map(*(split.spaces[eqn_idx]));
+      _eafe_dofs[eqn_idx].resize(eafe_vertices.size());
+      for (std::size_t dof = 0; dof < eafe_vertices.size(); dof++) {
+        _eafe_dofs[eqn_idx][dof] = split.dofs[eqn_idx][vertex_dofs[eafe_vertices[dof]]];
+      }
+    }
 
     std::shared_ptr<dolfin::Function> _diffusivity;
     _diffusivity.reset(new dolfin::Function(diffusivity_space));
     _diffusivity->interpolate(
       *(_bilinear_form->coefficient("diffusivity"))
     );
-    _split_diffusivity = Linear_PNP::split_mixed_function(_diffusivity);
-
+    std::vector<std::shared_ptr<dolfin::Function>> split_diffusivity;
+    split_diffusivity = Linear_PNP::split_mixed_function(_diffusivity);
+    _eafe_alpha.clear();
+    for (uint eqn_idx = 0; eqn_idx < eqns; eqn_idx++) {
+      _eafe_alpha.push_back(std::make_shared<dolfin::Function>(_eafe_function_space));
+      _eafe_alpha[eqn_idx]->interpolate( *(split_diffusivity[eqn_idx]) );
+    }
 
     dolfin::Function val_fn(valency_space);
     val_fn.interpolate(
       (*_bilinear_form->coefficient("valency"))
     );
 
-    std::size_t vals = Linear_PNP::get_solution_dimension();
-    _valency_double.reserve(vals);
-    for (uint val_idx = 0; val_idx < vals; val_idx++) {
+    _valency_double.resize(eqns);
+    for (uint val_idx = 0; val_idx < eqns; val_idx++) {
       _valency_double[val_idx] = (*(val_fn.vector()))[val_idx];
     }
     _valency_double[0] = 0.0;
-  }
 
-  std::shared_ptr<dolfin::Function> solution_ptr;
-  solution_ptr.reset( new dolfin::Function(solution_function.function_space()) );
-  *solution_ptr = solution_function;
+    eafe_beta.reset(new dolfin::Function(_eafe_function_space));
+    eafe_eta.reset(new dolfin::Function(_eafe_function_space));
 
-  auto zero= std::make_shared<const dolfin::Constant>(0.0);
-  std::vector<std::shared_ptr<dolfin::Function>> solution_vector;
-  solution_vector = Linear_PNP::split_mixed_function(solution_ptr);
-  std::shared_ptr<dolfin::Function> beta, eta, phi;
-
-  std::size_t eqns = Linear_PNP::get_solution_dimension();
-  for (uint eqn_idx = 1; eqn_idx < eqns; eqn_idx++) {
-    beta.reset(new dolfin::Function(_eafe_function_space));
-    eta.reset(new dolfin::Function(_eafe_function_space));
-    phi.reset(new dolfin::Function(_eafe_function_space));
+    _eafe_mesh_id = _function_space->mesh()->id();
+    _eafe_uninitialized = false;
+  }
 
-    beta->interpolate( *(solution_vector[eqn_idx]) );
-    eta->interpolate( *(solution_vector[eqn_idx]) );
-    phi->interpolate( *(solution_vector[0]) );
+  // gather eta and beta = eta + valency * phi straight from the solution
+  const double* solution_values = dolfin::as_type<const dolfin::EigenVector>(
+    *(PDE::get_solution_function()->vector())
+  ).data();
+  double* eta_values = dolfin::as_type<dolfin::EigenVector>(*(eafe_eta->vector())).data();
+  double* beta_values = dolfin::as_type<dolfin::EigenVector>(*(eafe_beta->vector())).data();
+  const dolfin::la_index* phi_dofs = _eafe_dofs[0].data();
+  const std::size_t eafe_size = _eafe_dofs[0].size();
 
-    if (_valency_double[eqn_idx] != 0.0) {
-      *(phi->vector()) *= _valency_double[eqn_idx];
-      *beta->vector() += *phi->vector();
+  for (uint eqn_idx = 1; eqn_idx < eqns; eqn_idx++) {
+    const dolfin::la_index* eta_dofs = _eafe_dofs[eqn_idx].data();
+    const double valency = _valency_double[eqn_idx];
+    for (std::size_t dof = 0; dof < eafe_size; dof++) {
+      eta_values[dof] = solution_values[eta_dofs[dof]];
+      beta_values[dof] = eta_values[dof] + valency * solution_values[phi_dofs[dof]];
     }
 
-    _eafe_bilinear_form->alpha = _split_diffusivity[eqn_idx];
-    _eafe_bilinear_form->beta = beta;
-    _eafe_bilinear_form->eta = eta;
-    _eafe_bilinear_form->gamma = zero;
-
-    dolfin::assemble(*_eafe_matrix, *_eafe_bilinear_form);
-
-    const int* IA = (int*) std::get<0>(_eafe_matrix->data());
-    const int* JA = (int*) std::get<1>(_eafe_matrix->data());
-    const double* values = (double*) std::get<2>(_eafe_matrix->data());
-
-    const int* global_IA = (int*) std::get<0>(_eigen_matrix->data());
-    const int* global_JA = (int*) std::get<1>(_eigen_matrix->data());
-    double* global_values = (double*) std::get<2>(_eigen_matrix->data());
-
-    uint row = 0, new_i = 0;
-    dolfin::la_index global_row, global_col;
-    std::size_t local_size = _eafe_matrix->nnz();
-    for (uint i = 0; i < local_size; i++) {
-
-      // convert local row/col to global row/col
-      while (IA[row + 1] < i + 1) row++;
-      global_row = _dof_map[eqn_idx][row];
-      global_col = _dof_map[eqn_idx][JA[i]];
-
-      // find and replace corresponding row/col in global IA/JA
-      new_i = global_IA[global_row];
-      while (global_JA[new_i] < global_col) new_i++;
-      global_values[new_i] = values[i];
-      // if (global_JA[new_i] != global_col) {
-        // printf("Error : %d != %d\n", global_JA[new_i], global_col); fflush(stdout);
-      // }
-    }
+    // overwrite the species block with the edge-based EAFE
+    _eafe_assembler->assemble(
+      *_bsr_assembler,
+      eqn_idx,
+      _eafe_dofs[eqn_idx],
+      *_eafe_alpha[eqn_idx],
+      *eafe_eta,
+      *eafe_beta
+    );
   }
 }
 //--------------------------------------
 std::vector<std::shared_ptr<dolfin::Function>> Linear_PNP::split_mixed_function (
   std::shared_ptr<const dolfin::Function> mixed_function
 ) {
-  //construct assignment arguments
-  std::shared_ptr<const dolfin::FunctionSpace> mixed_space(
-    mixed_function->function_space()
+  const Component_Split& split = Linear_PNP::get_component_split(
+    *(mixed_function->function_space())
   );
 
-  // construct receiving arguments
   std::vector<std::shared_ptr<dolfin::Function>> function_vector;
-  std::vector<std::shared_ptr<const dolfin::FunctionSpace>> subspace_vector;
+  for (std::size_t c = 0; c < split.spaces.size(); c++) {
+    function_vector.push_back(std::make_shared<dolfin::Function>(split.spaces[c]));
+  }
+  Linear_PNP::split_mixed_function(*mixed_function, function_vector);
 
-  // initialize vectors
-  std::shared_ptr<dolfin::Function> subfunction;
-  std::shared_ptr<const dolfin::FunctionSpace> subspace;
-  std::size_t num_components = mixed_space->element()->num_sub_elements();
+  return function_vector;
+}
+//--------------------------------------
+void Linear_PNP::split_mixed_function (
+  const dolfin::Function& mixed_function,
+  std::vector<std::shared_ptr<dolfin::Function>>& function_vector
+) {
+  const Component_Split& split = Linear_PNP::get_component_split(
+    *(mixed_function.function_space())
+  );
+  const double* mixed_values = dolfin::as_type<const dolfin::EigenVector>(
+    *(mixed_function.vector())
+  ).data();
+
+  for (std::size_t c = 0; c < split.dofs.size(); c++) {
+    double* values = dolfin::as_type<dolfin::EigenVector>(*(function_vector[c]->vector())).data();
+    const dolfin::la_index* dofs = split.dofs[c].data();
+    const std::size_t size = split.dofs[c].size();
+    for (std::size_t dof = 0; dof < size; dof++) {
+      values[dof] = mixed_values[dofs[dof]];
+    }
+  }
+}
+//--------------------------------------
+const Linear_PNP::Component_Split& Linear_PNP::get_component_split (
+  const dolfin::FunctionSpace& mixed_space
+) {
+  // splits on an older mesh would keep that mesh alive
+  const std::size_t mesh_id = mixed_space.mesh()->id();
+  if (_component_splits_mesh_id != mesh_id) {
+    _component_splits.clear();
+    _component_splits_mesh_id = mesh_id;
+  }
+
+  std::map<std::size_t, Component_Split>::const_iterator found;
+  found = _component_splits.find(mixed_space.id());
+  if (found != _component_splits.end()) {
+    return found->second;
+  }
 
+  Component_Split& split = _component_splits[mixed_space.id()];
+  std::size_t num_components = mixed_space.element()->num_sub_elements();
   for (std::size_t c = 0; c < num_components; c++) {
-    subspace.reset(
-      new const dolfin::FunctionSpace( *( (*mixed_space)[c]->collapse() ) )
+    std::unordered_map<std::size_t, std::size_t> collapsed_dofs;
+    std::shared_ptr<const dolfin::FunctionSpace> subspace(
+      mixed_space[c]->collapse(collapsed_dofs)
     );
-    subfunction.reset(new dolfin::Function(subspace));
 
-    subspace_vector.push_back(subspace);
-    function_vector.push_back(subfunction);
-  }
+    std::vector<dolfin::la_index> dofs(collapsed_dofs.size());
+    std::unordered_map<std::size_t, std::size_t>::const_iterator dof;
+    for (dof = collapsed_dofs.begin(); dof != collapsed_dofs.end(); ++dof) {
+      dofs[dof->first] = dof->second;
+    }
 
-  // assign
-  dolfin::FunctionAssigner function_assigner(subspace_vector, mixed_space);
-  function_assigner.assign(function_vector, mixed_function);
+    split.spaces.push_back(subspace);
+    split.dofs.push_back(dofs);
+  }
 
-  return function_vector;
+  return split;
 }
 
 //-------------------------------------
@@ -380,6 +719,7 @@ void Linear_PNP::init_BC (double Lx, double Ly, double Lz)
   // _dirichletBC.push_back(BC2);
   // _dirichletBC.push_back(BC3);
 
+  PDE::invalidate_residual();
 }
 //--------------------------------------
 
@@ -394,5 +734,7 @@ void Linear_PNP::init_measure (std::shared_ptr<const dolfin::Mesh> mesh,
   sp_domain.mark(*markers,1);
 
   _linear_form->set_exterior_facet_domains(markers);
+
+  PDE::invalidate_residual();
 }
 //--------------------------------------
@@ -9,7 +9,11 @@
 #include "pde.h"
 #include "domain.h"
 #include "dirichlet.h"
-#include "EAFE.h"
+#include "eafe_assembler.h"
+#include "bsr_assembler.h"
+#include "preconditioner_cache.h"
+#include "amg_cache.h"
+#include "pnp_jacobian_operator.h"
 extern "C" {
   #include "fasp.h"
   #include "fasp_functs.h"
@@ -60,14 +64,72 @@ class Linear_PNP : public PDE {
 
     void free_fasp ();
 
+    /// tolerance of the outer Krylov solve, e.g. an
+    /// inexact Newton forcing term
+    void set_linear_tolerance (
+      const double tolerance
+    );
+
+    /// iteration limit of the outer Krylov solve, e.g. raised
+    /// to retry a solve that ran out of iterations
+    void set_max_krylov_iterations (
+      const INT max_iterations
+    );
+    INT krylov_iterations = 0;
+
     void apply_eafe ();
     void use_eafe ();
     void no_eafe ();
 
+    /// Rebuild the EAFE diffusivity and valency on the next solve
+    void coefficients_changed ();
+
+    /// Jacobian-free Newton-Krylov: the Krylov solver applies the
+    /// Jacobian as a finite difference of residuals, and the
+    /// Jacobian is only assembled to refresh the ILU preconditioner
+    void use_jfnk ();
+    void no_jfnk ();
+
+    /// As use_jfnk, with the Jacobian applied cell by cell by a
+    /// PNP_Jacobian_Operator instead of finite differences
+    void use_matrix_free ();
+
+    /// The matrix-free Jacobian, linearized at the current solution
+    std::shared_ptr<PNP_Jacobian_Operator> get_jacobian_operator ();
+
+    /// Finite difference Jacobian action y = J x at the current
+    /// solution, given the residual there in _jfnk_base
+    void jacobian_action (
+      const double* x,
+      double* y
+    );
+
+    /// One decoupled Gummel sweep: the potential from the Poisson
+    /// block of the Jacobian with the concentrations fixed, then
+    /// each species from its Nernst-Planck block at the new
+    /// potential. Every block is a scalar system preconditioned
+    /// by its own cached AMG, so a sweep is much cheaper than a
+    /// monolithic solve but converges only linearly; use sweeps
+    /// as the solver for weak coupling or as a Newton initial guess.
+    /// If a block solve fails, the sweep stops there, the solution
+    /// keeps the updates of the earlier stages only, and
+    /// krylov_iterations is set to the negative FASP status
+    dolfin::Function gummel_solve ();
+
+    /// Krylov iterations summed over the blocks of the last sweep
+    INT gummel_iterations = 0;
+
     std::vector<std::shared_ptr<dolfin::Function>> split_mixed_function (
       std::shared_ptr<const dolfin::Function> mixed_function
     );
 
+    /// Copy the components of a mixed function into functions
+    /// on the collapsed subspaces, allocated by the caller
+    void split_mixed_function (
+      const dolfin::Function& mixed_function,
+      std::vector<std::shared_ptr<dolfin::Function>>& function_vector
+    );
+
     dolfin::Function get_total_charge ();
     void init_BC (double Lx, double Ly, double Lz);
     void init_measure (std::shared_ptr<const dolfin::Mesh> mesh,
@@ -80,27 +142,86 @@ class Linear_PNP : public PDE {
     std::shared_ptr<dolfin::FunctionSpace> phib_space;
 
   private:
+    /// Assemble the Jacobian into the block matrix, with EAFE
+    void assemble_jacobian ();
+
     // FASP
     itsolver_param _itsolver;
     AMG_param _amg;
     ILU_param _ilu;
-    dCSRmat _fasp_matrix;
-    dBSRmat _fasp_bsr_matrix;
+    std::shared_ptr<BSR_Assembler> _bsr_assembler;
+    std::shared_ptr<Preconditioner_Cache> _preconditioner;
     dvector _fasp_vector;
     dvector _fasp_soln;
     bool _faps_soln_unallocated = true;
 
-    // EAFE
+    // mesh of the last assembled Jacobian
+    std::size_t _jacobian_mesh_id;
+    bool _jacobian_uninitialized = true;
+
+    // JFNK: the saved solution, its residual, the perturbation and
+    // perturbed residual, and the Dirichlet dofs with identity rows
+    bool _use_jfnk = false;
+    bool _use_matrix_free = false;
+    std::shared_ptr<PNP_Jacobian_Operator> _jacobian_operator;
+    std::vector<double> _jfnk_state;
+    std::vector<double> _jfnk_base;
+    std::vector<double> _jfnk_perturbation;
+    std::shared_ptr<dolfin::EigenVector> _jfnk_residual;
+    std::vector<dolfin::la_index> _jfnk_dirichlet_dofs;
+    void init_jfnk ();
+    static void apply_jacobian (
+      const void* data,
+      const REAL* x,
+      REAL* y
+    );
+
+    // Gummel: the scalar block, AMG hierarchy and vectors of each
+    // component, valid for one block pattern
+    std::vector<dCSRmat> _gummel_matrices;
+    std::vector<std::vector<int>> _gummel_offsets;
+    std::vector<std::shared_ptr<AMG_Cache>> _gummel_amg;
+    std::vector<dvector> _gummel_rhs;
+    std::vector<dvector> _gummel_soln;
+    std::vector<double> _gummel_update;
+    std::size_t _gummel_pattern_count = 0;
+    void init_gummel ();
+    void free_gummel ();
+
+    /// Solve the diagonal blocks of some components at the
+    /// current solution, each on its own, and add the updates.
+    /// Returns the status of the first failed solve, in which
+    /// case no update is added, and 0 otherwise
+    INT gummel_update (
+      const std::vector<std::size_t>& components
+    );
+
+    // EAFE, set up once per mesh
     bool _use_eafe = false;
     bool _eafe_uninitialized = true;
-    std::shared_ptr<EAFE::BilinearForm> _eafe_bilinear_form;
-    std::shared_ptr<dolfin::FunctionSpace> _eafe_function_space;
+    std::size_t _eafe_mesh_id;
+    std::shared_ptr<EAFE_Assembler> _eafe_assembler;
+    std::shared_ptr<const dolfin::FunctionSpace> _eafe_function_space;
 
-    std::vector<std::shared_ptr<dolfin::Function>> _split_diffusivity;
+    std::vector<std::shared_ptr<dolfin::Function>> _eafe_alpha;
     std::vector<double> _valency_double;
 
+    // map from EAFE dofs to dofs of each component of the solution
+    std::vector<std::vector<dolfin::la_index>> _eafe_dofs;
     std::shared_ptr<dolfin::Function> eafe_beta, eafe_eta;
-    std::shared_ptr<dolfin::EigenMatrix> _eafe_matrix;
+
+    // collapsed subspaces of a mixed space and the map from their
+    // dofs to dofs of the mixed space, cached per mixed space
+    // of the current mesh
+    struct Component_Split {
+      std::vector<std::shared_ptr<const dolfin::FunctionSpace>> spaces;
+      std::vector<std::vector<dolfin::la_index>> dofs;
+    };
+    std::map<std::size_t, Component_Split> _component_splits;
+    std::size_t _component_splits_mesh_id = 0;
+    const Component_Split& get_component_split (
+      const dolfin::FunctionSpace& mixed_space
+    );
 
 };
 
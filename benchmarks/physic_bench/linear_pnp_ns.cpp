@@ -1,11 +1,13 @@
 #include <iostream>
 #include <fstream>
 #include <string.h>
+#include <unordered_map>
 #include <dolfin.h>
 #include <ufc.h>
 #include "pde.h"
 #include "domain.h"
 #include "dirichlet.h"
+#include "phase_timer.h"
 #include "EAFE.h"
 extern "C" {
   #include "fasp.h"
@@ -58,13 +60,8 @@ Linear_PNP_NS::Linear_PNP_NS (
   _nsitsolver = nsitsolver;
   _nsamg = nsamg;
 
-   _fasp_block_matrix.brow = 2;
-   _fasp_block_matrix.bcol = 2;
-   _fasp_block_matrix.blocks = (dCSRmat **)calloc(4, sizeof(dCSRmat *));
-   fasp_mem_check((void *)_fasp_block_matrix.blocks, "block matrix:cannot allocate memory!\n", ERROR_ALLOC_MEM);
-   for (int i=0; i<4 ;i++) {
-       _fasp_block_matrix.blocks[i] = (dCSRmat *)fasp_mem_calloc(1, sizeof(dCSRmat));
-   }
+  // sized by get_dofs_fasp
+  _fasp_workspace.reset(new FASP_Block_Workspace());
 }
 //--------------------------------------
 Linear_PNP_NS::~Linear_PNP_NS () {}
@@ -111,6 +108,8 @@ void Linear_PNP_NS::get_dofs_fasp(std::vector<std::size_t> pnp_dimensions,std::v
       count++;
   }
 
+  _fasp_workspace->init(_pnp_dofs, _stokes_dofs);
+  _update_map_uninitialized = true;
 
 }
 
@@ -121,17 +120,15 @@ void Linear_PNP_NS::EigenVector_to_dvector_block (
 ) {
   int i;
   int row = (int) eigen_vector->size();
-  double * val = (double*) eigen_vector->data();
-  if (row < 1) {
-    fasp_chkerr(ERROR_INPUT_PAR, "EigenVector_to_dvector");
+  const double * val = eigen_vector->data();
+  if (row < 1 || vector->row != _pnp_dofs.row + _stokes_dofs.row) {
+    fasp_chkerr(ERROR_INPUT_PAR, "EigenVector_to_dvector_block");
   }
-  // if( _fasp_vector.row > 0) fasp_dvec_free(&_fasp_vector);
-  _fasp_vector.row = row;
-  fasp_dvec_alloc(row, &_fasp_vector);
+  // the vector is allocated by the caller, e.g. the FASP workspace
   for (i=0; i<_pnp_dofs.row; i++)
-      _fasp_vector.val[i] = val[_pnp_dofs.val[i]];
+      vector->val[i] = val[_pnp_dofs.val[i]];
   for (i=0; i<_stokes_dofs.row; i++)
-      _fasp_vector.val[_pnp_dofs.row + i] = val[_stokes_dofs.val[i]];
+      vector->val[_pnp_dofs.row + i] = val[_stokes_dofs.val[i]];
 
 }
 //--------------------------------------
@@ -148,43 +145,30 @@ void Linear_PNP_NS::setup_fasp_linear_algebra () {
   std::size_t dimension = Linear_PNP_NS::get_solution_dimension();
   EigenMatrix_to_dCSRmat(_eigen_matrix, &_fasp_matrix);
 
-  fasp_dcsr_getblk(&_fasp_matrix, _pnp_dofs.val,  _pnp_dofs.val,    _pnp_dofs.row,
-      _pnp_dofs.row,    _fasp_block_matrix.blocks[0]);
-  fasp_dcsr_getblk(&_fasp_matrix, _pnp_dofs.val,  _stokes_dofs.val, _pnp_dofs.row,
-       _stokes_dofs.row, _fasp_block_matrix.blocks[1]);
-  fasp_dcsr_getblk(&_fasp_matrix, _stokes_dofs.val, _pnp_dofs.val,    _stokes_dofs.row,
-     _pnp_dofs.row,    _fasp_block_matrix.blocks[2]);
-  fasp_dcsr_getblk(&_fasp_matrix, _stokes_dofs.val, _stokes_dofs.val, _stokes_dofs.row,
-     _stokes_dofs.row, _fasp_block_matrix.blocks[3]);
-
-  if (_faps_soln_unallocated) {
-    fasp_dvec_alloc(_eigen_vector->size(), &_fasp_soln);
-    _faps_soln_unallocated = false;
-  }
-  Linear_PNP_NS::EigenVector_to_dvector_block(_eigen_vector, &_fasp_vector);
-
-  fasp_dvec_set(_fasp_vector.row, &_fasp_soln, 0.0);
+  // blocks, right-hand side and zeroed solution in the workspace
+  _fasp_workspace->extract_blocks(&_fasp_matrix);
+  _fasp_workspace->gather_rhs(_eigen_vector->data());
 
   // fasp_dcoo_write("Matrix.txt",&_fasp_matrix);
-  // fasp_dcoo_write("Matrix11.txt",_fasp_block_matrix.blocks[0]);
-  // fasp_dcoo_write("Matrix12.txt",_fasp_block_matrix.blocks[1]);
-  // fasp_dcoo_write("Matrix21.txt",_fasp_block_matrix.blocks[2]);
-  // fasp_dcoo_write("Matrix22.txt",_fasp_block_matrix.blocks[3]);
+  // fasp_dcoo_write("Matrix11.txt",_fasp_workspace->matrix()->blocks[0]);
+  // fasp_dcoo_write("Matrix12.txt",_fasp_workspace->matrix()->blocks[1]);
+  // fasp_dcoo_write("Matrix21.txt",_fasp_workspace->matrix()->blocks[2]);
+  // fasp_dcoo_write("Matrix22.txt",_fasp_workspace->matrix()->blocks[3]);
   // fasp_ivec_write("pnp_dofs.txt",&(_pnp_dofs));
   // fasp_ivec_write("stokes_dofs.txt",&(_stokes_dofs));
-  // fasp_dvec_write("RHS.txt",&(_fasp_vector));
+  // fasp_dvec_write("RHS.txt",_fasp_workspace->rhs());
 
 }
 //--------------------------------------
 std::vector<dolfin::Function> Linear_PNP_NS::fasp_solve () {
   Linear_PNP_NS::setup_fasp_linear_algebra();
-  std::vector<dolfin::Function> solutions(Linear_PNP_NS::get_solutions());
 
   printf("Solving linear system using FASP solver...\n"); fflush(stdout);
+  Phase_Timer solve_timer("FASP PNP-Stokes solve");
   INT status = fasp_solver_bdcsr_krylov_pnp_stokes(
-    &_fasp_block_matrix,
-    &_fasp_vector,
-    &_fasp_soln,
+    _fasp_workspace->matrix(),
+    _fasp_workspace->rhs(),
+    _fasp_workspace->solution(),
     &_itsolver,
     &_pnpitsolver,
     &_pnpamg,
@@ -192,7 +176,12 @@ std::vector<dolfin::Function> Linear_PNP_NS::fasp_solve () {
     &_nsamg,
     _velocity_dofs.row,
     _pressure_dofs.row);
+  solve_timer.stop();
 
+  krylov_iterations = status;
+  if (status > 0) {
+    Phase_Registry::count("Krylov iterations", status);
+  }
   if (status < 0) {
     printf("\n### WARNING: FASP solver failed! Exit status = %d.\n", status);
     fflush(stdout);
@@ -200,39 +189,77 @@ std::vector<dolfin::Function> Linear_PNP_NS::fasp_solve () {
   else {
     printf("Successfully solved the linear system\n");
     fflush(stdout);
-  }
-    dolfin::EigenVector solution_vector(_eigen_vector->mpi_comm(),_eigen_vector->size());
-    double* array = solution_vector.data();
-
-    std::size_t i;
-    for (i=0; i<_pnp_dofs.row; i++)
-        array[_pnp_dofs.val[i]] = _fasp_soln.val[i];
-    for (i=0; i<_stokes_dofs.row;i++)
-        array[_stokes_dofs.val[i]] = _fasp_soln.val[_pnp_dofs.row + i] ;
-
-    dolfin::Function update (
-      Linear_PNP_NS::_convert_EigenVector_to_Function(solution_vector)
-    );
 
-    // This need to change, it copies the same vector 3 times.
-    auto dCation = std::make_shared<dolfin::Function>(update[0]);
-    auto dAnion = std::make_shared<dolfin::Function>(update[1]);
-    auto dPotential = std::make_shared<dolfin::Function>(update[2]);
-
-    dolfin::Function dU = update[3];
-    dolfin::Function dPressure = update[4];
-
-    std::vector<std::shared_ptr<const dolfin::Function>> vvv = {dCation,dAnion,dPotential};
-    auto update_pnp  = std::make_shared<dolfin::Function>(_functions_space[0]);
-    assign(update_pnp , vvv);
+    Linear_PNP_NS::add_block_update(_fasp_workspace->solution()->val);
+  }
 
-    *(solutions[0].vector()) += *(update_pnp->vector());
-    *(solutions[1].vector()) += *(dU.vector());
-    *(solutions[2].vector()) += *(dPressure.vector());
+  return Linear_PNP_NS::get_solutions();
+}
+//--------------------------------------
+void Linear_PNP_NS::add_block_update (
+  const double* block_values
+) {
+  // scatter-add the block solution straight into the solution functions
+  if (_update_map_uninitialized) {
+    Linear_PNP_NS::init_update_map();
+  }
+  for (std::size_t f = 0; f < _update_dofs.size(); f++) {
+    double* values = dolfin::as_type<dolfin::EigenVector>(*(_solution_functions[f]->vector())).data();
+    const int* fasp_index = _update_fasp_index[f].data();
+    const dolfin::la_index* dofs = _update_dofs[f].data();
+    const std::size_t size = _update_dofs[f].size();
+    for (std::size_t i = 0; i < size; i++) {
+      values[dofs[i]] += block_values[fasp_index[i]];
+    }
+  }
+  PDE::invalidate_residual();
+}
+//--------------------------------------
+void Linear_PNP_NS::init_update_map () {
+  // solution function and its dof for each dof of the mixed space:
+  // the leading components form the PNP function, the others are
+  // one function each, numbered as their collapsed subspaces
+  const std::size_t mixed_size = _function_space->dim();
+  std::vector<int> target_function(mixed_size, -1);
+  std::vector<dolfin::la_index> target_dof(mixed_size, -1);
+
+  const std::size_t pnp_components = _functions_space[0]->element()->num_sub_elements();
+  const std::size_t components = _function_space->element()->num_sub_elements();
+  for (std::size_t c = 0; c < components; c++) {
+    std::unordered_map<std::size_t, std::size_t> collapsed_dofs;
+    (*_function_space)[c]->collapse(collapsed_dofs);
+
+    std::unordered_map<std::size_t, std::size_t> pnp_dofs;
+    if (c < pnp_components) {
+      (*_functions_space[0])[c]->collapse(pnp_dofs);
+    }
+
+    std::unordered_map<std::size_t, std::size_t>::const_iterator dof;
+    for (dof = collapsed_dofs.begin(); dof != collapsed_dofs.end(); ++dof) {
+      if (c < pnp_components) {
+        target_function[dof->second] = 0;
+        target_dof[dof->second] = pnp_dofs[dof->first];
+      }
+      else {
+        target_function[dof->second] = c - pnp_components + 1;
+        target_dof[dof->second] = dof->first;
+      }
+    }
+  }
 
-  Linear_PNP_NS::set_solutions(solutions);
+  _update_fasp_index.assign(_solution_functions.size(), std::vector<int>());
+  _update_dofs.assign(_solution_functions.size(), std::vector<dolfin::la_index>());
+  for (int i = 0; i < _pnp_dofs.row + _stokes_dofs.row; i++) {
+    const int mixed_dof = i < _pnp_dofs.row ? _pnp_dofs.val[i] : _stokes_dofs.val[i - _pnp_dofs.row];
+    const int f = target_function[mixed_dof];
+    if (f < 0) {
+      fasp_chkerr(ERROR_DATA_STRUCTURE, "Linear_PNP_NS::init_update_map");
+    }
+    _update_fasp_index[f].push_back(i);
+    _update_dofs[f].push_back(target_dof[mixed_dof]);
+  }
 
-  return solutions;
+  _update_map_uninitialized = false;
 }
 //--------------------------------------
 dolfin::EigenVector Linear_PNP_NS::fasp_test_solver (
@@ -246,15 +273,16 @@ dolfin::EigenVector Linear_PNP_NS::fasp_test_solver (
 
 
   _eigen_matrix->mult(target_vector, *rhs_vector);
-  EigenVector_to_dvector(rhs_vector, &_fasp_vector);
+  Linear_PNP_NS::EigenVector_to_dvector_block(rhs_vector, _fasp_workspace->rhs());
 
   dolfin::Function solution(Linear_PNP_NS::get_solution());
 
   printf("Solving linear system using FASP solver...\n"); fflush(stdout);
+  Phase_Timer solve_timer("FASP PNP-Stokes solve");
   INT status = fasp_solver_bdcsr_krylov_pnp_stokes(
-    &_fasp_block_matrix,
-    &_fasp_vector,
-    &_fasp_soln,
+    _fasp_workspace->matrix(),
+    _fasp_workspace->rhs(),
+    _fasp_workspace->solution(),
     &_itsolver,
     &_pnpitsolver,
     &_pnpamg,
@@ -262,6 +290,7 @@ dolfin::EigenVector Linear_PNP_NS::fasp_test_solver (
     &_nsamg,
     _velocity_dofs.row,
     _pressure_dofs.row);
+  solve_timer.stop();
 
   if (status < 0) {
     printf("\n### WARNING: FASP solver failed! Exit status = %d.\n", status);
@@ -275,18 +304,23 @@ dolfin::EigenVector Linear_PNP_NS::fasp_test_solver (
 
   dolfin::EigenVector solution_vector(_eigen_vector->mpi_comm(),_eigen_vector->size());
   double* array = solution_vector.data();
-  for (std::size_t i = 0; i < _fasp_soln.row; ++i) {
-    array[i] = _fasp_soln.val[i];
+  const dvector* fasp_solution = _fasp_workspace->solution();
+  for (std::size_t i = 0; i < fasp_solution->row; ++i) {
+    array[i] = fasp_solution->val[i];
   }
 
   return solution_vector;
 }
 //--------------------------------------
+void Linear_PNP_NS::set_linear_tolerance (
+  const double tolerance
+) {
+  _itsolver.tol = tolerance;
+}
+//--------------------------------------
 void Linear_PNP_NS::free_fasp () {
-  // fasp_dcsr_free(&_fasp_matrix);
-  fasp_bdcsr_free(&_fasp_block_matrix);
-  fasp_dvec_free(&_fasp_vector);
-  fasp_dvec_free(&_fasp_soln);
+  // _fasp_matrix only points into the EigenMatrix
+  _fasp_workspace->free_workspace();
 }
 //--------------------------------------
 
@@ -327,6 +361,8 @@ void Linear_PNP_NS::init_BC (double Lx,double Ly,double Lz) {
   sub_domains->set_value(0, 1);
   auto BC5 = std::make_shared<dolfin::DirichletBC>(_function_space->sub(4),zero,sub_domains,1);
   _dirichletBC.push_back(BC5);
+
+  PDE::invalidate_residual();
 }
 //--------------------------------------
 
@@ -341,5 +377,7 @@ void Linear_PNP_NS::init_measure (std::shared_ptr<const dolfin::Mesh> mesh,
   sp_domain.mark(*markers,1);
 
   _linear_form->set_exterior_facet_domains(markers);
+
+  PDE::invalidate_residual();
 }
 //--------------------------------------
@@ -10,6 +10,7 @@
 #include "domain.h"
 #include "dirichlet.h"
 #include "EAFE.h"
+#include "fasp_block_workspace.h"
 extern "C" {
   #include "fasp.h"
   #include "fasp_functs.h"
@@ -57,14 +58,30 @@ class Linear_PNP_NS : public PDE {
     /// FASP interface
     void setup_fasp_linear_algebra ();
 
+    /// Solve the linearized system and add the update to the
+    /// solutions; a failed solve leaves them unchanged and sets
+    /// krylov_iterations to the negative FASP status
     std::vector<dolfin::Function> fasp_solve ();
 
+    /// Add a vector in the block ordering of get_dofs_fasp, PNP
+    /// dofs first, to the PNP, velocity and pressure solutions
+    void add_block_update (
+      const double* block_values
+    );
+
     dolfin::EigenVector fasp_test_solver (
       const dolfin::EigenVector& target_vector
     );
 
     void free_fasp ();
 
+    /// tolerance of the outer Krylov solve, e.g. an
+    /// inexact Newton forcing term
+    void set_linear_tolerance (
+      const double tolerance
+    );
+    INT krylov_iterations = 0;
+
     void get_dofs_fasp(
       std::vector<std::size_t> pnp_dimensions,
       std::vector<std::size_t> ns_dimensions);
@@ -110,10 +127,14 @@ class Linear_PNP_NS : public PDE {
     AMG_param _pnpamg;
     AMG_ns_param _nsamg;
     dCSRmat _fasp_matrix;
-    block_dCSRmat _fasp_block_matrix;
-    dvector _fasp_vector;
-    dvector _fasp_soln;
-    bool _faps_soln_unallocated = true;
+    std::shared_ptr<FASP_Block_Workspace> _fasp_workspace;
+
+    // for each solution function, the FASP solution entries
+    // and the dofs they are added to, built once per dof layout
+    bool _update_map_uninitialized = true;
+    std::vector<std::vector<int>> _update_fasp_index;
+    std::vector<std::vector<dolfin::la_index>> _update_dofs;
+    void init_update_map ();
 
     // EAFE
     bool _use_eafe = false;
@@ -11,6 +11,7 @@
 #include "newton_status.h"
 #include "domain.h"
 #include "dirichlet.h"
+#include "phase_timer.h"
 extern "C" {
   #include "fasp.h"
   #include "fasp_functs.h"
@@ -199,10 +200,12 @@ int main (int argc, char** argv) {
     printf("\tmaximum residual :  %10.5e\n", newton.max_residual);
     printf("\trelative residual : %10.5e\n", newton.relative_residual);
     printf("\toutput solution to file...\n");
+    Phase_Timer output_timer("file output");
     solution_file0 << solutionFn[0];
     solution_file1 << solutionFn[1];
     solution_file2 << solutionFn[2];
     xmlSolution << solutionFn;
+    output_timer.stop();
     printf("\n");
   }
 
@@ -214,6 +217,9 @@ int main (int argc, char** argv) {
     newton.print_status();
   }
 
+  Phase_Registry::print_table();
+  Phase_Registry::write_json("./benchmarks/physic_bench/output/timings.json");
+
   printf("Solver exiting\n"); fflush(stdout);
   return 0;
 }
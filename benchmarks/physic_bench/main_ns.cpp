@@ -10,6 +10,7 @@
 #include "newton_status.h"
 #include "domain.h"
 #include "dirichlet.h"
+#include "phase_timer.h"
 #include "error.h"
 extern "C" {
   #include "fasp.h"
@@ -260,6 +261,10 @@ int main (int argc, char** argv) {
     // solve
     printf("Solving for Newton iterate %lu \n", newton.iteration);
     solutionFn = pnp_ns_problem.fasp_solve();
+    if (pnp_ns_problem.krylov_iterations < 0) {
+      printf("Linear solver failed, the solution is unchanged... stopping\n");
+      break;
+    }
 
     // update newton measurements
     printf("Newton measurements for iteration :\n");
@@ -272,6 +277,7 @@ int main (int argc, char** argv) {
     printf("\tmaximum residual :  %10.5e\n", newton.max_residual);
     printf("\trelative residual : %10.5e\n", newton.relative_residual);
     printf("\toutput solution to file...\n");
+    Phase_Timer output_timer("file output");
     solution_file0 << solutionFn[0][0];
     solution_file1 << solutionFn[0][1];
     solution_file2 << solutionFn[0][2];
@@ -281,6 +287,7 @@ int main (int argc, char** argv) {
     xml_pnp << solutionFn[0];
     xml_vel << solutionFn[1];
     xml_pressure<< solutionFn[2];
+    output_timer.stop();
 
   }
 
@@ -299,6 +306,8 @@ int main (int argc, char** argv) {
   xml_file0 << solutionFn[0];
   xml_file1 << solutionFn[1];
 
+  Phase_Registry::print_table();
+  Phase_Registry::write_json("./benchmarks/physic_bench/output_NS/timings.json");
 
   printf("Solver exiting\n"); fflush(stdout);
   return 0;
@@ -0,0 +1,242 @@
+/// Performance sweep of the PNP+Stokes pipeline over box and sphere meshes
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <time.h>
+#include <stdlib.h>
+#include <dolfin.h>
+#include "pde.h"
+#include "newton_status.h"
+#include "domain.h"
+#include "dirichlet.h"
+#include "phase_timer.h"
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_functs.h"
+  #include "fasp4ns.h"
+  #include "fasp4ns_functs.h"
+}
+
+#include "vector_linear_pnp_ns_forms.h"
+#include "linear_pnp_ns.h"
+#include "performance.h"
+
+using namespace std;
+
+Performance_Record run_pnp_ns (
+  const std::string mesh_name,
+  std::shared_ptr<dolfin::Mesh> mesh,
+  const std::size_t max_newton,
+  const std::size_t threads
+);
+
+int main (int argc, char** argv) {
+  printf("\n");
+  printf("----------------------------------------------------\n");
+  printf(" PNP+Stokes performance sweep\n");
+  printf("----------------------------------------------------\n\n");
+  fflush(stdout);
+
+  // Need to use Eigen for linear algebra
+  dolfin::parameters["linear_algebra_backend"] = "Eigen";
+  dolfin::parameters["allow_extrapolation"] = true;
+
+  std::string output_dir("./benchmarks/physic_bench/output_performance/");
+  boost::filesystem::create_directories(output_dir);
+
+  // a fixed number of Newton steps keeps runs comparable
+  const std::size_t max_newton = 5;
+
+  // box meshes refined uniformly, then the sphere meshes; peak RSS
+  // is a high-water mark for the process, so run small meshes first
+  std::vector<Performance_Record> records;
+  const std::vector<std::size_t> box_levels = {4, 8, 12};
+  for (std::size_t level = 0; level < box_levels.size(); level++) {
+    const std::size_t n = box_levels[level];
+    auto mesh = performance_box_mesh(2.0, 2.0, 2.0, n, n, n);
+    records.push_back(run_pnp_ns("box_" + std::to_string(n), mesh, max_newton, 0));
+  }
+
+  const std::vector<std::string> sphere_meshes = {"mesh1", "mesh2", "mesh3"};
+  for (std::size_t i = 0; i < sphere_meshes.size(); i++) {
+    auto mesh = std::make_shared<dolfin::Mesh>(
+      "./benchmarks/physic_bench/" + sphere_meshes[i] + ".xml.gz"
+    );
+    records.push_back(run_pnp_ns(sphere_meshes[i], mesh, max_newton, 0));
+  }
+
+  write_performance_csv(records, output_dir + "pnp_ns_performance.csv");
+  write_performance_json(records, output_dir + "pnp_ns_performance.json");
+  printf("Wrote %s\n", (output_dir + "pnp_ns_performance.csv").c_str());
+
+  // assembly scaling on the largest box mesh, one run per thread count
+  std::vector<Performance_Record> scaling_records;
+  const std::vector<std::size_t> thread_counts = performance_thread_counts();
+  const std::size_t n = box_levels.back();
+  auto scaling_mesh = performance_box_mesh(2.0, 2.0, 2.0, n, n, n);
+  for (std::size_t i = 0; i < thread_counts.size(); i++) {
+    scaling_records.push_back(
+      run_pnp_ns("box_" + std::to_string(n), scaling_mesh, max_newton, thread_counts[i])
+    );
+  }
+
+  write_performance_csv(scaling_records, output_dir + "pnp_ns_scaling.csv");
+  write_performance_json(scaling_records, output_dir + "pnp_ns_scaling.json");
+  printf("Wrote %s\n", (output_dir + "pnp_ns_scaling.csv").c_str());
+
+  return 0;
+}
+
+//-------------------------------------
+Performance_Record run_pnp_ns (
+  const std::string mesh_name,
+  std::shared_ptr<dolfin::Mesh> mesh,
+  const std::size_t max_newton,
+  const std::size_t threads
+) {
+  printf("\nRunning PNP+Stokes on %s (%lu cells)\n", mesh_name.c_str(), mesh->num_cells());
+  fflush(stdout);
+  Phase_Registry::reset();
+  Phase_Timer total_timer("total");
+
+  std::vector<double> lengths = performance_mesh_lengths(*mesh);
+  const double Lx = lengths[0], Ly = lengths[1], Lz = lengths[2];
+
+  // same solver settings as main_ns.cpp
+  input_param inpar;
+  itsolver_param itpar;
+  AMG_param amgpar;
+  ILU_param ilupar;
+  char fasp_params[] = "./benchmarks/physic_bench/bcsr.dat";
+  fasp_param_input(fasp_params, &inpar);
+  fasp_param_init(&inpar, &itpar, &amgpar, &ilupar, NULL);
+
+  input_param pnp_inpar;
+  itsolver_param pnp_itpar;
+  AMG_param pnp_amgpar;
+  ILU_param pnp_ilupar;
+  Schwarz_param pnp_schpar;
+  char fasp_pnp_params[] = "./benchmarks/physic_bench/bsr.dat";
+  fasp_param_input(fasp_pnp_params, &pnp_inpar);
+  fasp_param_init(&pnp_inpar, &pnp_itpar, &pnp_amgpar, &pnp_ilupar, &pnp_schpar);
+
+  input_ns_param ns_inpar;
+  itsolver_ns_param ns_itpar;
+  AMG_ns_param ns_amgpar;
+  ILU_param ns_ilupar;
+  Schwarz_param ns_schpar;
+  char fasp_ns_params[] = "./benchmarks/physic_bench/ns.dat";
+  fasp_ns_param_input(fasp_ns_params, &ns_inpar);
+  fasp_ns_param_init(&ns_inpar, &ns_itpar, &ns_amgpar, &ns_ilupar, &ns_schpar);
+
+  // same problem as main_ns.cpp
+  std::shared_ptr<dolfin::FunctionSpace> function_space;
+  std::shared_ptr<dolfin::Form> bilinear_form;
+  std::shared_ptr<dolfin::Form> linear_form;
+  function_space.reset(
+    new vector_linear_pnp_ns_forms::FunctionSpace(mesh)
+  );
+  bilinear_form.reset(
+    new vector_linear_pnp_ns_forms::Form_a(function_space, function_space)
+  );
+  linear_form.reset(
+    new vector_linear_pnp_ns_forms::Form_L(function_space)
+  );
+  std::vector<std::shared_ptr<dolfin::FunctionSpace>> functions_space;
+  functions_space.push_back(std::make_shared<vector_linear_pnp_ns_forms::CoefficientSpace_cc>(mesh));
+  functions_space.push_back(std::make_shared<vector_linear_pnp_ns_forms::CoefficientSpace_uu>(mesh));
+  functions_space.push_back(std::make_shared<vector_linear_pnp_ns_forms::CoefficientSpace_pp>(mesh));
+
+  double Eps = .019044;
+  std::map<std::string, std::vector<double>> coefficients = {
+    {"permittivity", {Eps}},
+    {"diffusivity0", {1.0}},
+    {"diffusivity1", {1.334/2.032}},
+    {"valency0", {1.0}},
+    {"valency1", {-1.0}},
+    {"mu", {1.0}},
+    {"penalty1", {1.0}},
+    {"penalty2", {1.0}},
+    {"Re", {0.01}},
+  };
+  std::map<std::string, std::vector<double>> sources = {{"g",{Eps*10.0}}};
+  const std::vector<std::string> variables = {"cc","uu","pp"};
+
+  Linear_PNP_NS pnp_ns_problem (
+    mesh,
+    function_space,
+    functions_space,
+    bilinear_form,
+    linear_form,
+    coefficients,
+    sources,
+    itpar,
+    pnp_itpar,
+    pnp_amgpar,
+    ns_itpar,
+    ns_amgpar,
+    variables
+  );
+
+  pnp_ns_problem.set_assembly_threads(threads);
+  printf("\tassembly threads : %lu\n", pnp_ns_problem.get_assembly_threads());
+  pnp_ns_problem.get_dofs();
+  pnp_ns_problem.get_dofs_fasp({0,1,2},{3,4});
+  pnp_ns_problem.init_BC(Lx, Ly, Lz);
+  pnp_ns_problem.init_measure(mesh, Lx, Ly, Lz);
+
+  // constant initial guess, as in the earlier main_ns.cpp runs
+  auto initpnp = std::make_shared<dolfin::Constant>(1.0, -1.0, -1.0);
+  auto initvel = std::make_shared<dolfin::Constant>(0.0, 0.0, 0.0);
+  auto initp = std::make_shared<dolfin::Constant>(0.0);
+  dolfin::Function pnp_init(pnp_ns_problem._functions_space[0]);
+  dolfin::Function u_init(pnp_ns_problem._functions_space[1]);
+  dolfin::Function p_init(pnp_ns_problem._functions_space[2]);
+  pnp_init.interpolate(*initpnp);
+  u_init.interpolate(*initvel);
+  p_init.interpolate(*initp);
+  std::vector<dolfin::Function> initial_guess;
+  initial_guess.push_back(pnp_init);
+  initial_guess.push_back(u_init);
+  initial_guess.push_back(p_init);
+  pnp_ns_problem.set_solutions(initial_guess);
+
+  const double initial_residual = pnp_ns_problem.compute_residual("l2");
+  Newton_Status newton(
+    max_newton,
+    initial_residual,
+    1.0e-8,
+    1.0e-8
+  );
+
+  // resident memory after each step should stay flat
+  std::vector<long> newton_rss_kb;
+  while (newton.needs_to_iterate()) {
+    pnp_ns_problem.fasp_solve();
+    if (pnp_ns_problem.krylov_iterations < 0) {
+      printf("\tLinear solver failed, the solution is unchanged... stopping\n");
+      break;
+    }
+    double residual = pnp_ns_problem.compute_residual("l2");
+    double max_residual = pnp_ns_problem.compute_residual("max");
+    newton.update_residuals(residual, max_residual);
+    newton.update_iteration();
+    newton_rss_kb.push_back(current_rss_kb());
+    printf("\tresident memory : %ld kB\n", newton_rss_kb.back());
+  }
+
+  Performance_Record record;
+  record.newton_rss_kb = newton_rss_kb;
+  record.pipeline = "pnp_ns";
+  record.mesh_name = mesh_name;
+  record.cells = mesh->num_cells();
+  record.dofs = function_space->dim();
+  record.threads = pnp_ns_problem.get_assembly_threads();
+  record.newton_iterations = newton.iteration - 1;
+  record.total_seconds = total_timer.stop();
+  performance_collect(record);
+
+  Phase_Registry::print_table();
+  return record;
+}
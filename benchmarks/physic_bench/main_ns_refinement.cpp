@@ -8,6 +8,7 @@
 #include <dolfin.h>
 #include "mesh_refiner.h"
 #include "domain.h"
+#include "phase_timer.h"
 extern "C" {
   #include "fasp.h"
   #include "fasp_functs.h"
@@ -223,13 +224,10 @@ int main (int argc, char** argv) {
       mesh_adapt.max_elements = (std::size_t) std::floor( growth_factor * mesh->num_cells() );
       mesh_adapt.multilevel_refinement(diffusivity, entropy_potential, log_densities);
 
-      // update solution
-      adaptive_solution[0].reset( new dolfin::Function(computed_solution[0].function_space()) );
-      adaptive_solution[0]->interpolate(computed_solution[0]);
-      adaptive_solution[1].reset( new dolfin::Function(computed_solution[1].function_space()) );
-      adaptive_solution[1]->interpolate(computed_solution[1]);
-      adaptive_solution[2].reset( new dolfin::Function(computed_solution[2].function_space()) );
-      adaptive_solution[2]->interpolate(computed_solution[2]);
+      // carry the solution to the refined mesh through the refinement history
+      adaptive_solution[0] = mesh_adapt.prolong(computed_solution[0]);
+      adaptive_solution[1] = mesh_adapt.prolong(computed_solution[1]);
+      adaptive_solution[2] = mesh_adapt.prolong(computed_solution[2]);
 
       // adaptive_solution[0]->interpolate(InitialGuess[0]);
       // adaptive_solution[1]->interpolate(InitialGuess[1]);
@@ -254,6 +252,9 @@ int main (int argc, char** argv) {
   pvd_file0 << *adaptive_solution[0];
   pvd_file1 << *adaptive_solution[1];
 
+  Phase_Registry::print_table();
+  Phase_Registry::write_json("./benchmarks/physic_bench/output/timings.json");
+
   return 0;
 }
 
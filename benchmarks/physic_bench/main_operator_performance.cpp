@@ -0,0 +1,215 @@
+/// Throughput of the matrix-free PNP Jacobian against the assembled BSR matrix
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <cmath>
+#include <time.h>
+#include <stdlib.h>
+#include <dolfin.h>
+#include "pde.h"
+#include "domain.h"
+#include "dirichlet.h"
+#include "bsr_assembler.h"
+#include "pnp_jacobian_operator.h"
+#include "phase_timer.h"
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+#include "vector_linear_pnp_forms.h"
+#include "linear_pnp.h"
+#include "performance.h"
+
+using namespace std;
+
+/// one mesh of the operator sweep
+struct Operator_Record {
+  std::string mesh_name;
+  std::size_t cells;
+  std::size_t dofs;
+  std::size_t bsr_bytes;
+  std::size_t operator_bytes;
+  double bsr_seconds;
+  double operator_seconds;
+  double relative_difference;
+};
+
+Operator_Record run_operator (
+  const std::string mesh_name,
+  std::shared_ptr<dolfin::Mesh> mesh,
+  const std::size_t repeats
+);
+
+int main (int argc, char** argv) {
+  printf("\n");
+  printf("----------------------------------------------------\n");
+  printf(" PNP Jacobian application: BSR matrix vs matrix-free\n");
+  printf("----------------------------------------------------\n\n");
+  fflush(stdout);
+
+  // Need to use Eigen for linear algebra
+  dolfin::parameters["linear_algebra_backend"] = "Eigen";
+
+  std::string output_dir("./benchmarks/physic_bench/output_performance/");
+  boost::filesystem::create_directories(output_dir);
+
+  // enough applications to time, as in a Krylov solve
+  const std::size_t repeats = 50;
+
+  std::vector<Operator_Record> records;
+  const std::vector<std::size_t> box_levels = {4, 8, 16};
+  for (std::size_t level = 0; level < box_levels.size(); level++) {
+    const std::size_t n = box_levels[level];
+    auto mesh = performance_box_mesh(20.0, 2.0, 2.0, 10 * n, n, n);
+    records.push_back(run_operator("box_" + std::to_string(n), mesh, repeats));
+  }
+
+  const std::vector<std::string> sphere_meshes = {"mesh1", "mesh2", "mesh3"};
+  for (std::size_t i = 0; i < sphere_meshes.size(); i++) {
+    auto mesh = std::make_shared<dolfin::Mesh>(
+      "./benchmarks/physic_bench/" + sphere_meshes[i] + ".xml.gz"
+    );
+    records.push_back(run_operator(sphere_meshes[i], mesh, repeats));
+  }
+
+  // bandwidth as the bytes each application has to read and write
+  std::string filename = output_dir + "pnp_operator_performance.csv";
+  std::ofstream csv_file;
+  csv_file.open(filename);
+  csv_file << "mesh,cells,dofs,bsr_bytes,operator_bytes,bsr_seconds,operator_seconds,";
+  csv_file << "bsr_gb_per_second,operator_gb_per_second,relative_difference\n";
+  csv_file.precision(6);
+  csv_file << std::scientific;
+  for (std::size_t r = 0; r < records.size(); r++) {
+    const Operator_Record& record = records[r];
+    csv_file << record.mesh_name << "," << record.cells << "," << record.dofs << ",";
+    csv_file << record.bsr_bytes << "," << record.operator_bytes << ",";
+    csv_file << record.bsr_seconds << "," << record.operator_seconds << ",";
+    csv_file << record.bsr_bytes / record.bsr_seconds * 1.0e-9 << ",";
+    csv_file << record.operator_bytes / record.operator_seconds * 1.0e-9 << ",";
+    csv_file << record.relative_difference << "\n";
+  }
+  csv_file.close();
+  printf("Wrote %s\n", filename.c_str());
+
+  return 0;
+}
+
+//-------------------------------------
+Operator_Record run_operator (
+  const std::string mesh_name,
+  std::shared_ptr<dolfin::Mesh> mesh,
+  const std::size_t repeats
+) {
+  printf("\nApplying the PNP Jacobian on %s (%lu cells)\n", mesh_name.c_str(), mesh->num_cells());
+  fflush(stdout);
+  Phase_Registry::reset();
+
+  std::vector<double> lengths = performance_mesh_lengths(*mesh);
+  const double Lx = lengths[0], Ly = lengths[1], Lz = lengths[2];
+
+  char fasp_params[] = "./benchmarks/physic_bench/bsr.dat";
+  input_param input;
+  itsolver_param itsolver;
+  AMG_param amg;
+  ILU_param ilu;
+  fasp_param_input(fasp_params, &input);
+  fasp_param_init(&input, &itsolver, &amg, &ilu, NULL);
+
+  // same problem as main_performance.cpp
+  std::shared_ptr<dolfin::FunctionSpace> function_space;
+  std::shared_ptr<dolfin::Form> bilinear_form;
+  std::shared_ptr<dolfin::Form> linear_form;
+  function_space.reset(
+    new vector_linear_pnp_forms::FunctionSpace(mesh)
+  );
+  bilinear_form.reset(
+    new vector_linear_pnp_forms::Form_a(function_space, function_space)
+  );
+  linear_form.reset(
+    new vector_linear_pnp_forms::Form_L(function_space)
+  );
+
+  double Eps = 1E-3;
+  std::map<std::string, std::vector<double>> pnp_coefficients = {
+    {"permittivity", {Eps}},
+    {"diffusivity", {0.0, 1.0, 1.0}},
+    {"valency", {0.0, 1.0, -1.0}}
+  };
+  std::map<std::string, std::vector<double>> pnp_sources = {
+    {"fixed_charge", {0.0}},
+    {"g", {100.0*Eps}}
+  };
+
+  Linear_PNP pnp_problem (
+    mesh,
+    function_space,
+    bilinear_form,
+    linear_form,
+    pnp_coefficients,
+    pnp_sources,
+    itsolver,
+    amg,
+    ilu,
+    "uu"
+  );
+  pnp_problem.init_BC(Lx, Ly, Lz);
+  pnp_problem.init_measure(mesh, Lx, Ly, Lz);
+
+  Linear_Function Phi(0, -Lx/2.0, Lx/2.0, -1.0, 1.0);
+  Linear_Function Eta1(0, -Lx/2.0, Lx/2.0, 0.0, -2.30258509299);
+  Linear_Function Eta2(0, -Lx/2.0, Lx/2.0, -2.30258509299, 0.0);
+  std::vector<Linear_Function> initial_guess = {Phi, Eta1, Eta2};
+  pnp_problem.set_solution(initial_guess);
+
+  // the assembled Galerkin Jacobian, without EAFE
+  BSR_Assembler bsr_assembler(pnp_problem.get_solution_dimension());
+  bsr_assembler.assemble(*(pnp_problem._bilinear_form));
+  bsr_assembler.apply(pnp_problem._dirichletBC);
+  dBSRmat* matrix = bsr_assembler.matrix();
+  std::shared_ptr<PNP_Jacobian_Operator> jacobian = pnp_problem.get_jacobian_operator();
+
+  const std::size_t size = function_space->dim();
+  std::vector<double> x(size), y_bsr(size), y_operator(size);
+  for (std::size_t dof = 0; dof < size; dof++) {
+    x[dof] = std::sin(0.1 * dof);
+  }
+
+  for (std::size_t r = 0; r < repeats; r++) {
+    Phase_Timer timer("fasp_blas_dbsr_mxv");
+    fasp_blas_dbsr_mxv(matrix, x.data(), y_bsr.data());
+  }
+  for (std::size_t r = 0; r < repeats; r++) {
+    jacobian->apply(x.data(), y_operator.data());
+  }
+
+  // the operator interpolates exp(uu), so expect a small difference
+  double difference = 0.0, norm = 0.0;
+  for (std::size_t dof = 0; dof < size; dof++) {
+    difference += (y_operator[dof] - y_bsr[dof]) * (y_operator[dof] - y_bsr[dof]);
+    norm += y_bsr[dof] * y_bsr[dof];
+  }
+
+  Operator_Record record;
+  record.mesh_name = mesh_name;
+  record.cells = mesh->num_cells();
+  record.dofs = size;
+  record.bsr_bytes = (std::size_t) matrix->NNZ * matrix->nb * matrix->nb * sizeof(REAL)
+    + (std::size_t) matrix->NNZ * sizeof(INT)
+    + (std::size_t) (matrix->ROW + 1) * sizeof(INT)
+    + 2 * size * sizeof(REAL);
+  record.operator_bytes = jacobian->memory_bytes();
+  record.bsr_seconds = Phase_Registry::total_seconds("fasp_blas_dbsr_mxv") / repeats;
+  record.operator_seconds = Phase_Registry::total_seconds("PNP_Jacobian_Operator::apply") / repeats;
+  record.relative_difference = std::sqrt(difference / norm);
+
+  printf("\tBSR           : %e s per application, %lu bytes\n", record.bsr_seconds, record.bsr_bytes);
+  printf("\tmatrix-free   : %e s per application, %lu bytes\n", record.operator_seconds, record.operator_bytes);
+  printf("\trelative difference : %e\n", record.relative_difference);
+  fflush(stdout);
+
+  bsr_assembler.free_matrix();
+  return record;
+}
@@ -0,0 +1,242 @@
+/// Performance sweep of the PNP pipeline over box and sphere meshes
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <time.h>
+#include <stdlib.h>
+#include <dolfin.h>
+#include "pde.h"
+#include "newton_status.h"
+#include "domain.h"
+#include "dirichlet.h"
+#include "phase_timer.h"
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+#include "vector_linear_pnp_forms.h"
+#include "linear_pnp.h"
+#include "performance.h"
+
+using namespace std;
+
+Performance_Record run_pnp (
+  const std::string mesh_name,
+  std::shared_ptr<dolfin::Mesh> mesh,
+  const std::size_t max_newton,
+  const std::size_t threads
+);
+
+// run the Newton steps Jacobian-free, set by "phys_pnp_perf jfnk"
+// for finite differences or "phys_pnp_perf matrix_free"
+static bool use_jfnk = false;
+static bool use_matrix_free = false;
+
+// "phys_pnp_perf gummel" iterates decoupled Gummel sweeps instead
+// of Newton steps, "phys_pnp_perf gummel_newton" starts Newton
+// from a few sweeps
+static bool use_gummel = false;
+static std::size_t gummel_sweeps = 0;
+
+// name of the pipeline in the records and output files
+static std::string pipeline = "pnp";
+
+int main (int argc, char** argv) {
+  printf("\n");
+  printf("----------------------------------------------------\n");
+  printf(" PNP performance sweep\n");
+  printf("----------------------------------------------------\n\n");
+  fflush(stdout);
+
+  use_jfnk = (argc > 1 && std::string(argv[1]) == "jfnk");
+  use_matrix_free = (argc > 1 && std::string(argv[1]) == "matrix_free");
+  use_gummel = (argc > 1 && std::string(argv[1]) == "gummel");
+  if (argc > 1 && std::string(argv[1]) == "gummel_newton") {
+    gummel_sweeps = 2;
+  }
+  pipeline = use_matrix_free ? "pnp_matrix_free" : (use_jfnk ? "pnp_jfnk" : "pnp");
+  if (use_gummel) {
+    pipeline = "pnp_gummel";
+  }
+  if (gummel_sweeps > 0) {
+    pipeline = "pnp_gummel_newton";
+  }
+
+  // Need to use Eigen for linear algebra
+  dolfin::parameters["linear_algebra_backend"] = "Eigen";
+
+  std::string output_dir("./benchmarks/physic_bench/output_performance/");
+  boost::filesystem::create_directories(output_dir);
+
+  // a fixed number of Newton steps keeps runs comparable
+  const std::size_t max_newton = 5;
+
+  // box meshes refined uniformly, then the sphere meshes; peak RSS
+  // is a high-water mark for the process, so run small meshes first
+  std::vector<Performance_Record> records;
+  const std::vector<std::size_t> box_levels = {4, 8, 16};
+  for (std::size_t level = 0; level < box_levels.size(); level++) {
+    const std::size_t n = box_levels[level];
+    auto mesh = performance_box_mesh(20.0, 2.0, 2.0, 10 * n, n, n);
+    records.push_back(run_pnp("box_" + std::to_string(n), mesh, max_newton, 0));
+  }
+
+  const std::vector<std::string> sphere_meshes = {"mesh1", "mesh2", "mesh3"};
+  for (std::size_t i = 0; i < sphere_meshes.size(); i++) {
+    auto mesh = std::make_shared<dolfin::Mesh>(
+      "./benchmarks/physic_bench/" + sphere_meshes[i] + ".xml.gz"
+    );
+    records.push_back(run_pnp(sphere_meshes[i], mesh, max_newton, 0));
+  }
+
+  write_performance_csv(records, output_dir + pipeline + "_performance.csv");
+  write_performance_json(records, output_dir + pipeline + "_performance.json");
+  printf("Wrote %s\n", (output_dir + pipeline + "_performance.csv").c_str());
+
+  // assembly scaling on the largest box mesh, one run per thread count
+  std::vector<Performance_Record> scaling_records;
+  const std::vector<std::size_t> thread_counts = performance_thread_counts();
+  const std::size_t n = box_levels.back();
+  auto scaling_mesh = performance_box_mesh(20.0, 2.0, 2.0, 10 * n, n, n);
+  for (std::size_t i = 0; i < thread_counts.size(); i++) {
+    scaling_records.push_back(
+      run_pnp("box_" + std::to_string(n), scaling_mesh, max_newton, thread_counts[i])
+    );
+  }
+
+  write_performance_csv(scaling_records, output_dir + pipeline + "_scaling.csv");
+  write_performance_json(scaling_records, output_dir + pipeline + "_scaling.json");
+  printf("Wrote %s\n", (output_dir + pipeline + "_scaling.csv").c_str());
+
+  return 0;
+}
+
+//-------------------------------------
+Performance_Record run_pnp (
+  const std::string mesh_name,
+  std::shared_ptr<dolfin::Mesh> mesh,
+  const std::size_t max_newton,
+  const std::size_t threads
+) {
+  printf("\nRunning PNP on %s (%lu cells)\n", mesh_name.c_str(), mesh->num_cells());
+  fflush(stdout);
+  Phase_Registry::reset();
+  Phase_Timer total_timer("total");
+
+  std::vector<double> lengths = performance_mesh_lengths(*mesh);
+  const double Lx = lengths[0], Ly = lengths[1], Lz = lengths[2];
+
+  char fasp_params[] = "./benchmarks/physic_bench/bsr.dat";
+  input_param input;
+  itsolver_param itsolver;
+  AMG_param amg;
+  ILU_param ilu;
+  fasp_param_input(fasp_params, &input);
+  fasp_param_init(&input, &itsolver, &amg, &ilu, NULL);
+
+  // same problem as main.cpp
+  std::shared_ptr<dolfin::FunctionSpace> function_space;
+  std::shared_ptr<dolfin::Form> bilinear_form;
+  std::shared_ptr<dolfin::Form> linear_form;
+  function_space.reset(
+    new vector_linear_pnp_forms::FunctionSpace(mesh)
+  );
+  bilinear_form.reset(
+    new vector_linear_pnp_forms::Form_a(function_space, function_space)
+  );
+  linear_form.reset(
+    new vector_linear_pnp_forms::Form_L(function_space)
+  );
+
+  double Eps = 1E-3;
+  std::map<std::string, std::vector<double>> pnp_coefficients = {
+    {"permittivity", {Eps}},
+    {"diffusivity", {0.0, 1.0, 1.0}},
+    {"valency", {0.0, 1.0, -1.0}}
+  };
+  std::map<std::string, std::vector<double>> pnp_sources = {
+    {"fixed_charge", {0.0}},
+    {"g", {100.0*Eps}}
+  };
+
+  Linear_PNP pnp_problem (
+    mesh,
+    function_space,
+    bilinear_form,
+    linear_form,
+    pnp_coefficients,
+    pnp_sources,
+    itsolver,
+    amg,
+    ilu,
+    "uu"
+  );
+  pnp_problem.set_assembly_threads(threads);
+  printf("\tassembly threads : %lu\n", pnp_problem.get_assembly_threads());
+  pnp_problem.use_eafe();
+  if (use_jfnk) {
+    pnp_problem.use_jfnk();
+  }
+  if (use_matrix_free) {
+    pnp_problem.use_matrix_free();
+  }
+
+  pnp_problem.init_BC(Lx, Ly, Lz);
+  pnp_problem.init_measure(mesh, Lx, Ly, Lz);
+
+  Linear_Function Phi(0, -Lx/2.0, Lx/2.0, -1.0, 1.0);
+  Linear_Function Eta1(0, -Lx/2.0, Lx/2.0, 0.0, -2.30258509299);
+  Linear_Function Eta2(0, -Lx/2.0, Lx/2.0, -2.30258509299, 0.0);
+  std::vector<Linear_Function> initial_guess = {Phi, Eta1, Eta2};
+  pnp_problem.set_solution(initial_guess);
+
+  for (std::size_t sweep = 0; sweep < gummel_sweeps; sweep++) {
+    pnp_problem.gummel_solve();
+    if (pnp_problem.krylov_iterations < 0) {
+      printf("\tGummel sweep %lu failed... starting Newton\n", sweep + 1);
+      break;
+    }
+    printf("\tGummel sweep %lu residual : %e\n", sweep + 1, pnp_problem.compute_residual("l2"));
+  }
+
+  const double initial_residual = pnp_problem.compute_residual("l2");
+  Newton_Status newton(
+    max_newton,
+    initial_residual,
+    1.0e-10,
+    1.0e-10
+  );
+
+  // resident memory after each step should stay flat
+  std::vector<long> newton_rss_kb;
+  while (newton.needs_to_iterate()) {
+    if (use_gummel) {
+      pnp_problem.gummel_solve();
+    }
+    else {
+      pnp_problem.fasp_solve();
+    }
+    double residual = pnp_problem.compute_residual("l2");
+    double max_residual = pnp_problem.compute_residual("max");
+    newton.update_residuals(residual, max_residual);
+    newton.update_iteration();
+    newton_rss_kb.push_back(current_rss_kb());
+    printf("\tresident memory : %ld kB\n", newton_rss_kb.back());
+  }
+
+  Performance_Record record;
+  record.newton_rss_kb = newton_rss_kb;
+  record.pipeline = pipeline;
+  record.mesh_name = mesh_name;
+  record.cells = mesh->num_cells();
+  record.dofs = function_space->dim();
+  record.threads = pnp_problem.get_assembly_threads();
+  record.newton_iterations = newton.iteration - 1;
+  record.total_seconds = total_timer.stop();
+  performance_collect(record);
+
+  Phase_Registry::print_table();
+  return record;
+}
@@ -8,6 +8,7 @@
 #include <dolfin.h>
 #include "mesh_refiner.h"
 #include "domain.h"
+#include "phase_timer.h"
 extern "C" {
   #include "fasp.h"
   #include "fasp_functs.h"
@@ -88,6 +89,8 @@ int main (int argc, char** argv) {
   const double max_residual_tol = 1.0e-10;
   const double relative_residual_tol = 1.0e-10;
   const bool use_eafe_approximation = false;
+  // limit the max-norm of each update instead of backtracking only
+  const bool use_trust_region = false;
 
     Mesh_Refiner mesh_adapt(
       initial_mesh,
@@ -121,6 +124,7 @@ int main (int argc, char** argv) {
         relative_residual_tol,
         initial_residual_ptr,
         use_eafe_approximation,
+        use_trust_region,
         itsolver,
         amg,
         ilu,
@@ -140,7 +144,7 @@ int main (int argc, char** argv) {
       // adapt computed solutions
       mesh_adapt.max_elements = (std::size_t) std::floor(growth_factor * mesh->num_cells());
       mesh_adapt.multilevel_refinement(diffusivity, entropy_potential, log_densities);
-      adaptive_solution = adapt( *computed_solution, mesh_adapt.get_mesh() );
+      adaptive_solution = mesh_adapt.prolong(*computed_solution);
       // adaptive_solution->interpolate(PNP);
 
      adapted_solution_file << *adaptive_solution;
@@ -161,6 +165,9 @@ int main (int argc, char** argv) {
     mesh_file << *mesh_adapt.get_mesh();
     mesh_xml << *mesh_adapt.get_mesh();
 
+    Phase_Registry::print_table();
+    Phase_Registry::write_json("./benchmarks/physic_bench/output/timings.json");
+
     return 0;
 }
 
@@ -0,0 +1,203 @@
+#ifndef __PERFORMANCE_H
+#define __PERFORMANCE_H
+
+/// Shared helpers for the physic_bench performance sweeps
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <dolfin.h>
+#include "domain.h"
+#include "phase_timer.h"
+
+/// measurements for one mesh of a sweep
+struct Performance_Record {
+  std::string pipeline;
+  std::string mesh_name;
+  std::size_t cells;
+  std::size_t dofs;
+  std::size_t threads;
+  std::size_t newton_iterations;
+  long krylov_iterations;
+  double total_seconds;
+  long peak_rss_kb;
+  std::vector<long> newton_rss_kb;
+  std::map<std::string, double> phase_seconds;
+};
+
+/// phases reported as columns of the CSV file
+const std::vector<std::string> performance_phases = {
+  "PDE::setup_linear_algebra",
+  "PDE::EigenMatrix_to_dCSRmat",
+  "PDE::assemble_residual",
+  "Threaded_Assembler::assemble_matrix",
+  "Threaded_Assembler::assemble_vector",
+  "BSR_Assembler::assemble",
+  "Linear_PNP::apply_eafe",
+  "Linear_PNP::jacobian_action",
+  "PNP_Jacobian_Operator::apply",
+  "Linear_PNP::gummel_solve",
+  "FASP AMG setup",
+  "FASP ILU setup",
+  "FASP Krylov solve",
+  "FASP PNP-Stokes solve",
+  "file output"
+};
+
+/// peak resident set size of this process in kB
+long peak_rss_kb () {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/// current resident set size of this process in kB, which
+/// unlike the peak shows whether memory is released again
+long current_rss_kb () {
+  long pages = 0, resident = 0;
+  std::ifstream statm("/proc/self/statm");
+  statm >> pages >> resident;
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/// assembly thread counts of a scaling run: powers of two
+/// up to the number of hardware threads, and that number
+std::vector<std::size_t> performance_thread_counts () {
+  std::size_t max_threads = std::thread::hardware_concurrency();
+  max_threads = max_threads > 0 ? max_threads : 1;
+
+  std::vector<std::size_t> thread_counts;
+  for (std::size_t threads = 1; threads < max_threads; threads *= 2) {
+    thread_counts.push_back(threads);
+  }
+  thread_counts.push_back(max_threads);
+
+  return thread_counts;
+}
+
+/// box mesh as built from a domain.dat file
+std::shared_ptr<dolfin::Mesh> performance_box_mesh (
+  const double Lx,
+  const double Ly,
+  const double Lz,
+  const std::size_t grid_x,
+  const std::size_t grid_y,
+  const std::size_t grid_z
+) {
+  domain_param domain;
+  domain_param_input_init(&domain);
+  domain.length_x = Lx;
+  domain.length_y = Ly;
+  domain.length_z = Lz;
+  domain.grid_x = grid_x;
+  domain.grid_y = grid_y;
+  domain.grid_z = grid_z;
+
+  return std::make_shared<dolfin::Mesh>(domain_build(domain));
+}
+
+/// side lengths of the bounding box of a mesh
+std::vector<double> performance_mesh_lengths (
+  const dolfin::Mesh& mesh
+) {
+  std::vector<double> lengths;
+  for (std::size_t dim = 0; dim < mesh.geometry().dim(); dim++) {
+    double min = mesh.geometry().x(0, dim);
+    double max = min;
+    for (std::size_t vertex = 1; vertex < mesh.num_vertices(); vertex++) {
+      double x = mesh.geometry().x(vertex, dim);
+      min = x < min ? x : min;
+      max = x > max ? x : max;
+    }
+    lengths.push_back(max - min);
+  }
+
+  return lengths;
+}
+
+/// fill the timings of a record from the Phase_Registry
+void performance_collect (
+  Performance_Record& record
+) {
+  for (std::size_t i = 0; i < performance_phases.size(); i++) {
+    record.phase_seconds[performance_phases[i]] = Phase_Registry::total_seconds(performance_phases[i]);
+  }
+  record.krylov_iterations = Phase_Registry::counter_value("Krylov iterations");
+  record.peak_rss_kb = peak_rss_kb();
+}
+
+/// write the records of a sweep as CSV, one mesh per row
+void write_performance_csv (
+  const std::vector<Performance_Record>& records,
+  const std::string filename
+) {
+  std::ofstream csv_file;
+  csv_file.open(filename);
+  csv_file << "pipeline,mesh,cells,dofs,threads,newton_iterations,krylov_iterations,total_seconds,peak_rss_kb";
+  for (std::size_t i = 0; i < performance_phases.size(); i++) {
+    csv_file << ",\"" << performance_phases[i] << "\"";
+  }
+  csv_file << "\n";
+
+  csv_file.precision(6);
+  csv_file << std::scientific;
+  for (std::size_t r = 0; r < records.size(); r++) {
+    const Performance_Record& record = records[r];
+    csv_file << record.pipeline << "," << record.mesh_name << ",";
+    csv_file << record.cells << "," << record.dofs << "," << record.threads << ",";
+    csv_file << record.newton_iterations << "," << record.krylov_iterations << ",";
+    csv_file << record.total_seconds << "," << record.peak_rss_kb;
+    for (std::size_t i = 0; i < performance_phases.size(); i++) {
+      csv_file << "," << record.phase_seconds.at(performance_phases[i]);
+    }
+    csv_file << "\n";
+  }
+  csv_file.close();
+}
+
+/// write the records of a sweep as a JSON array
+void write_performance_json (
+  const std::vector<Performance_Record>& records,
+  const std::string filename
+) {
+  std::ofstream json_file;
+  json_file.open(filename);
+  json_file.precision(9);
+  json_file << std::scientific;
+
+  json_file << "[";
+  for (std::size_t r = 0; r < records.size(); r++) {
+    const Performance_Record& record = records[r];
+    json_file << (r == 0 ? "\n" : ",\n");
+    json_file << "  {\"pipeline\": \"" << record.pipeline << "\", ";
+    json_file << "\"mesh\": \"" << record.mesh_name << "\", ";
+    json_file << "\"cells\": " << record.cells << ", ";
+    json_file << "\"dofs\": " << record.dofs << ", ";
+    json_file << "\"threads\": " << record.threads << ", ";
+    json_file << "\"newton_iterations\": " << record.newton_iterations << ", ";
+    json_file << "\"krylov_iterations\": " << record.krylov_iterations << ", ";
+    json_file << "\"total_seconds\": " << record.total_seconds << ", ";
+    json_file << "\"peak_rss_kb\": " << record.peak_rss_kb << ", ";
+    json_file << "\"newton_rss_kb\": [";
+    for (std::size_t i = 0; i < record.newton_rss_kb.size(); i++) {
+      json_file << (i == 0 ? "" : ", ") << record.newton_rss_kb[i];
+    }
+    json_file << "], ";
+    json_file << "\"phases\": {";
+    for (std::size_t i = 0; i < performance_phases.size(); i++) {
+      json_file << (i == 0 ? "" : ", ");
+      json_file << "\"" << performance_phases[i] << "\": " << record.phase_seconds.at(performance_phases[i]);
+    }
+    json_file << "}}";
+  }
+  json_file << "\n]\n";
+
+  json_file.close();
+}
+
+#endif
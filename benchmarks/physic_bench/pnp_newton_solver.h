@@ -11,6 +11,8 @@
 #include <dolfin.h>
 #include "pde.h"
 #include "newton_status.h"
+#include "line_search.h"
+#include "phase_timer.h"
 #include "error.h"
 extern "C" {
   #include "fasp.h"
@@ -32,6 +34,7 @@ std::shared_ptr<dolfin::Function> solve_pnp (
   const double relative_residual_tol,
   std::shared_ptr<double> initial_residual_ptr,
   bool use_eafe_approximation,
+  bool use_trust_region,
   itsolver_param itsolver,
   AMG_param amg,
   ILU_param ilu,
@@ -112,9 +115,9 @@ std::shared_ptr<dolfin::Function> solve_pnp (
   printf("Initializing nonlinear solver\n");
 
   // set nonlinear solver parameters
-  double mesh_initial_residual = pnp_problem.compute_residual("l2");
+  const double raw_initial_residual = pnp_problem.compute_residual("l2");
   const double dof_size = pnp_problem._eigen_vector->size();
-  mesh_initial_residual /= dof_size;
+  double mesh_initial_residual = raw_initial_residual / dof_size;
   if (*initial_residual_ptr < 0.0) {
     *initial_residual_ptr = mesh_initial_residual;
   }
@@ -132,15 +135,61 @@ std::shared_ptr<dolfin::Function> solve_pnp (
 
   newton.update_max_residual(initial_max_residual);
 
-  // avoid updates that cause more than than 5% growth in the solution
-  bool fasp_reset = false;
+  // globalize with a backtracking line search on the residual
+  Line_Search line_search(20, 1E-4, 0.5);
+  if (use_trust_region) {
+    line_search.use_trust_region(1.0, 1E-4, 1E2);
+  }
+
+  // the linear solver already retries with fresh factors, so
+  // a failed system is only solved again with more iterations
+  const INT max_krylov_iterations = itsolver.maxit;
+  INT krylov_iteration_limit = itsolver.maxit;
   uint fasp_fail_count = 0;
-  double increase_tolerance = 1E-1;
+
+  // inexact Newton: loose linear solves far from the root
+  // the forcing term compares the unscaled residuals of this mesh
+  newton.use_inexact_newton(1E-1, itsolver.tol, 0.5);
+  newton.reset_residual_history(raw_initial_residual);
 
   while (newton.needs_to_iterate()) {
       // solve
       printf("\t\tSolving for Newton iterate %lu \n", newton.iteration);
-      solutionFn = pnp_problem.fasp_solve();
+      const double previous_residual = pnp_problem.compute_residual("l2");
+      const dolfin::Function previous_solution = pnp_problem.get_solution();
+      pnp_problem.set_linear_tolerance(newton.linear_tolerance(itsolver.tol));
+      printf("\tlinear solver tolerance : %10.5e\n", newton.forcing_term);
+      dolfin::Function computed_solution(pnp_problem.fasp_solve());
+      newton.update_krylov_iterations(pnp_problem.krylov_iterations);
+      if (pnp_problem.krylov_iterations < 0) {
+        printf("\t\tFASP solver has failed %u times\n", ++fasp_fail_count);
+        // the update of a failed solve is no search direction
+        pnp_problem.set_solution(previous_solution);
+        if (pnp_problem.krylov_iterations != ERROR_SOLVER_MAXIT || fasp_fail_count > 3) {
+          printf("\t\tLinear solver cannot solve the Newton system... stopping\n");
+          break;
+        }
+        krylov_iteration_limit *= 2;
+        printf("\t\tretrying with at most %d Krylov iterations\n", krylov_iteration_limit);
+        pnp_problem.set_max_krylov_iterations(krylov_iteration_limit);
+        continue;
+      }
+      if (krylov_iteration_limit != max_krylov_iterations) {
+        krylov_iteration_limit = max_krylov_iterations;
+        pnp_problem.set_max_krylov_iterations(krylov_iteration_limit);
+        fasp_fail_count = 0;
+      }
+
+      // damp the update
+      line_search.search(
+        pnp_problem,
+        previous_solution,
+        computed_solution,
+        previous_residual,
+        1.0
+      );
+      printf("\t\tstep length : %5.3e\n", line_search.step_length);
+      solutionFn = pnp_problem.get_solution();
 
       // update newton measurements
       printf("\t\tNewton measurements for iteration :\n");
@@ -153,12 +202,16 @@ std::shared_ptr<dolfin::Function> solve_pnp (
       printf("\t\tmaximum residual :  %10.5e\n", newton.max_residual);
       printf("\t\trelative residual : %10.5e\n", newton.relative_residual);
       printf("\t\toutput solution to file...\n");
+      Phase_Timer output_timer("file output");
       solution_file0 << solutionFn[0];
       solution_file1 << solutionFn[1];
       solution_file2 << solutionFn[2];
+      output_timer.stop();
       printf("\n");
   }
 
+  newton.print_krylov_iterations();
+
   // check status of nonlinear solve
   if (newton.converged()) {
     printf("\tSolver succeeded!\n");
@@ -162,10 +162,20 @@ std::vector<dolfin::Function> solve_pnp_stokes (
   printf("\tinitial residual : %10.5e\n", newton.initial_residual);
   printf("\n");
 
+  // inexact Newton: loose linear solves far from the root
+  newton.use_inexact_newton(1E-1, itsolver.tol, 0.5);
+
   while (newton.needs_to_iterate()) {
     // solve
     printf("\t\tSolving for Newton iterate %lu \n", newton.iteration);
+    pnp_ns_problem.set_linear_tolerance(newton.linear_tolerance(itsolver.tol));
+    printf("\tlinear solver tolerance : %10.5e\n", newton.forcing_term);
     solutionFn = pnp_ns_problem.fasp_solve();
+    newton.update_krylov_iterations(pnp_ns_problem.krylov_iterations);
+    if (pnp_ns_problem.krylov_iterations < 0) {
+      printf("\t\tLinear solver failed, the solution is unchanged... stopping\n");
+      break;
+    }
 
     // update newton measurements
     printf("\t\tNewton measurements for iteration :\n");
@@ -192,6 +202,8 @@ std::vector<dolfin::Function> solve_pnp_stokes (
   // xml_file0 << solutionFn[0];
   // xml_file1 << solutionFn[1];
 
+  newton.print_krylov_iterations();
+
   // check status of nonlinear solve
   if (newton.converged()) {
     printf("\tSolver succeeded!\n");
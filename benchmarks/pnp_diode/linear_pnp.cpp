@@ -1,12 +1,16 @@
 #include <iostream>
 #include <fstream>
 #include <string.h>
+#include <unordered_map>
 #include <dolfin.h>
 #include <ufc.h>
 #include "pde.h"
 #include "domain.h"
 #include "dirichlet.h"
-#include "EAFE.h"
+#include "eafe_assembler.h"
+#include "bsr_assembler.h"
+#include "preconditioner_cache.h"
+#include "phase_timer.h"
 extern "C" {
   #include "fasp.h"
   #include "fasp_functs.h"
@@ -62,6 +66,15 @@ Linear_PNP::Linear_PNP (
   _itsolver = itsolver;
   _amg = amg;
   _ilu = ilu;
+
+  _bsr_assembler.reset(
+    new BSR_Assembler(Linear_PNP::get_solution_dimension())
+  );
+
+  // keep the ILU factors until the Krylov iterations grow by 50%
+  _preconditioner.reset(new Preconditioner_Cache(_ilu, 1.5));
+
+  _eafe_assembler.reset(new EAFE_Assembler());
 }
 //--------------------------------------
 Linear_PNP::~Linear_PNP () {}
@@ -73,18 +86,17 @@ Linear_PNP::~Linear_PNP () {}
 
 //--------------------------------------
 void Linear_PNP::setup_fasp_linear_algebra () {
-  Linear_PNP::setup_linear_algebra();
+  // assemble the Jacobian straight into the FASP block matrix
+  _bsr_assembler->assemble(*_bilinear_form, *_threaded_assembler);
+  _bsr_assembler->apply(_dirichletBC);
 
   if (_use_eafe) {
     Linear_PNP::apply_eafe();
-    for (std::size_t i = 0; i < _dirichletBC.size(); i++) {
-      _dirichletBC[i]->apply(*_eigen_matrix);
-    }
+    _bsr_assembler->apply(_dirichletBC);
   }
 
-  std::size_t dimension = Linear_PNP::get_solution_dimension();
-  PDE::EigenMatrix_to_dCSRmat(_eigen_matrix, &_fasp_matrix);
-  _fasp_bsr_matrix = fasp_format_dcsr_dbsr(&_fasp_matrix, dimension);
+  // the right-hand side is the residual of the current solution
+  _eigen_vector.reset(new dolfin::EigenVector(*PDE::get_residual_vector()));
 
   if (_faps_soln_unallocated) {
     fasp_dvec_alloc(_eigen_vector->size(), &_fasp_soln);
@@ -97,24 +109,23 @@ void Linear_PNP::setup_fasp_linear_algebra () {
 //--------------------------------------
 dolfin::Function Linear_PNP::fasp_solve () {
   Linear_PNP::setup_fasp_linear_algebra();
-  dolfin::Function solution(Linear_PNP::get_solution());
 
   printf("Solving linear system using FASP solver...\n"); fflush(stdout);
-  INT status = fasp_solver_dbsr_krylov_ilu (
-    &_fasp_bsr_matrix,
+  INT status = _preconditioner->solve(
+    _bsr_assembler->matrix(),
     &_fasp_vector,
     &_fasp_soln,
-    &_itsolver,
-    &_ilu
+    &_itsolver
   );
   // INT status = fasp_solver_dbsr_krylov_amg (
-  //   &_fasp_bsr_matrix,
+  //   _bsr_assembler->matrix(),
   //   &_fasp_vector,
   //   &_fasp_soln,
   //   &_itsolver,
   //   &_amg
   // );
 
+  krylov_iterations = status;
   if (status < 0) {
     printf("\n### WARNING: FASP solver failed! Exit status = %d.\n", status);
     Linear_PNP::fasp_failed = true;
@@ -124,23 +135,13 @@ dolfin::Function Linear_PNP::fasp_solve () {
     printf("Successfully solved the linear system\n");
     Linear_PNP::fasp_failed = false;
     fflush(stdout);
-  }
 
-  // update solution regardless of successful solve
-  dolfin::EigenVector solution_vector(_eigen_vector->mpi_comm(),_eigen_vector->size());
-  double* array = solution_vector.data();
-  for (std::size_t i = 0; i < _fasp_soln.row; ++i) {
-    array[i] = _fasp_soln.val[i];
+    // block dofs are the dofs of the mixed space, so the update
+    // is added straight into the solution vector
+    PDE::add_to_solution(_fasp_soln.val);
   }
 
-  dolfin::Function update (
-    Linear_PNP::_convert_EigenVector_to_Function(solution_vector)
-  );
-  *(solution.vector()) += *(update.vector());
-
-  Linear_PNP::set_solution(solution);
-
-  return solution;
+  return Linear_PNP::get_solution();
 }
 //--------------------------------------
 dolfin::EigenVector Linear_PNP::fasp_test_solver (
@@ -153,14 +154,18 @@ dolfin::EigenVector Linear_PNP::fasp_test_solver (
   rhs_vector.reset( new dolfin::EigenVector(target_vector.mpi_comm(),target_vector.size()) );
 
 
-  _eigen_matrix->mult(target_vector, *rhs_vector);
+  fasp_blas_dbsr_mxv(
+    _bsr_assembler->matrix(),
+    target_vector.data(),
+    rhs_vector->data()
+  );
   PDE::EigenVector_to_dvector(rhs_vector, &_fasp_vector);
 
   dolfin::Function solution(Linear_PNP::get_solution());
 
   printf("Solving linear system using FASP solver...\n"); fflush(stdout);
   INT status = fasp_solver_dbsr_krylov_amg (
-    &_fasp_bsr_matrix,
+    _bsr_assembler->matrix(),
     &_fasp_vector,
     &_fasp_soln,
     &_itsolver,
@@ -186,9 +191,21 @@ dolfin::EigenVector Linear_PNP::fasp_test_solver (
   return solution_vector;
 }
 //--------------------------------------
+void Linear_PNP::set_linear_tolerance (
+  const double tolerance
+) {
+  _itsolver.tol = tolerance;
+}
+//--------------------------------------
+void Linear_PNP::set_max_krylov_iterations (
+  const INT max_iterations
+) {
+  _itsolver.maxit = max_iterations;
+}
+//--------------------------------------
 void Linear_PNP::free_fasp () {
-  fasp_dcsr_free(&_fasp_matrix);
-  fasp_dbsr_free(&_fasp_bsr_matrix);
+  _bsr_assembler->free_matrix();
+  _preconditioner->free_preconditioner();
   fasp_dvec_free(&_fasp_vector);
   fasp_dvec_free(&_fasp_soln);
 }
@@ -204,130 +221,161 @@ void Linear_PNP::no_eafe () {
  _use_eafe = false;
 }
 //--------------------------------------
+void Linear_PNP::coefficients_changed () {
+  _eafe_uninitialized = true;
+}
+//--------------------------------------
 void Linear_PNP::apply_eafe () {
-  dolfin::Function solution_function(Linear_PNP::get_solution());
-
-  if (_eafe_uninitialized) {
+  Phase_Timer timer("Linear_PNP::apply_eafe");
+  std::size_t eqns = Linear_PNP::get_solution_dimension();
 
-    _eafe_function_space = solution_function[0].function_space()->collapse();
-    _eafe_bilinear_form.reset(
-      new EAFE::Form_a(_eafe_function_space, _eafe_function_space)
-    );
-    _eafe_matrix.reset(new dolfin::EigenMatrix());
+  if (_eafe_uninitialized || _eafe_mesh_id != _function_space->mesh()->id()) {
+    const Component_Split& split = Linear_PNP::get_component_split(*_function_space);
+    _eafe_function_space = split.spaces[0];
+
+    // match the EAFE dofs to each component through the vertices
+    std::vector<std::size_t> eafe_vertices = dolfin::dof_to_vertex_map(*_eafe_function_space);
+    _eafe_dofs.resize(eqns);
+    for (uint eqn_idx = 0; eqn_idx < eqns; eqn_idx++) {
+      std::vector<dolfin::la_index> vertex_dofs = dolfin::vertex_to_dof_map(*(split.spaces[eqn_idx]));
+      _eafe_dofs[eqn_idx].resize(eafe_vertices.size());
+      for (std::size_t dof = 0; dof < eafe_vertices.size(); dof++) {
+        _eafe_dofs[eqn_idx][dof] = split.dofs[eqn_idx][vertex_dofs[eafe_vertices[dof]]];
+      }
+    }
 
     std::shared_ptr<dolfin::Function> _diffusivity;
     _diffusivity.reset(new dolfin::Function(diffusivity_space));
     _diffusivity->interpolate(
       *(_bilinear_form->coefficient("diffusivity"))
     );
-    _split_diffusivity = Linear_PNP::split_mixed_function(_diffusivity);
-
+    std::vector<std::shared_ptr<dolfin::Function>> split_diffusivity;
+    split_diffusivity = Linear_PNP::split_mixed_function(_diffusivity);
+    _eafe_alpha.clear();
+    for (uint eqn_idx = 0; eqn_idx < eqns; eqn_idx++) {
+      _eafe_alpha.push_back(std::make_shared<dolfin::Function>(_eafe_function_space));
+      _eafe_alpha[eqn_idx]->interpolate( *(split_diffusivity[eqn_idx]) );
+    }
 
     dolfin::Function val_fn(valency_space);
     val_fn.interpolate(
       (*_bilinear_form->coefficient("valency"))
     );
 
-    std::size_t vals = Linear_PNP::get_solution_dimension();
-    _valency_double.reserve(vals);
-    for (uint val_idx = 0; val_idx < vals; val_idx++) {
+    _valency_double.resize(eqns);
+    for (uint val_idx = 0; val_idx < eqns; val_idx++) {
       _valency_double[val_idx] = (*(val_fn.vector()))[val_idx];
     }
     _valency_double[0] = 0.0;
-  }
-
-  std::shared_ptr<dolfin::Function> solution_ptr;
-  solution_ptr.reset( new dolfin::Function(solution_function.function_space()) );
-  *solution_ptr = solution_function;
 
-  auto zero = std::make_shared<const dolfin::Constant>(0.0);
-  std::vector<std::shared_ptr<dolfin::Function>> solution_vector;
-  solution_vector = Linear_PNP::split_mixed_function(solution_ptr);
-  std::shared_ptr<dolfin::Function> beta, eta, phi;
+    eafe_beta.reset(new dolfin::Function(_eafe_function_space));
+    eafe_eta.reset(new dolfin::Function(_eafe_function_space));
 
-  std::size_t eqns = Linear_PNP::get_solution_dimension();
-  for (uint eqn_idx = 1; eqn_idx < eqns; eqn_idx++) {
-    beta.reset(new dolfin::Function(_eafe_function_space));
-    eta.reset(new dolfin::Function(_eafe_function_space));
-    phi.reset(new dolfin::Function(_eafe_function_space));
+    _eafe_mesh_id = _function_space->mesh()->id();
+    _eafe_uninitialized = false;
+  }
 
-    beta->interpolate( *(solution_vector[eqn_idx]) );
-    eta->interpolate( *(solution_vector[eqn_idx]) );
-    phi->interpolate( *(solution_vector[0]) );
+  // gather eta and beta = eta + valency * phi straight from the solution
+  const double* solution_values = dolfin::as_type<const dolfin::EigenVector>(
+    *(PDE::get_solution_function()->vector())
+  ).data();
+  double* eta_values = dolfin::as_type<dolfin::EigenVector>(*(eafe_eta->vector())).data();
+  double* beta_values = dolfin::as_type<dolfin::EigenVector>(*(eafe_beta->vector())).data();
+  const dolfin::la_index* phi_dofs = _eafe_dofs[0].data();
+  const std::size_t eafe_size = _eafe_dofs[0].size();
 
-    if (_valency_double[eqn_idx] != 0.0) {
-      *(phi->vector()) *= _valency_double[eqn_idx];
-      *beta = *beta + *phi;
+  for (uint eqn_idx = 1; eqn_idx < eqns; eqn_idx++) {
+    const dolfin::la_index* eta_dofs = _eafe_dofs[eqn_idx].data();
+    const double valency = _valency_double[eqn_idx];
+    for (std::size_t dof = 0; dof < eafe_size; dof++) {
+      eta_values[dof] = solution_values[eta_dofs[dof]];
+      beta_values[dof] = eta_values[dof] + valency * solution_values[phi_dofs[dof]];
     }
 
-    _eafe_bilinear_form->alpha = _split_diffusivity[eqn_idx];
-    _eafe_bilinear_form->beta = beta;
-    _eafe_bilinear_form->eta = eta;
-    _eafe_bilinear_form->gamma = zero;
-
-    dolfin::assemble(*_eafe_matrix, *_eafe_bilinear_form);
-
-    const int* IA = (int*) std::get<0>(_eafe_matrix->data());
-    const int* JA = (int*) std::get<1>(_eafe_matrix->data());
-    const double* values = (double*) std::get<2>(_eafe_matrix->data());
-
-    const int* global_IA = (int*) std::get<0>(_eigen_matrix->data());
-    const int* global_JA = (int*) std::get<1>(_eigen_matrix->data());
-    double* global_values = (double*) std::get<2>(_eigen_matrix->data());
-
-    uint row = 0, new_i = 0;
-    dolfin::la_index global_row, global_col;
-    std::size_t local_size = _eafe_matrix->nnz();
-    for (uint i = 0; i < local_size; i++) {
-
-      // convert local row/col to global row/col
-      while (IA[row + 1] < i + 1) row++;
-      global_row = _dof_map[eqn_idx][row];
-      global_col = _dof_map[eqn_idx][JA[i]];
-
-      // find and replace corresponding row/col in global IA/JA
-      new_i = global_IA[global_row];
-      while (global_JA[new_i] < global_col) new_i++;
-      global_values[new_i] = values[i];
-      // if (global_JA[new_i] != global_col) {
-        // printf("Error : %d != %d\n", global_JA[new_i], global_col); fflush(stdout);
-      // }
-    }
+    // overwrite the species block with the edge-based EAFE
+    _eafe_assembler->assemble(
+      *_bsr_assembler,
+      eqn_idx,
+      _eafe_dofs[eqn_idx],
+      *_eafe_alpha[eqn_idx],
+      *eafe_eta,
+      *eafe_beta
+    );
   }
 }
 //--------------------------------------
 std::vector<std::shared_ptr<dolfin::Function>> Linear_PNP::split_mixed_function (
   std::shared_ptr<const dolfin::Function> mixed_function
 ) {
-  //construct assignment arguments
-  std::shared_ptr<const dolfin::FunctionSpace> mixed_space(
-    mixed_function->function_space()
+  const Component_Split& split = Linear_PNP::get_component_split(
+    *(mixed_function->function_space())
   );
 
-  // construct receiving arguments
   std::vector<std::shared_ptr<dolfin::Function>> function_vector;
-  std::vector<std::shared_ptr<const dolfin::FunctionSpace>> subspace_vector;
+  for (std::size_t c = 0; c < split.spaces.size(); c++) {
+    function_vector.push_back(std::make_shared<dolfin::Function>(split.spaces[c]));
+  }
+  Linear_PNP::split_mixed_function(*mixed_function, function_vector);
+
+  return function_vector;
+}
+//--------------------------------------
+void Linear_PNP::split_mixed_function (
+  const dolfin::Function& mixed_function,
+  std::vector<std::shared_ptr<dolfin::Function>>& function_vector
+) {
+  const Component_Split& split = Linear_PNP::get_component_split(
+    *(mixed_function.function_space())
+  );
+  const double* mixed_values = dolfin::as_type<const dolfin::EigenVector>(
+    *(mixed_function.vector())
+  ).data();
+
+  for (std::size_t c = 0; c < split.dofs.size(); c++) {
+    double* values = dolfin::as_type<dolfin::EigenVector>(*(function_vector[c]->vector())).data();
+    const dolfin::la_index* dofs = split.dofs[c].data();
+    const std::size_t size = split.dofs[c].size();
+    for (std::size_t dof = 0; dof < size; dof++) {
+      values[dof] = mixed_values[dofs[dof]];
+    }
+  }
+}
+//--------------------------------------
+const Linear_PNP::Component_Split& Linear_PNP::get_component_split (
+  const dolfin::FunctionSpace& mixed_space
+) {
+  // splits on an older mesh would keep that mesh alive
+  const std::size_t mesh_id = mixed_space.mesh()->id();
+  if (_component_splits_mesh_id != mesh_id) {
+    _component_splits.clear();
+    _component_splits_mesh_id = mesh_id;
+  }
 
-  // initialize vectors
-  std::shared_ptr<dolfin::Function> subfunction;
-  std::shared_ptr<const dolfin::FunctionSpace> subspace;
-  std::size_t num_components = mixed_space->element()->num_sub_elements();
+  std::map<std::size_t, Component_Split>::const_iterator found;
+  found = _component_splits.find(mixed_space.id());
+  if (found != _component_splits.end()) {
+    return found->second;
+  }
 
+  Component_Split& split = _component_splits[mixed_space.id()];
+  std::size_t num_components = mixed_space.element()->num_sub_elements();
   for (std::size_t c = 0; c < num_components; c++) {
-    subspace.reset(
-      new const dolfin::FunctionSpace( *( (*mixed_space)[c]->collapse() ) )
+    std::unordered_map<std::size_t, std::size_t> collapsed_dofs;
+    std::shared_ptr<const dolfin::FunctionSpace> subspace(
+      mixed_space[c]->collapse(collapsed_dofs)
     );
-    subfunction.reset(new dolfin::Function(subspace));
 
-    subspace_vector.push_back(subspace);
-    function_vector.push_back(subfunction);
-  }
+    std::vector<dolfin::la_index> dofs(collapsed_dofs.size());
+    std::unordered_map<std::size_t, std::size_t>::const_iterator dof;
+    for (dof = collapsed_dofs.begin(); dof != collapsed_dofs.end(); ++dof) {
+      dofs[dof->first] = dof->second;
+    }
 
-  // assign
-  dolfin::FunctionAssigner function_assigner(subspace_vector, mixed_space);
-  function_assigner.assign(function_vector, mixed_function);
+    split.spaces.push_back(subspace);
+    split.dofs.push_back(dofs);
+  }
 
-  return function_vector;
+  return split;
 }
 
 //-------------------------------------
@@ -9,7 +9,9 @@
 #include "pde.h"
 #include "domain.h"
 #include "dirichlet.h"
-#include "EAFE.h"
+#include "eafe_assembler.h"
+#include "bsr_assembler.h"
+#include "preconditioner_cache.h"
 extern "C" {
   #include "fasp.h"
   #include "fasp_functs.h"
@@ -60,14 +62,37 @@ class Linear_PNP : public PDE {
 
     void free_fasp ();
 
+    /// tolerance of the outer Krylov solve, e.g. an
+    /// inexact Newton forcing term
+    void set_linear_tolerance (
+      const double tolerance
+    );
+
+    /// iteration limit of the outer Krylov solve, e.g. raised
+    /// to retry a solve that ran out of iterations
+    void set_max_krylov_iterations (
+      const INT max_iterations
+    );
+    INT krylov_iterations = 0;
+
     void apply_eafe ();
     void use_eafe ();
     void no_eafe ();
 
+    /// Rebuild the EAFE diffusivity and valency on the next solve
+    void coefficients_changed ();
+
     std::vector<std::shared_ptr<dolfin::Function>> split_mixed_function (
       std::shared_ptr<const dolfin::Function> mixed_function
     );
 
+    /// Copy the components of a mixed function into functions
+    /// on the collapsed subspaces, allocated by the caller
+    void split_mixed_function (
+      const dolfin::Function& mixed_function,
+      std::vector<std::shared_ptr<dolfin::Function>>& function_vector
+    );
+
     dolfin::Function get_total_charge ();
 
     bool fasp_failed = false;
@@ -84,23 +109,38 @@ class Linear_PNP : public PDE {
     itsolver_param _itsolver;
     AMG_param _amg;
     ILU_param _ilu;
-    dCSRmat _fasp_matrix;
-    dBSRmat _fasp_bsr_matrix;
+    std::shared_ptr<BSR_Assembler> _bsr_assembler;
+    std::shared_ptr<Preconditioner_Cache> _preconditioner;
     dvector _fasp_vector;
     dvector _fasp_soln;
     bool _faps_soln_unallocated = true;
 
-    // EAFE
+    // EAFE, set up once per mesh
     bool _use_eafe = false;
     bool _eafe_uninitialized = true;
-    std::shared_ptr<EAFE::BilinearForm> _eafe_bilinear_form;
-    std::shared_ptr<dolfin::FunctionSpace> _eafe_function_space;
+    std::size_t _eafe_mesh_id;
+    std::shared_ptr<EAFE_Assembler> _eafe_assembler;
+    std::shared_ptr<const dolfin::FunctionSpace> _eafe_function_space;
 
-    std::vector<std::shared_ptr<dolfin::Function>> _split_diffusivity;
+    std::vector<std::shared_ptr<dolfin::Function>> _eafe_alpha;
     std::vector<double> _valency_double;
 
+    // map from EAFE dofs to dofs of each component of the solution
+    std::vector<std::vector<dolfin::la_index>> _eafe_dofs;
     std::shared_ptr<dolfin::Function> eafe_beta, eafe_eta;
-    std::shared_ptr<dolfin::EigenMatrix> _eafe_matrix;
+
+    // collapsed subspaces of a mixed space and the map from their
+    // dofs to dofs of the mixed space, cached per mixed space
+    // of the current mesh
+    struct Component_Split {
+      std::vector<std::shared_ptr<const dolfin::FunctionSpace>> spaces;
+      std::vector<std::vector<dolfin::la_index>> dofs;
+    };
+    std::map<std::size_t, Component_Split> _component_splits;
+    std::size_t _component_splits_mesh_id = 0;
+    const Component_Split& get_component_split (
+      const dolfin::FunctionSpace& mixed_space
+    );
 
 };
 
@@ -5,9 +5,15 @@
 #include <string>
 #include <time.h>
 #include <stdlib.h>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <unistd.h>
+#include <sys/wait.h>
 #include <dolfin.h>
 #include "mesh_refiner.h"
 #include "domain.h"
+#include "phase_timer.h"
 extern "C" {
   #include "fasp.h"
   #include "fasp_functs.h"
@@ -51,6 +57,40 @@ class CrossSection : public dolfin::SubDomain {
   }
 };
 
+// converged state at one bias point
+struct Bias_Point {
+  double voltage_drop;
+  double induced_current;
+  std::size_t newton_iterations;
+  bool converged;
+  std::shared_ptr<dolfin::Function> solution;
+};
+
+// solve one bias point, starting from the given mesh and initial guess
+// or from the coarse domain mesh and Initial_Guess if they are not given,
+// assembling on num_threads threads (0 for all hardware threads)
+Bias_Point solve_bias_point (
+  const double voltage_drop,
+  std::shared_ptr<const dolfin::Mesh> initial_mesh,
+  std::shared_ptr<dolfin::Function> initial_guess,
+  const std::size_t num_threads
+);
+
+// continuation in the voltage drop with warm starts; stops at the
+// first point that does not converge at the minimum step and returns
+// it last, flagged as unconverged
+std::vector<Bias_Point> voltage_continuation (
+  const double min_volts,
+  const double max_volts,
+  const double delta_volts
+);
+
+std::shared_ptr<dolfin::Function> predict_solution (
+  const double voltage_drop,
+  const Bias_Point& previous,
+  const Bias_Point& older
+);
+
 // the main body of the script
 int main (int argc, char** argv) {
   printf("\n");
@@ -59,23 +99,159 @@ int main (int argc, char** argv) {
   printf("----------------------------------------------------\n\n");
   fflush(stdout);
 
+  // Deleting the folders:
+  boost::filesystem::remove_all("./benchmarks/pnp_diode/output");
+  boost::filesystem::create_directories("./benchmarks/pnp_diode/output");
+
+  // i-v curve
+  const double min_volts = -0.3;
+  const double max_volts = 0.5;
+  const double delta_volts = 0.1;
+
+  std::vector<double> voltages;
+  for (double voltage_drop = min_volts; voltage_drop < max_volts + 1.e-5; voltage_drop += delta_volts) {
+    voltages.push_back(voltage_drop);
+  }
+
+  // continuation walks the curve in one process, seeding each
+  // voltage with the converged solution and mesh of the last one
+  if (argc > 1 && std::string(argv[1]) == "continuation") {
+    std::vector<Bias_Point> iv_curve = voltage_continuation(min_volts, max_volts, delta_volts);
+
+    ofstream iv_file;
+    iv_file.open("./benchmarks/pnp_diode/output/iv_curve.txt");
+    iv_file.precision(6);
+    iv_file << std::scientific;
+    iv_file << "# voltage [V]    current [mA]    newton iterations    converged\n";
+    for (std::size_t i = 0; i < iv_curve.size(); i++) {
+      iv_file << iv_curve[i].voltage_drop << "    " << iv_curve[i].induced_current;
+      iv_file << "    " << iv_curve[i].newton_iterations;
+      iv_file << "    " << (iv_curve[i].converged ? 1 : 0) << "\n";
+    }
+    iv_file.close();
+    printf("Wrote i-v curve to ./benchmarks/pnp_diode/output/iv_curve.txt\n");
+
+    // the continuation stops at the first point it cannot solve
+    if (iv_curve.empty() || !iv_curve.back().converged) {
+      printf("Continuation stopped before %5.2eV\n", max_volts);
+      return 1;
+    }
+    return 0;
+  }
+
+  // bias points are independent, so each one runs in its own
+  // process (DOLFIN is not thread safe) fed from a work queue
+  std::size_t max_workers = std::thread::hardware_concurrency();
+  if (argc > 1) {
+    max_workers = (std::size_t) std::atoi(argv[1]);
+  }
+  max_workers = std::max((std::size_t) 1, std::min(max_workers, voltages.size()));
+
+  // share the hardware threads among the workers
+  const std::size_t worker_threads = std::max(
+    (std::size_t) 1, (std::size_t) std::thread::hardware_concurrency() / max_workers
+  );
+  printf("Sweeping %lu bias points with %lu workers of %lu threads\n\n",
+    voltages.size(), max_workers, worker_threads
+  );
+  fflush(stdout);
+
+  std::map<pid_t, std::size_t> workers;
+  std::size_t next_point = 0;
+  std::size_t failed_points = 0;
+  while (next_point < voltages.size() || !workers.empty()) {
+    if (next_point < voltages.size() && workers.size() < max_workers) {
+      const double voltage_drop = voltages[next_point];
+      // buffered output would be written again by the child
+      fflush(stdout);
+      pid_t pid = fork();
+      if (pid == 0) {
+        Bias_Point bias_point = solve_bias_point(voltage_drop, NULL, NULL, worker_threads);
+        fflush(stdout);
+        _exit(bias_point.converged ? 0 : 1);
+      }
+      else if (pid < 0) {
+        printf("Could not start a worker... solving %5.2eV in place\n", voltage_drop);
+        if (!solve_bias_point(voltage_drop, NULL, NULL, worker_threads).converged) {
+          printf("Newton solver failed for %5.2eV\n", voltage_drop);
+          failed_points++;
+        }
+      }
+      else {
+        workers[pid] = next_point;
+      }
+      next_point++;
+      continue;
+    }
+
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      break;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      printf("Worker for %5.2eV failed\n", voltages[workers[pid]]);
+      failed_points++;
+    }
+    workers.erase(pid);
+  }
+
+  // merge the bias points into one i-v curve
+  ofstream iv_file;
+  iv_file.open("./benchmarks/pnp_diode/output/iv_curve.txt");
+  iv_file.precision(6);
+  iv_file << std::scientific;
+  iv_file << "# voltage [V]    current [mA]\n";
+  for (std::size_t i = 0; i < voltages.size(); i++) {
+    std::string point_name = "./benchmarks/pnp_diode/output/voltage_";
+    point_name += std::to_string(voltages[i]);
+    point_name += "/iv.txt";
+
+    // a point whose Newton solve did not converge is no data
+    ifstream point_file(point_name);
+    double voltage, current;
+    int converged;
+    if (point_file >> voltage >> current >> converged) {
+      if (converged) {
+        iv_file << voltage << "    " << current << "\n";
+      }
+      else {
+        printf("Leaving the unconverged point %5.2eV out of the i-v curve\n", voltage);
+      }
+    }
+  }
+  iv_file.close();
+
+  if (failed_points > 0) {
+    printf("%lu of %lu bias points failed\n", failed_points, voltages.size());
+  }
+  printf("Merged i-v curve into ./benchmarks/pnp_diode/output/iv_curve.txt\n");
+
+  return failed_points > 0 ? 1 : 0;
+}
+
+//-------------------------------------
+Bias_Point solve_bias_point (
+  const double voltage_drop,
+  std::shared_ptr<const dolfin::Mesh> initial_mesh,
+  std::shared_ptr<dolfin::Function> initial_guess,
+  const std::size_t num_threads
+) {
   // Need to use Eigen for linear algebra
   dolfin::parameters["linear_algebra_backend"] = "Eigen";
   dolfin::parameters["allow_extrapolation"] = true;
 
-  // Deleting the folders:
-  boost::filesystem::remove_all("./benchmarks/pnp_diode/output");
-
   // read in parameters
   printf("Reading parameters from files...\n");
-  char domain_param_filename[] = "./benchmarks/pnp_diode/domain.dat";
-  printf("\tdomain... %s\n", domain_param_filename);
-  domain_param domain;
-  domain_param_input(domain_param_filename, &domain);
-  std::shared_ptr<dolfin::Mesh> initial_mesh;
-  initial_mesh.reset(new dolfin::Mesh(domain_build(domain)));
-  // initial_mesh.reset(new dolfin::Mesh("./diode_mesh_V-0.500000_level_3.xml"));
-  // print_domain_param(&domain);
+  if (!initial_mesh) {
+    char domain_param_filename[] = "./benchmarks/pnp_diode/domain.dat";
+    printf("\tdomain... %s\n", domain_param_filename);
+    domain_param domain;
+    domain_param_input(domain_param_filename, &domain);
+    initial_mesh.reset(new dolfin::Mesh(domain_build(domain)));
+    // initial_mesh.reset(new dolfin::Mesh("./diode_mesh_V-0.500000_level_3.xml"));
+    // print_domain_param(&domain);
+  }
 
   // set parameters for FASP solver
   char fasp_params[] = "./benchmarks/pnp_diode/bsr.dat";
@@ -90,12 +266,6 @@ int main (int argc, char** argv) {
   //-------------------------
   // Mesh Adaptivity Loop
   //-------------------------
-  dolfin::File accepted_solution_file("./benchmarks/pnp_diode/output/accepted_solution.pvd");
-
-  // i-v curve
-  const double min_volts = -0.3;
-  const double max_volts = 0.5;
-  const double delta_volts = 0.1;
 
   // mesh adaptivity
   const double growth_factor = 1.05;
@@ -108,104 +278,230 @@ int main (int argc, char** argv) {
   const double max_residual_tol = 1.0e-10;
   const double relative_residual_tol = 1.0e-7;
   const bool use_eafe_approximation = true;
+  // limit the max-norm of each update instead of backtracking only
+  const bool use_trust_region = false;
+
+  printf("Solving for voltage drop : %5.2e\n\n", voltage_drop);
+
+  std::string output_path("./benchmarks/pnp_diode/output/voltage_");
+  output_path += std::to_string(voltage_drop);
+  output_path += "/";
+
+  Mesh_Refiner mesh_adapt(
+    initial_mesh,
+    max_elements,
+    max_refine_depth,
+    entropy_error_per_cell
+  );
+  mesh_adapt.max_threads = num_threads;
+
+  std::shared_ptr<double> initial_residual_ptr = std::make_shared<double>(-1.0);
+  std::shared_ptr<std::size_t> newton_iterations_ptr = std::make_shared<std::size_t>(0);
+  std::shared_ptr<bool> converged_ptr = std::make_shared<bool>(false);
+  std::size_t newton_iterations = 0;
+
+  // construct initial guess
+  double induced_current;
+  Initial_Guess initial_guess_expression(voltage_drop);
+  auto adaptive_solution = std::make_shared<dolfin::Function>(
+    std::make_shared<vector_linear_pnp_forms::FunctionSpace>(mesh_adapt.get_mesh())
+  );
+  if (initial_guess) {
+    adaptive_solution->interpolate(*initial_guess);
+  } else {
+    adaptive_solution->interpolate(initial_guess_expression);
+  }
 
+  dolfin::File initial_guess_file(output_path + "initial_guess.pvd");
+  dolfin::File physical_output_file(output_path + "physical.pvd");
+  while (mesh_adapt.needs_to_solve) {
+    auto mesh = mesh_adapt.get_mesh();
+
+    initial_guess_file << *adaptive_solution;
+
+    auto computed_solution = solve_pnp(
+      voltage_drop,
+      mesh_adapt.iteration++,
+      mesh,
+      adaptive_solution,
+      max_newton,
+      max_residual_tol,
+      relative_residual_tol,
+      initial_residual_ptr,
+      newton_iterations_ptr,
+      converged_ptr,
+      use_eafe_approximation,
+      use_trust_region,
+      itsolver,
+      amg,
+      ilu,
+      num_threads,
+      output_path
+    );
+    newton_iterations += *newton_iterations_ptr;
+
+    // output physically relevant quantities
+    printf("Extracting physically relevant quantities\n");
+    auto physical_functions = get_physical_functions(computed_solution);
+    physical_output_file << *(physical_functions[0]);
+    physical_output_file << *(physical_functions[1]);
+    physical_output_file << *(physical_functions[2]);
+    physical_output_file << *(physical_functions[3]);
+
+    // compute current / entropy terms
+    printf("Computing diode current\n");
+    auto diffusivity = get_diode_diffusivity(computed_solution->function_space());
+    auto entropy_potential = compute_entropy_potential(computed_solution);
+    auto log_densities = extract_log_densities(computed_solution);
+
+    // Compute current flux through cross section
+    induced_current = computeCurrentFlux(diffusivity, log_densities, entropy_potential);
+
+    // adapt computed solutions
+    mesh_adapt.max_elements = (std::size_t) std::floor(growth_factor * mesh->num_cells());
+    mesh_adapt.multilevel_refinement(diffusivity, entropy_potential, log_densities);
+    adaptive_solution = mesh_adapt.prolong(*computed_solution);
+
+    std::string mesh_output = "./diode_mesh_V";
+    mesh_output += std::to_string(voltage_drop);
+    mesh_output += "_level_";
+    mesh_output += std::to_string(mesh_adapt.iteration);
+    mesh_output += ".xml.gz";
+    dolfin::File mesh_file(mesh_output);
+    mesh_file << *(mesh_adapt.get_mesh());
+  }
 
-  for (double voltage_drop = min_volts; voltage_drop < max_volts + 1.e-5; voltage_drop += delta_volts) {
-    printf("Solving for voltage drop : %5.2e\n\n", voltage_drop);
 
-    std::string output_path("./benchmarks/pnp_diode/output/voltage_");
-    output_path += std::to_string(voltage_drop);
-    output_path += "/";
+  printf("\nCompleted adaptivity loop for %5.3eV with induced current %5.3emA\n\n\n\n", voltage_drop, induced_current);
+  dolfin::File accepted_solution_file(output_path + "accepted_solution.pvd");
+  accepted_solution_file << *adaptive_solution;
+
+  std::string of_name = "./benchmarks/pnp_diode/output/iv_";
+  of_name += std::to_string(voltage_drop);
+  of_name += ".txt";
+  ofstream output_file;
+  output_file.precision(3);
+  output_file << std::scientific;
+  output_file.open(of_name);
+  // output_file << "IV curves for voltage [ " << (-max_volts) << ", " << max_volts << " ] ";
+  // output_file << "with voltage increments " << delta_volts << ".\n\n";
+  output_file << "Completed adaptivity loop for " << voltage_drop << "V with induced current " << induced_current << "mA\n";
+  output_file.close();
+
+  // machine readable point for the merged i-v curve
+  ofstream point_file;
+  point_file.precision(6);
+  point_file << std::scientific;
+  boost::filesystem::create_directories(output_path);
+  point_file.open(output_path + "iv.txt");
+  point_file << voltage_drop << " " << induced_current << " " << (*converged_ptr ? 1 : 0) << "\n";
+  point_file.close();
+
+  // timings of this bias point only
+  Phase_Registry::print_table();
+  Phase_Registry::write_json(output_path + "timings.json");
+  Phase_Registry::reset();
+
+  Bias_Point bias_point;
+  bias_point.voltage_drop = voltage_drop;
+  bias_point.induced_current = induced_current;
+  bias_point.newton_iterations = newton_iterations;
+  bias_point.converged = *converged_ptr;
+  bias_point.solution = adaptive_solution;
+
+  return bias_point;
+}
 
-    Mesh_Refiner mesh_adapt(
-      initial_mesh,
-      max_elements,
-      max_refine_depth,
-      entropy_error_per_cell
+//-------------------------------------
+std::vector<Bias_Point> voltage_continuation (
+  const double min_volts,
+  const double max_volts,
+  const double delta_volts
+) {
+  // adapt the step to the Newton effort of the last voltage
+  const std::size_t target_newton = 20;
+  const double min_delta_volts = 1.0e-3;
+  const double max_delta_volts = 4.0 * delta_volts;
+
+  std::vector<Bias_Point> iv_curve;
+  iv_curve.push_back(solve_bias_point(min_volts, NULL, NULL, 0));
+  if (!iv_curve.back().converged) {
+    printf("Newton solver did not converge at %5.2eV... stopping\n\n", min_volts);
+    return iv_curve;
+  }
+
+  double step = delta_volts;
+  while (iv_curve.back().voltage_drop < max_volts - 1.e-8) {
+    const Bias_Point& previous = iv_curve.back();
+    const Bias_Point& older = iv_curve.size() > 1 ? iv_curve[iv_curve.size() - 2] : previous;
+    const double voltage_drop = std::min(previous.voltage_drop + step, max_volts);
+
+    printf("Continuation step %5.2eV -> %5.2eV\n", previous.voltage_drop, voltage_drop);
+    Bias_Point current = solve_bias_point(
+      voltage_drop,
+      previous.solution->function_space()->mesh(),
+      predict_solution(voltage_drop, previous, older),
+      0
     );
 
-    std::shared_ptr<double> initial_residual_ptr = std::make_shared<double>(-1.0);
+    if (!current.converged && step > min_delta_volts) {
+      step = std::max(0.5 * step, min_delta_volts);
+      printf("Newton solver did not converge... retrying with step %5.2eV\n\n", step);
+      continue;
+    }
 
-    // construct initial guess
-    double induced_current;
-    Initial_Guess initial_guess_expression(voltage_drop);
-    auto adaptive_solution = std::make_shared<dolfin::Function>(
-      std::make_shared<vector_linear_pnp_forms::FunctionSpace>(mesh_adapt.get_mesh())
-    );
-    adaptive_solution->interpolate(initial_guess_expression);
+    // an unconverged state must not seed the next predictor, so
+    // the curve ends with this point, flagged as unconverged
+    if (!current.converged) {
+      printf("Newton solver did not converge at the minimum step... stopping\n\n");
+      iv_curve.push_back(current);
+      break;
+    }
 
-    dolfin::File initial_guess_file("./benchmarks/pnp_diode/output/initial_guess.pvd");
-    dolfin::File physical_output_file(output_path + "physical.pvd");
-    while (mesh_adapt.needs_to_solve) {
-      auto mesh = mesh_adapt.get_mesh();
-
-      initial_guess_file << *adaptive_solution;
-
-      auto computed_solution = solve_pnp(
-        voltage_drop,
-        mesh_adapt.iteration++,
-        mesh,
-        adaptive_solution,
-        max_newton,
-        max_residual_tol,
-        relative_residual_tol,
-        initial_residual_ptr,
-        use_eafe_approximation,
-        itsolver,
-        amg,
-        ilu,
-        output_path
-      );
-
-      // output physically relevant quantities
-      printf("Extracting physically relevant quantities\n");
-      auto physical_functions = get_physical_functions(computed_solution);
-      physical_output_file << *(physical_functions[0]);
-      physical_output_file << *(physical_functions[1]);
-      physical_output_file << *(physical_functions[2]);
-      physical_output_file << *(physical_functions[3]);
-
-      // compute current / entropy terms
-      printf("Computing diode current\n");
-      auto diffusivity = get_diode_diffusivity(computed_solution->function_space());
-      auto entropy_potential = compute_entropy_potential(computed_solution);
-      auto log_densities = extract_log_densities(computed_solution);
-
-      // Compute current flux through cross section
-      induced_current = computeCurrentFlux(diffusivity, log_densities, entropy_potential);
-
-      // adapt computed solutions
-      mesh_adapt.max_elements = (std::size_t) std::floor(growth_factor * mesh->num_cells());
-      mesh_adapt.multilevel_refinement(diffusivity, entropy_potential, log_densities);
-      adaptive_solution = adapt( *computed_solution, mesh_adapt.get_mesh() );
-
-      std::string mesh_output = "./diode_mesh_V";
-      mesh_output += std::to_string(voltage_drop);
-      mesh_output += "_level_";
-      mesh_output += std::to_string(mesh_adapt.iteration);
-      mesh_output += ".xml.gz";
-      dolfin::File mesh_file(mesh_output);
-      mesh_file << *(mesh_adapt.get_mesh());
+    if (current.newton_iterations < target_newton / 2) {
+      step = std::min(1.5 * step, max_delta_volts);
+    }
+    else if (current.newton_iterations > target_newton) {
+      step = std::max(0.5 * step, min_delta_volts);
     }
+    iv_curve.push_back(current);
+  }
 
+  return iv_curve;
+}
 
-    printf("\nCompleted adaptivity loop for %5.3eV with induced current %5.3emA\n\n\n\n", voltage_drop, induced_current);
-    accepted_solution_file << *adaptive_solution;
-
-    std::string of_name = "./benchmarks/pnp_diode/output/iv_";
-    of_name += std::to_string(voltage_drop);
-    of_name += ".txt";
-    ofstream output_file;
-    output_file.precision(3);
-    output_file << std::scientific;
-    output_file.open(of_name);
-    // output_file << "IV curves for voltage [ " << (-max_volts) << ", " << max_volts << " ] ";
-    // output_file << "with voltage increments " << delta_volts << ".\n\n";
-    output_file << "Completed adaptivity loop for " << voltage_drop << "V with induced current " << induced_current << "mA\n";
-    output_file.close();
+//-------------------------------------
+std::shared_ptr<dolfin::Function> predict_solution (
+  const double voltage_drop,
+  const Bias_Point& previous,
+  const Bias_Point& older
+) {
+  auto prediction = std::make_shared<dolfin::Function>(*(previous.solution));
+
+  if (older.voltage_drop != previous.voltage_drop) {
+    // secant predictor; the contact values are affine in the voltage
+    // drop, so the extrapolation keeps the Dirichlet data exact
+    dolfin::Function older_solution(previous.solution->function_space());
+    older_solution.interpolate(*(older.solution));
+
+    const double ratio = (voltage_drop - previous.voltage_drop)
+      / (previous.voltage_drop - older.voltage_drop);
+    prediction->vector()->axpy(ratio, *(previous.solution->vector()));
+    prediction->vector()->axpy(-ratio, *(older_solution.vector()));
+  } else {
+    // shift the potential by the change in the linear contact lift
+    dolfin::Function new_lift(previous.solution->function_space());
+    dolfin::Function old_lift(previous.solution->function_space());
+    Initial_Guess new_lift_expression(voltage_drop);
+    Initial_Guess old_lift_expression(previous.voltage_drop);
+    new_lift.interpolate(new_lift_expression);
+    old_lift.interpolate(old_lift_expression);
+
+    *(prediction->vector()) += *(new_lift.vector());
+    *(prediction->vector()) -= *(old_lift.vector());
   }
 
-  return 0;
+  return prediction;
 }
 
 
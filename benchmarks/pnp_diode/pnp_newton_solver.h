@@ -11,6 +11,8 @@
 #include <dolfin.h>
 #include "pde.h"
 #include "newton_status.h"
+#include "line_search.h"
+#include "phase_timer.h"
 extern "C" {
   #include "fasp.h"
   #include "fasp_functs.h"
@@ -32,10 +34,14 @@ std::shared_ptr<dolfin::Function> solve_pnp (
   const double max_residual_tol,
   const double relative_residual_tol,
   std::shared_ptr<double> initial_residual_ptr,
+  std::shared_ptr<std::size_t> newton_iterations_ptr,
+  std::shared_ptr<bool> converged_ptr,
   bool use_eafe_approximation,
+  bool use_trust_region,
   itsolver_param itsolver,
   AMG_param amg,
   ILU_param ilu,
+  const std::size_t assembly_threads,
   std::string output_dir
 ) {
   // setup function spaces and forms
@@ -81,6 +87,9 @@ std::shared_ptr<dolfin::Function> solve_pnp (
     "uu"
   );
 
+  // 0 for all hardware threads
+  pnp_problem.set_assembly_threads(assembly_threads);
+
   // set eafe flag
   if (use_eafe_approximation) {
   printf("Setting solver to use EAFE approximation\n");
@@ -189,34 +198,70 @@ std::shared_ptr<dolfin::Function> solve_pnp (
 
   // avoid updates that cause more than than 5% growth in the solution
   bool fasp_reset = false;
+
+  // the linear solver already retries with fresh factors, so
+  // a failed system is only solved again with more iterations
+  const INT max_krylov_iterations = itsolver.maxit;
+  INT krylov_iteration_limit = itsolver.maxit;
   uint fasp_fail_count = 0;
   double increase_tolerance = 1E-1;
 
+  // globalize with a backtracking line search on the residual
+  Line_Search line_search(20, 1E-4, 0.5);
+  if (use_trust_region) {
+    line_search.use_trust_region(1.0, 1E-4, 1E2);
+  }
+
+  // inexact Newton: loose linear solves far from the root
+  // the forcing term compares the residuals of this mesh
+  newton.use_inexact_newton(1E-1, itsolver.tol, 0.5);
+  newton.reset_residual_history(mesh_initial_residual);
+
   while (newton.needs_to_iterate()) {
     // solve
     printf("Solving for Newton iterate %lu \n", newton.iteration);
     const double previous_residual = pnp_problem.compute_residual("l2") / dof_size;
     const dolfin::Function previous_solution = pnp_problem.get_solution();
+    pnp_problem.set_linear_tolerance(newton.linear_tolerance(itsolver.tol));
+    printf("\tlinear solver tolerance : %10.5e\n", newton.forcing_term);
     dolfin::Function computed_solution(pnp_problem.fasp_solve());
+    newton.update_krylov_iterations(pnp_problem.krylov_iterations);
     if (pnp_problem.fasp_failed) {
       printf("\tFASP solver has failed %u times\n", ++fasp_fail_count);
-      if (fasp_fail_count > 10) {
-        printf("Linear solver has failed more than 10 times...\n");
-        printf("\treset solution to initial guess\n\n");
-        Initial_Guess initial_guess_expression(voltage_drop);
-        dolfin::Function reset_solution = pnp_problem.get_solution();
-        reset_solution.interpolate(initial_guess_expression);
-        pnp_problem.set_solution(reset_solution);
-        fasp_fail_count = 0;
-        if (fasp_reset) break;
-        fasp_reset = true;
+      if (pnp_problem.krylov_iterations == ERROR_SOLVER_MAXIT && fasp_fail_count <= 3) {
+        // the update of a failed solve is no search direction
+        pnp_problem.set_solution(previous_solution);
+        krylov_iteration_limit *= 2;
+        printf("\tretrying with at most %d Krylov iterations\n", krylov_iteration_limit);
+        pnp_problem.set_max_krylov_iterations(krylov_iteration_limit);
         continue;
       }
+
+      // a different linearization point is the last resort
+      if (fasp_reset) {
+        printf("Linear solver cannot solve the Newton system... stopping\n");
+        break;
+      }
+      printf("Linear solver cannot solve the Newton system...\n");
+      printf("\treset solution to initial guess\n\n");
+      Initial_Guess initial_guess_expression(voltage_drop);
+      dolfin::Function reset_solution = pnp_problem.get_solution();
+      reset_solution.interpolate(initial_guess_expression);
+      pnp_problem.set_solution(reset_solution);
+      krylov_iteration_limit = max_krylov_iterations;
+      pnp_problem.set_max_krylov_iterations(krylov_iteration_limit);
+      fasp_fail_count = 0;
+      fasp_reset = true;
+      continue;
+    }
+    if (krylov_iteration_limit != max_krylov_iterations) {
+      krylov_iteration_limit = max_krylov_iterations;
+      pnp_problem.set_max_krylov_iterations(krylov_iteration_limit);
+      fasp_fail_count = 0;
     }
 
     // update newton measurements with backtracking
     printf("Newton measurements for iteration :\n");
-    double residual_check = pnp_problem.compute_residual("l2") / dof_size;
 
     // ensure L_infinity norm has bounded growth at each iteration
     double prev_max_dof = previous_solution.vector()->max();
@@ -254,21 +299,16 @@ std::shared_ptr<dolfin::Function> solve_pnp (
       computed_solution = previous_solution + newton_update;
     }
 
-    // dolfin::File backFile(output_dir + "backtrack.pvd");
-    std::size_t backtrack_count = 0;
-    while (backtrack_count < 50 && (residual_check > 1.00001 * previous_residual || isnan(residual_check))) {
-      printf("\trelative residual increased : %e < %e\n", previous_residual, residual_check);
-      dolfin::Function backtrack(computed_solution.function_space());
-      backtrack = previous_solution - computed_solution;
-      *(backtrack.vector()) *= 1.0 - std::pow(0.5, ++backtrack_count);
-
-      dolfin::Function backtrack_solution(computed_solution.function_space());
-      backtrack_solution = computed_solution + backtrack;
-      // backFile << backtrack_solution;
-      pnp_problem.set_solution(backtrack_solution);
-      residual_check = pnp_problem.compute_residual("l2") / dof_size;
-    }
-    printf("\trelative residual decreased : %e > %e\n", previous_residual, residual_check);
+    double residual_check = line_search.search(
+      pnp_problem,
+      previous_solution,
+      computed_solution,
+      previous_residual,
+      dof_size
+    );
+    printf("\trelative residual : %e -> %e, step length %5.3e\n",
+      previous_residual, residual_check, line_search.step_length
+    );
     double residual = pnp_problem.compute_residual("l2") / dof_size;
     double max_residual = pnp_problem.compute_residual("max");
     newton.update_residuals(residual, max_residual);
@@ -278,12 +318,20 @@ std::shared_ptr<dolfin::Function> solve_pnp (
     printf("\tmaximum residual :  %10.5e\n", newton.max_residual);
     printf("\trelative residual : %10.5e\n", newton.relative_residual);
     printf("\toutput solution to file...\n");
-    total_solution_file << computed_solution;
+    Phase_Timer output_timer("file output");
+    total_solution_file << pnp_problem.get_solution();
     total_charge_file << pnp_problem.get_total_charge();
+    output_timer.stop();
     printf("\n");
   }
 
 
+  newton.print_krylov_iterations();
+
+  // report the Newton effort to the caller
+  *newton_iterations_ptr = newton.iteration - 1;
+  *converged_ptr = newton.converged();
+
   // check status of nonlinear solve
   if (newton.converged()) {
     printf("Solver succeeded!\n");
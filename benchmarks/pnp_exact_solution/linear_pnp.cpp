@@ -82,7 +82,7 @@ void Linear_PNP::setup_fasp_linear_algebra () {
 
   std::size_t dimension = Linear_PNP::get_solution_dimension();
   EigenMatrix_to_dCSRmat(_eigen_matrix, &_fasp_matrix);
-  _fasp_bsr_matrix = fasp_format_dcsr_dbsr(&_fasp_matrix, dimension);
+  PDE::dCSRmat_to_dBSRmat(&_fasp_matrix, dimension, &_fasp_bsr_matrix);
 
   if (_faps_soln_unallocated) {
     fasp_dvec_alloc(_eigen_vector->size(), &_fasp_soln);
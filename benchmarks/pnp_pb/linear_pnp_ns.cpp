@@ -326,5 +326,7 @@ void Linear_PNP_NS::init_BC (double Lx,double Ly,double Lz) {
   sub_domains->set_value(0, 1);
   auto BC5 = std::make_shared<dolfin::DirichletBC>(_function_space->sub(4),zero,sub_domains,1);
   _dirichletBC.push_back(BC5);
+
+  PDE::invalidate_residual();
 }
 //--------------------------------------
@@ -322,6 +322,8 @@ void Linear_PNP_NS::init_BC (double Lx,double Ly,double Lz) {
   sub_domains->set_value(0, 1);
   auto BC5 = std::make_shared<dolfin::DirichletBC>(_function_space->sub(4),zero,sub_domains,1);
   _dirichletBC.push_back(BC5);
+
+  PDE::invalidate_residual();
 }
 //--------------------------------------
 
@@ -347,5 +349,7 @@ void Linear_PNP_NS::init_measure (std::shared_ptr<const dolfin::Mesh> mesh,
   // BCdomain_yz.mark(*markers,2);
 
   _linear_form->set_exterior_facet_domains(markers);
+
+  PDE::invalidate_residual();
 }
 //--------------------------------------
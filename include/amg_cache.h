@@ -0,0 +1,67 @@
+#ifndef __AMG_CACHE_H
+#define __AMG_CACHE_H
+
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include "lagged_preconditioner.h"
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+class AMG_Cache : public Lagged_Preconditioner {
+  public:
+
+    /// Keep the AMG hierarchy of a scalar matrix across
+    /// solves and rebuild it only when needed, as
+    /// Preconditioner_Cache does for block ILU factors
+    ///
+    /// *Arguments*
+    ///  amg (_AMG_param_)
+    ///    Parameters for the AMG setup and cycle
+    ///  iteration_growth (_double_)
+    ///    Rebuild once the Krylov iteration count exceeds
+    ///    this factor times the count right after a setup
+    AMG_Cache (
+      const AMG_param &amg,
+      const double iteration_growth
+    );
+
+    /// Destructor
+    virtual ~AMG_Cache ();
+
+    /// Solve with the cached hierarchy as preconditioner,
+    /// refreshing it first if the matrix layout changed, the
+    /// last solve was too slow, or a rebuild was requested.
+    /// A failed solve with a reused hierarchy is retried
+    /// once with a fresh one.
+    INT solve (
+      dCSRmat* matrix,
+      dvector* rhs,
+      dvector* solution,
+      itsolver_param* itsolver
+    );
+
+    /// Release the hierarchy
+    void free_preconditioner ();
+
+  protected:
+    void setup ();
+
+    INT krylov_solve (
+      dvector* rhs,
+      dvector* solution,
+      itsolver_param* itsolver
+    );
+
+  private:
+    AMG_param _amg;
+    AMG_data* _amg_data = NULL;
+    precond_data _precond_data;
+
+    /// matrix of the current solve
+    dCSRmat* _matrix = NULL;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef __BSR_ASSEMBLER_H
+#define __BSR_ASSEMBLER_H
+
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <dolfin.h>
+#include <ufc.h>
+#include "threaded_assembler.h"
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+class BSR_Assembler {
+  public:
+
+    /// Assemble bilinear forms on mixed spaces with
+    /// interleaved dofs straight into a FASP block matrix,
+    /// bypassing the EigenMatrix -> dCSRmat -> dBSRmat path.
+    ///
+    /// *Arguments*
+    ///  block_size (_std::size_t_)
+    ///    Number of components sharing each mesh vertex
+    BSR_Assembler (
+      const std::size_t block_size
+    );
+
+    /// Destructor
+    virtual ~BSR_Assembler ();
+
+    /// Build the block sparsity pattern from the cell dofmaps
+    void init_pattern (
+      const dolfin::Form& bilinear_form
+    );
+
+    /// Zero the values and add all cell tensors of the form,
+    /// building the pattern first if the mesh has changed
+    void assemble (
+      const dolfin::Form& bilinear_form
+    );
+
+    /// As above, adding the cell tensors of each color on
+    /// the threads of a Threaded_Assembler
+    void assemble (
+      const dolfin::Form& bilinear_form,
+      Threaded_Assembler& threaded_assembler
+    );
+
+    /// Zero Dirichlet rows, place ones on their diagonal and
+    /// put a unit diagonal in any row that is entirely zero
+    void apply (
+      const std::vector<std::shared_ptr<dolfin::DirichletBC>>& dirichletBC
+    );
+
+    /// Pointer to the value of entry (row, col), or NULL if
+    /// the entry is outside the block pattern
+    double* entry (
+      const std::size_t row,
+      const std::size_t col
+    );
+
+    /// Offset of entry (row, col) in the values array of the
+    /// block matrix, or -1 if the entry is outside the pattern
+    int value_offset (
+      const std::size_t row,
+      const std::size_t col
+    );
+
+    /// Copy the couplings among a subset of the dofs, e.g. one
+    /// component, into a scalar CSR matrix numbered like the
+    /// subset. With empty offsets the matrix is allocated with
+    /// the pattern of the couplings and offsets maps its values
+    /// into the block matrix; later calls only copy the values.
+    /// The caller frees the matrix with fasp_dcsr_free.
+    ///
+    /// *Arguments*
+    ///  dofs (_std::vector<dolfin::la_index>_)
+    ///    Dofs of the subset, in the order of its rows
+    ///  block (_dCSRmat_)
+    ///    The scalar matrix
+    ///  offsets (_std::vector<int>_)
+    ///    Offsets of its values in the block matrix
+    void extract_block (
+      const std::vector<dolfin::la_index>& dofs,
+      dCSRmat& block,
+      std::vector<int>& offsets
+    );
+
+    /// Number of times the block pattern has been built, so
+    /// cached value offsets can be checked for staleness
+    std::size_t pattern_count ();
+
+    /// The assembled block matrix
+    dBSRmat* matrix ();
+
+    /// Release the block matrix
+    void free_matrix ();
+
+  private:
+    std::size_t _block_size;
+    dBSRmat _matrix;
+    bool _matrix_allocated = false;
+
+    /// mesh the pattern was built for
+    std::size_t _pattern_mesh_id;
+    std::size_t _pattern_dimension = 0;
+    std::size_t _pattern_count = 0;
+};
+
+#endif
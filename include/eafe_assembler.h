@@ -0,0 +1,99 @@
+#ifndef __EAFE_ASSEMBLER_H
+#define __EAFE_ASSEMBLER_H
+
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <map>
+#include <vector>
+#include <dolfin.h>
+#include "bsr_assembler.h"
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+class EAFE_Assembler {
+  public:
+
+    /// Assemble the edge-averaged finite element (EAFE)
+    /// discretization of -div(alpha*exp(eta)*(grad(u)+grad(beta)*u))
+    /// on P1 tetrahedra edge by edge, straight into one species
+    /// block of a FASP block matrix. Each edge only needs its P1
+    /// stiffness entry and a Bernoulli weight of the nodal values,
+    /// so no quadrature or form assembly is involved.
+    EAFE_Assembler ();
+
+    /// Destructor
+    virtual ~EAFE_Assembler ();
+
+    /// Collect the mesh edges and their P1 stiffness entries
+    ///
+    /// *Arguments*
+    ///  function_space (_dolfin::FunctionSpace_)
+    ///    Scalar P1 space of a single species
+    void init_edges (
+      const dolfin::FunctionSpace& function_space
+    );
+
+    /// Overwrite the EAFE entries of a species block, rebuilding
+    /// the edges if the mesh has changed and the block offsets if
+    /// the block pattern has changed
+    ///
+    /// *Arguments*
+    ///  bsr_assembler (_BSR_Assembler_)
+    ///    Holds the assembled Jacobian
+    ///  species (_std::size_t_)
+    ///    Component of the Jacobian to overwrite
+    ///  dof_map (_std::vector<dolfin::la_index>_)
+    ///    Map from P1 dofs to dofs of the Jacobian
+    ///  alpha, eta, beta (_dolfin::Function_)
+    ///    Coefficients in the P1 space of the species
+    void assemble (
+      BSR_Assembler& bsr_assembler,
+      const std::size_t species,
+      const std::vector<dolfin::la_index>& dof_map,
+      const dolfin::Function& alpha,
+      const dolfin::Function& eta,
+      const dolfin::Function& beta
+    );
+
+    /// Bernoulli function B(x) = x / (exp(x) - 1)
+    static double bernoulli (
+      const double x
+    );
+
+  private:
+    /// edges as pairs of P1 dofs with their stiffness entry
+    std::vector<dolfin::la_index> _edge_start;
+    std::vector<dolfin::la_index> _edge_end;
+    std::vector<double> _edge_stiffness;
+    std::size_t _num_dofs = 0;
+
+    /// mesh the edges were collected for
+    std::size_t _edge_mesh_id;
+    bool _edges_uninitialized = true;
+
+    /// per species offsets of the (start, end), (end, start) and
+    /// diagonal entries in the block matrix values
+    struct Block_Offsets {
+      std::size_t pattern = 0;
+      std::vector<int> forward;
+      std::vector<int> backward;
+      std::vector<int> diagonal;
+    };
+    std::map<std::size_t, Block_Offsets> _block_offsets;
+
+    void init_offsets (
+      BSR_Assembler& bsr_assembler,
+      const std::vector<dolfin::la_index>& dof_map,
+      Block_Offsets& offsets
+    );
+
+    /// work arrays of the edge kernel
+    std::vector<double> _alpha, _eta, _beta;
+    std::vector<double> _exp_eta, _fermi;
+    std::vector<double> _forward_weight, _backward_weight;
+};
+
+#endif
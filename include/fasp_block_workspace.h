@@ -0,0 +1,79 @@
+#ifndef __FASP_BLOCK_WORKSPACE_H
+#define __FASP_BLOCK_WORKSPACE_H
+
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <vector>
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_block.h"
+  #include "fasp_functs.h"
+}
+
+class FASP_Block_Workspace {
+  public:
+
+    /// Right-hand side, solution and 2x2 block matrix of a
+    /// FASP block solve, allocated once per dof layout and
+    /// refilled in place on later Newton steps
+    FASP_Block_Workspace ();
+
+    /// Destructor
+    virtual ~FASP_Block_Workspace ();
+
+    /// Size the workspace for a split of the dofs into two
+    /// blocks, keeping the buffers if the sizes are unchanged
+    ///
+    /// *Arguments*
+    ///  first_dofs (_ivector_)
+    ///    Dofs of the first block, in block order
+    ///  second_dofs (_ivector_)
+    ///    Dofs of the second block, in block order
+    void init (
+      const ivector& first_dofs,
+      const ivector& second_dofs
+    );
+
+    /// Permute a vector in dof order into the right-hand side
+    /// and zero the solution
+    void gather_rhs (
+      const double* values
+    );
+
+    /// Split a matrix in dof order into the four blocks,
+    /// building the extraction plan if the pattern is new
+    void extract_blocks (
+      dCSRmat* matrix
+    );
+
+    dvector* rhs ();
+    dvector* solution ();
+    block_dCSRmat* matrix ();
+
+    /// Release all buffers
+    void free_workspace ();
+
+  private:
+    ivector _first_dofs;
+    ivector _second_dofs;
+    dvector _rhs;
+    dvector _solution;
+    block_dCSRmat _matrix;
+    bool _vectors_allocated = false;
+    bool _blocks_allocated = false;
+
+    /// block and offset in its values of every nonzero of
+    /// the matrix, valid for one sparsity pattern
+    std::vector<int> _plan_block;
+    std::vector<int> _plan_offset;
+    INT _plan_rows = 0;
+    INT _plan_nnz = 0;
+
+    void init_plan (
+      const dCSRmat* matrix
+    );
+    void free_blocks ();
+};
+
+#endif
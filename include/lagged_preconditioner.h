@@ -0,0 +1,102 @@
+#ifndef __LAGGED_PRECONDITIONER_H
+#define __LAGGED_PRECONDITIONER_H
+
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <string>
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+class Lagged_Preconditioner {
+  public:
+
+    /// Shared logic of the preconditioner caches: the setup
+    /// is kept across solves and runs again only when the
+    /// matrix layout changes, the Krylov iterations grow, a
+    /// rebuild is requested, or a solve fails. Derived
+    /// classes only set up, free and solve.
+    ///
+    /// *Arguments*
+    ///  name (_std::string_)
+    ///    Preconditioner name for the log, e.g. "ILU"
+    ///  iteration_growth (_double_)
+    ///    Rebuild once the Krylov iteration count exceeds
+    ///    this factor times the count right after a setup
+    Lagged_Preconditioner (
+      const std::string name,
+      const double iteration_growth
+    );
+
+    /// Destructor
+    virtual ~Lagged_Preconditioner ();
+
+    /// Whether the next solve rebuilds the preconditioner, so
+    /// a lagged matrix should be reassembled first
+    bool needs_setup ();
+
+    /// Force a rebuild at the next solve, e.g. on a new mesh
+    void reset ();
+
+    /// statistics
+    std::size_t setup_count = 0;
+    std::size_t solve_count = 0;
+    INT last_iterations = 0;
+
+  protected:
+    /// Build _preconditioner for the matrix of the current
+    /// solve and call finish_setup
+    virtual void setup () = 0;
+
+    /// One Krylov solve of the current system with _preconditioner
+    virtual INT krylov_solve (
+      dvector* rhs,
+      dvector* solution,
+      itsolver_param* itsolver
+    ) = 0;
+
+    /// Refresh the preconditioner if needed, solve, and with
+    /// retry a failed solve with a reused setup runs once more
+    /// from the same initial guess after a fresh setup
+    INT lagged_solve (
+      const INT rows,
+      const INT nnz,
+      dvector* rhs,
+      dvector* solution,
+      itsolver_param* itsolver,
+      const bool retry
+    );
+
+    /// Record the layout of a completed setup
+    void finish_setup (
+      const INT rows,
+      const INT nnz
+    );
+
+    precond _preconditioner;
+    bool _needs_setup = true;
+
+  private:
+    /// Update the statistics and the rebuild decision after
+    /// a solve and pass its status through
+    INT finish_solve (
+      const INT status,
+      const bool fresh_setup
+    );
+
+    std::string _name;
+    double _iteration_growth;
+    INT _setup_iterations = -1;
+
+    /// layout of the matrix of the last setup
+    INT _setup_rows = 0;
+    INT _setup_nnz = 0;
+
+    /// initial guess of the last solve, restored for a retry
+    dvector _initial_guess;
+    bool _initial_guess_allocated = false;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef __LINE_SEARCH_H
+#define __LINE_SEARCH_H
+
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <dolfin.h>
+#include <ufc.h>
+#include "pde.h"
+
+class Line_Search {
+  public:
+
+    /// Backtracking line search on the residual norm for
+    /// globalizing Newton's method, with an optional trust
+    /// region on the size of each update
+    ///
+    /// *Arguments*
+    ///  max_backtracks (_std::size_t_)
+    ///    Maximum number of step reductions per search
+    ///  sufficient_decrease (_double_)
+    ///    Armijo constant c: accept a step of length t once
+    ///    the residual is below (1 - c t) times the previous one
+    ///  contraction (_double_)
+    ///    Factor applied to the step length on each reduction
+    Line_Search (
+      const std::size_t max_backtracks,
+      const double sufficient_decrease,
+      const double contraction
+    );
+
+    /// Destructor
+    virtual ~Line_Search ();
+
+    /// Limit the max-norm of each update to a radius that
+    /// grows after good steps and shrinks after poor ones
+    void use_trust_region (
+      const double initial_radius,
+      const double min_radius,
+      const double max_radius
+    );
+
+    /// Step from previous_solution towards computed_solution,
+    /// shortening the step until the residual decreases enough.
+    /// Trial steps only assemble the residual; nothing is
+    /// re-solved. The accepted solution is left in the problem
+    /// and its residual, divided by residual_scale, is returned.
+    /// If no step is accepted the shortest trial is kept.
+    double search (
+      PDE& problem,
+      const dolfin::Function& previous_solution,
+      const dolfin::Function& computed_solution,
+      const double previous_residual,
+      const double residual_scale
+    );
+
+    /// status of the last search
+    double step_length = 1.0;
+    std::size_t backtracks = 0;
+    bool accepted = false;
+
+    /// statistics
+    std::size_t search_count = 0;
+    std::size_t total_backtracks = 0;
+
+    /// trust region
+    bool trust_region = false;
+    double trust_radius = 0.0;
+
+  private:
+    std::size_t _max_backtracks;
+    double _sufficient_decrease;
+    double _contraction;
+
+    double _min_radius = 0.0;
+    double _max_radius = 0.0;
+};
+
+#endif
@@ -57,11 +57,28 @@ class Mesh_Refiner {
       double entropy_tolerance
     );
 
-    /// refine to get close to target size
+    /// mark the cells of largest entropy error, as many as the
+    /// predicted refined mesh allows within the target size
+    ///
+    /// *Arguments*
+    ///  entropy_vector (_dolfin::EigenVector_)
+    ///    Entropy error of each cell
+    ///  target_size (_std::size_t_)
+    ///    Largest number of cells after refinement
+    ///  growth_scale (_double_)
+    ///    Correction of the predicted growth, e.g. measured
+    ///    from a refinement that overshot
     std::size_t mark_for_refinement_with_target_size (
-      dolfin::EigenVector entropy_vector,
-      std::vector<double> error_vector,
-      std::size_t target_size
+      const dolfin::EigenVector& entropy_vector,
+      const std::size_t target_size,
+      const double growth_scale
+    );
+
+    /// predict the number of cells after refining the marked
+    /// cells, closing the marked edges as Plaza refinement does:
+    /// a face with a marked edge gets its longest edge marked
+    std::size_t predict_refined_size (
+      const std::vector<bool>& marked_cells
     );
 
     /// compute interpolation error of entropy function
@@ -76,6 +93,16 @@ class Mesh_Refiner {
 
     std::shared_ptr<const dolfin::Mesh> refine_uniformly ();
 
+    /// Carry a function from a mesh of the refinement history to
+    /// the current mesh without point location: P1 functions,
+    /// scalar or mixed, by averaging over the parent edge of each
+    /// new vertex, other elements such as RT or DG0 by local
+    /// interpolation of the function on the parent cell. Functions
+    /// outside the history are interpolated by dolfin::adapt.
+    std::shared_ptr<dolfin::Function> prolong (
+      const dolfin::Function& function
+    );
+
     void mass_lumping_solver (
       std::shared_ptr<dolfin::EigenMatrix> A,
       std::shared_ptr<dolfin::EigenVector> b,
@@ -93,10 +120,17 @@ class Mesh_Refiner {
     /// maximum mesh size
     std::size_t max_elements;
 
+    /// threads of the entropy kernel, 0 for all hardware threads
+    std::size_t max_threads = 0;
+
     /// solve flags
     bool needs_to_solve;
     bool needs_refinement;
 
+    /// write the entropy error of each species to ./entropy.pvd
+    /// on every marking pass, for debugging
+    bool write_entropy = false;
+
   private:
     std::size_t max_refine_depth;
     double entropy_tolerance_per_cell;
@@ -104,6 +138,100 @@ class Mesh_Refiner {
     std::shared_ptr<const L2Error::Functional> _l2_form;
     std::shared_ptr<const SemiH1error::Functional> _semi_h1_form;
     std::shared_ptr<dolfin::MeshFunction<bool>> _cell_marker;
+
+    /// DG0 space of the entropy indicator and its dof on each
+    /// cell, for output, and the cells of the indicator kernel as
+    /// structure of arrays: _cell_vertices[vertex * cells + cell] and
+    /// _cell_gradients[(vertex * 3 + d) * cells + cell], with
+    /// the gradients of the barycentric coordinates; cached per mesh
+    std::shared_ptr<poisson_cell_marker::FunctionSpace> _marker_space;
+    std::vector<dolfin::la_index> _marker_dofs;
+    std::vector<unsigned int> _cell_vertices;
+    std::vector<double> _cell_gradients;
+    std::size_t _geometry_mesh_id;
+    bool _geometry_uninitialized = true;
+    void init_cell_geometry ();
+    std::shared_ptr<dolfin::File> _entropy_file;
+
+    /// vertex values of the indicator fields, species after
+    /// species, gathered on the mesh a refinement pass starts
+    /// from and prolonged to each refined mesh
+    std::size_t _field_species = 0;
+    std::vector<double> _vertex_potential;
+    std::vector<double> _vertex_log_weight;
+    std::vector<double> _vertex_diffusivity;
+    std::size_t _fields_mesh_id;
+    bool _fields_uninitialized = true;
+    void init_vertex_fields (
+      std::vector<std::shared_ptr<const dolfin::Function>> diffusivity_vector,
+      std::vector<std::shared_ptr<const dolfin::Function>> entropy_potential_vector,
+      std::vector<std::shared_ptr<const dolfin::Function>> entropy_log_weight_vector
+    );
+
+    /// Vertex values of a scalar P1 function on the current mesh,
+    /// interpolated only if it lives on another mesh
+    void gather_vertex_values (
+      const dolfin::Function& function,
+      double* values
+    );
+
+    /// one refinement: the two parent vertices of each vertex,
+    /// equal for a vertex kept from the parent mesh, and the
+    /// parent cell of each cell
+    struct Refinement_Level {
+      std::size_t parent_mesh_id;
+      std::size_t child_mesh_id;
+      std::size_t parent_vertices;
+      std::size_t parent_cells;
+      std::vector<std::size_t> vertex_parents;
+      std::vector<std::size_t> cell_parents;
+    };
+
+    /// refinements since the start of the last refinement pass
+    std::vector<Refinement_Level> _refinement_history;
+
+    /// Record a refinement and make the refined mesh current,
+    /// prolonging the indicator fields
+    void accept_refinement (
+      std::shared_ptr<const dolfin::Mesh> refined_mesh
+    );
+
+    /// Match the vertices of a refined mesh to the vertices and
+    /// edge midpoints of its parent; false, with the history
+    /// cleared, if the meshes are not nested
+    bool record_refinement (
+      const dolfin::Mesh& parent_mesh,
+      const dolfin::Mesh& child_mesh
+    );
+
+    /// Prolong vertex values, components after each other, from
+    /// the parent to the child mesh of a refinement
+    static void prolong_vertex_values (
+      const Refinement_Level& level,
+      const std::size_t components,
+      std::vector<double>& values
+    );
+
+    /// Entropy error of the cells in [begin, end) for every
+    /// species, from vertex values stored species after species;
+    /// the integrand of poisson_cell_marker with zero entropy,
+    /// averaged over each P1 tetrahedron in closed form
+    void entropy_kernel (
+      const std::size_t begin,
+      const std::size_t end,
+      const std::size_t species,
+      const double* potential,
+      const double* weight,
+      const double* diffusivity,
+      double* component_entropy
+    ) const;
+
+    /// longest edge of each face, for the refinement closure,
+    /// cached per mesh
+    std::vector<std::size_t> _face_longest_edge;
+    std::size_t _edges_mesh_id;
+    bool _edges_uninitialized = true;
+    void init_edges ();
 };
 
 #endif
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <fstream>
 #include <string.h>
+#include <vector>
 #include <dolfin.h>
 #include <ufc.h>
 
@@ -42,6 +43,32 @@ class Newton_Status {
     bool converged ();
     void print_status ();
 
+    /// inexact Newton: choose the linear solver tolerance
+    /// from the residual history (Eisenstat-Walker, choice 2)
+    void use_inexact_newton (
+      const double initial_forcing_in,
+      const double min_forcing_in,
+      const double max_forcing_in
+    );
+
+    /// restart the residual history behind the forcing term,
+    /// e.g. when initial_residual is carried over from a
+    /// coarser mesh or scaled differently than later residuals
+    void reset_residual_history (
+      const double residual_in
+    );
+
+    /// linear solver tolerance for the next Newton step
+    double linear_tolerance (
+      const double fixed_tolerance
+    );
+
+    /// record the Krylov iterations of the last linear solve
+    void update_krylov_iterations (
+      const int krylov_iterations_in
+    );
+    void print_krylov_iterations ();
+
     /// compare solutions
     // void update_solution ();
     // void update_residual_vector ();
@@ -57,7 +84,17 @@ class Newton_Status {
     double max_residual;
     double relative_residual = 1.0;
 
+    /// inexact Newton
+    bool inexact_newton = false;
+    double forcing_term = 1.0;
+    double min_forcing = 0.0;
+    double max_forcing = 1.0;
+    std::vector<double> residual_history;
+    std::vector<int> krylov_iterations;
+
   private:
+    void update_forcing_term ();
+
     // std::shared_ptr<dolfin::Function> _solution;
     // std::shared_ptr<dolfin::GenericVector> _residual_vector;
 };
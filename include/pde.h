@@ -8,6 +8,7 @@
 #include <ufc.h>
 #include "domain.h"
 #include "dirichlet.h"
+#include "threaded_assembler.h"
 extern "C" {
   #include "fasp.h"
   #include "fasp_functs.h"
@@ -118,6 +119,21 @@ class PDE {
 
     /// Get the current solution
     dolfin::Function get_solution ();
+
+    /// The current solution itself, without copying its vector
+    std::shared_ptr<const dolfin::Function> get_solution_function ();
+
+    /// Add an update, indexed by dofs of the function space, to
+    /// the current solution in place
+    void add_to_solution (
+      const double* update
+    );
+
+    /// Overwrite the current solution with values indexed by
+    /// dofs of the function space, e.g. to restore a saved state
+    void set_solution_values (
+      const double* values
+    );
     std::vector<dolfin::Function> get_solutions ();
 
 
@@ -144,6 +160,41 @@ class PDE {
       std::string norm_type
     );
 
+    /// Compute the residual restricted to one solution component,
+    /// building the dof map first if needed. A component outside
+    /// the solution is an input error
+    double compute_residual (
+      std::string norm_type,
+      std::size_t component
+    );
+
+    /// Assemble the residual vector for the current solution,
+    /// reusing the cached vector if the solution has not changed
+    std::shared_ptr<const dolfin::EigenVector> get_residual_vector ();
+
+    /// Assemble the residual of the current solution into a
+    /// vector, bypassing the cache
+    void assemble_residual (
+      dolfin::EigenVector& residual_vector
+    );
+
+    /// Mark the cached residual as stale, e.g. after
+    /// changing forms or coefficients outside of PDE
+    void invalidate_residual ();
+
+    /// Called at the end of every set_coefficients, so derived
+    /// problems can drop state built from the old coefficients
+    virtual void coefficients_changed ();
+
+    /// Set the number of threads assembling the Jacobian and
+    /// residual, 0 for all hardware threads
+    void set_assembly_threads (
+      const std::size_t num_threads
+    );
+
+    /// Number of threads assembling the Jacobian and residual
+    std::size_t get_assembly_threads ();
+
 
     /// Define analytic functions from read-in files
     ///
@@ -179,6 +230,18 @@ class PDE {
       dvector* vector
     );
 
+    /// Convert to block CSR with a persistent block layout:
+    /// the layout is built once per sparsity pattern and later
+    /// calls only refill the values in place
+    void dCSRmat_to_dBSRmat (
+      const dCSRmat* dCSR_matrix,
+      const int block_size,
+      dBSRmat* dBSR_matrix
+    );
+
+    /// Colored multithreaded assembly of the forms
+    std::shared_ptr<Threaded_Assembler> _threaded_assembler;
+
     /// Linear algebra
     std::shared_ptr<dolfin::EigenMatrix> _eigen_matrix;
     std::shared_ptr<dolfin::EigenVector> _eigen_vector;
@@ -206,6 +269,16 @@ class PDE {
 
   private:
 
+    /// Residual cache, valid while _residual_version == _solution_version
+    std::shared_ptr<dolfin::EigenVector> _residual_vector;
+    std::size_t _solution_version = 1;
+    std::size_t _residual_version = 0;
+
+    /// Sparsity pattern, rebuilt only when the mesh changes
+    std::size_t _matrix_pattern_version = 0;
+    std::size_t _bsr_pattern_version = 0;
+    std::vector<int> _bsr_value_map;
+
     /// Current solution
     std::shared_ptr<dolfin::Function> _solution_function;
 
@@ -0,0 +1,83 @@
+#ifndef __PHASE_TIMER_H
+#define __PHASE_TIMER_H
+
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <string>
+#include <map>
+#include <chrono>
+
+class Phase_Timer {
+  public:
+
+    /// Time the enclosing scope and record it under the
+    /// given phase in the Phase_Registry when it ends
+    ///
+    /// *Arguments*
+    ///  phase (_std::string_)
+    ///    Name of the phase, e.g. "PDE::setup_linear_algebra"
+    Phase_Timer (
+      const std::string phase
+    );
+
+    /// Destructor, records the elapsed time if not stopped
+    virtual ~Phase_Timer ();
+
+    /// Record the elapsed time now instead of at scope exit
+    double stop ();
+
+  private:
+    std::string _phase;
+    std::chrono::steady_clock::time_point _start;
+    bool _running = true;
+};
+
+class Phase_Registry {
+  public:
+
+    /// Add one timed call of a phase
+    static void record (
+      const std::string phase,
+      const double seconds
+    );
+
+    /// Add to a named counter, e.g. Krylov iterations
+    static void count (
+      const std::string counter,
+      const long increment
+    );
+
+    /// Print a table of all phases and counters
+    static void print_table ();
+
+    /// Write all phases and counters as JSON
+    static void write_json (
+      const std::string filename
+    );
+
+    /// Accumulated time of a phase, zero if never recorded
+    static double total_seconds (
+      const std::string phase
+    );
+
+    /// Value of a counter, zero if never counted
+    static long counter_value (
+      const std::string counter
+    );
+
+    /// Forget all recorded phases and counters
+    static void reset ();
+
+  private:
+    struct Phase {
+      std::size_t calls = 0;
+      double total_seconds = 0.0;
+      double max_seconds = 0.0;
+    };
+
+    static std::map<std::string, Phase>& _phases ();
+    static std::map<std::string, long>& _counters ();
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef __PNP_JACOBIAN_OPERATOR_H
+#define __PNP_JACOBIAN_OPERATOR_H
+
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <vector>
+#include <dolfin.h>
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+class PNP_Jacobian_Operator {
+  public:
+
+    /// Matrix-free action of the Jacobian of vector_linear_pnp_forms
+    /// (potential and two log-concentrations on P1 tetrahedra)
+    /// computed cell by cell from the geometry and the nodal values
+    /// of the linearization point, without storing the block matrix.
+    /// exp(uu) enters through its P1 interpolant, which gives closed
+    /// form cell integrals; the result agrees with the assembled
+    /// Jacobian up to that interpolation.
+    ///
+    /// Cells are processed in batches with the geometry stored as
+    /// structure of arrays. Each stage of the kernel loops over the
+    /// cells of a batch innermost (omp simd), so it vectorizes even
+    /// at -O2; phys_pnp_operator_perf reports the time per apply.
+    PNP_Jacobian_Operator ();
+
+    /// Destructor
+    virtual ~PNP_Jacobian_Operator ();
+
+    /// Cache cell volumes, barycentric gradients and dofs
+    ///
+    /// *Arguments*
+    ///  function_space (_dolfin::FunctionSpace_)
+    ///    Mixed space of three P1 components
+    void init_geometry (
+      const dolfin::FunctionSpace& function_space
+    );
+
+    /// Set the constant coefficients of the form
+    ///
+    /// *Arguments*
+    ///  permittivity (_double_)
+    ///  diffusivity, valency (_std::vector<double>_)
+    ///    One entry per component, the first is unused
+    void set_coefficients (
+      const double permittivity,
+      const std::vector<double>& diffusivity,
+      const std::vector<double>& valency
+    );
+
+    /// Dofs whose rows are identity rows, as after applying
+    /// Dirichlet conditions to the assembled Jacobian
+    void set_dirichlet_dofs (
+      const std::vector<dolfin::la_index>& dofs
+    );
+
+    /// Linearize at a solution, rebuilding the geometry if the
+    /// mesh has changed
+    void update (
+      const dolfin::Function& solution
+    );
+
+    /// y = J x, with x and y indexed by dofs of the mixed space
+    void apply (
+      const double* x,
+      double* y
+    );
+
+    /// Shell matrix callback for the FASP matrix-free solvers,
+    /// with data pointing to the operator
+    static void apply (
+      const void* data,
+      const REAL* x,
+      REAL* y
+    );
+
+    /// Fill a FASP shell matrix applying this operator
+    void shell_matrix (
+      mxv_matfree& shell
+    );
+
+    /// Bytes read by one application, for throughput estimates
+    std::size_t memory_bytes ();
+
+  private:
+    /// cells per batch of the vectorized kernel; the cell arrays
+    /// are padded with empty cells to a multiple of it
+    static const std::size_t _batch = 8;
+    std::size_t _num_cells = 0;
+    std::size_t _padded_cells = 0;
+    std::size_t _num_dofs = 0;
+
+    /// structure of arrays: _volume[cell],
+    /// _gradients[(vertex * 3 + d) * _padded_cells + cell] and
+    /// _cell_dofs[(component * 4 + vertex) * _padded_cells + cell]
+    std::vector<double> _volume;
+    std::vector<double> _gradients;
+    std::vector<dolfin::la_index> _cell_dofs;
+
+    /// mesh the geometry was cached for
+    std::size_t _geometry_mesh_id;
+    bool _geometry_uninitialized = true;
+
+    /// linearization point and exp of it, per dof
+    std::vector<double> _solution;
+    std::vector<double> _exp_solution;
+
+    double _permittivity = 1.0;
+    double _diffusivity[3] = {0.0, 0.0, 0.0};
+    double _valency[3] = {0.0, 0.0, 0.0};
+    std::vector<dolfin::la_index> _dirichlet_dofs;
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef __PRECONDITIONER_CACHE_H
+#define __PRECONDITIONER_CACHE_H
+
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include "lagged_preconditioner.h"
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+class Preconditioner_Cache : public Lagged_Preconditioner {
+  public:
+
+    /// Keep the ILU factors of a block Jacobian across
+    /// Newton steps and rebuild them only when needed
+    ///
+    /// FASP has no numeric-only refactorization of the block
+    /// ILU on an existing symbolic structure, so the factors
+    /// are lagged: they precondition the new Jacobian as they
+    /// are, and the full setup runs again when the layout
+    /// changes, the iterations grow, or a solve fails.
+    ///
+    /// *Arguments*
+    ///  ilu (_ILU_param_)
+    ///    Parameters for the ILU setup
+    ///  iteration_growth (_double_)
+    ///    Rebuild once the Krylov iteration count exceeds
+    ///    this factor times the count right after a setup
+    Preconditioner_Cache (
+      const ILU_param &ilu,
+      const double iteration_growth
+    );
+
+    /// Destructor
+    virtual ~Preconditioner_Cache ();
+
+    /// Solve with the cached preconditioner, refreshing
+    /// it first if the matrix layout changed, the last
+    /// solve was too slow, or a rebuild was requested.
+    /// A failed solve with reused factors is retried
+    /// once with fresh factors.
+    INT solve (
+      dBSRmat* matrix,
+      dvector* rhs,
+      dvector* solution,
+      itsolver_param* itsolver
+    );
+
+    /// Solve with a matrix-free operator, e.g. a finite
+    /// difference Jacobian, preconditioned by the factors of
+    /// a possibly lagged matrix. Factors are refreshed as in
+    /// the assembled solve, but a failed solve is not retried
+    /// since the matrix may be too old to help.
+    INT solve (
+      mxv_matfree* jacobian,
+      dBSRmat* matrix,
+      dvector* rhs,
+      dvector* solution,
+      itsolver_param* itsolver
+    );
+
+    /// Release the factors
+    void free_preconditioner ();
+
+  protected:
+    void setup ();
+
+    INT krylov_solve (
+      dvector* rhs,
+      dvector* solution,
+      itsolver_param* itsolver
+    );
+
+  private:
+    ILU_param _ilu;
+    ILU_data _ilu_data;
+    bool _ilu_allocated = false;
+
+    /// system of the current solve, the operator is NULL
+    /// for an assembled solve
+    dBSRmat* _matrix = NULL;
+    mxv_matfree* _jacobian = NULL;
+};
+
+#endif
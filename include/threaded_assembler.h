@@ -0,0 +1,155 @@
+#ifndef __THREADED_ASSEMBLER_H
+#define __THREADED_ASSEMBLER_H
+
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <dolfin.h>
+#include <ufc.h>
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+class Threaded_Assembler {
+  public:
+
+    /// Assemble forms on shared memory threads. Cells, together
+    /// with their exterior facets, and interior facets are colored
+    /// so that no two items of one color share a mesh vertex; the
+    /// items of a color then touch disjoint dofs and are added
+    /// into the preallocated tensor without locks, one color after
+    /// the other.
+    ///
+    /// Coefficients are restricted concurrently, so they must be
+    /// constants or functions on the mesh of the form.
+    ///
+    /// The worker threads are started at the first assembly and
+    /// kept, waiting for the next one, until the number of
+    /// threads changes or the assembler is destroyed.
+    ///
+    /// *Arguments*
+    ///  num_threads (_std::size_t_)
+    ///    Number of threads, 0 for all hardware threads
+    Threaded_Assembler (
+      const std::size_t num_threads
+    );
+
+    /// Destructor
+    virtual ~Threaded_Assembler ();
+
+    /// Set the number of threads, 0 for all hardware threads
+    void set_num_threads (
+      const std::size_t num_threads
+    );
+
+    /// Number of threads used for assembly
+    std::size_t num_threads ();
+
+    /// Color the cells and interior facets of a mesh
+    void init_coloring (
+      const dolfin::Mesh& mesh
+    );
+
+    /// Number of colors of the cells and of the interior facets
+    std::size_t num_cell_colors ();
+    std::size_t num_facet_colors ();
+
+    /// Zero and refill the values of a matrix. An empty matrix
+    /// gets its sparsity pattern from a serial dolfin::assemble.
+    void assemble (
+      dolfin::EigenMatrix& matrix,
+      const dolfin::Form& bilinear_form
+    );
+
+    /// Zero and refill a vector, sizing it if needed
+    void assemble (
+      dolfin::EigenVector& vector,
+      const dolfin::Form& linear_form
+    );
+
+    /// Assemble a rank 1 or 2 form into any storage, calling
+    /// add_tensor with the thread, the local tensor and the dofs
+    /// of each dimension; calls for one color never share dofs
+    void assemble_form (
+      const dolfin::Form& form,
+      const std::function<void(
+        std::size_t,
+        const double*,
+        const std::vector<dolfin::ArrayView<const dolfin::la_index>>&
+      )>& add_tensor
+    );
+
+  private:
+    std::size_t _num_threads;
+
+    /// items of each color: cells, and interior facets
+    std::vector<std::vector<std::size_t>> _cell_colors;
+    std::vector<std::vector<std::size_t>> _facet_colors;
+
+    /// exterior facets of each cell, as local facet numbers
+    /// in _cell_facets[_cell_facet_offsets[cell] ...]
+    std::vector<std::size_t> _cell_facet_offsets;
+    std::vector<std::size_t> _cell_facets;
+
+    /// mesh the coloring was built for
+    std::size_t _coloring_mesh_id;
+    bool _coloring_uninitialized = true;
+
+    /// Greedy coloring of items given by their vertex lists
+    static void color_items (
+      const std::vector<std::size_t>& item_ids,
+      const std::vector<std::size_t>& item_offsets,
+      const std::vector<unsigned int>& item_vertices,
+      const std::size_t num_vertices,
+      std::vector<std::vector<std::size_t>>& colors
+    );
+
+    /// Run a kernel over the items of every color, waiting for
+    /// all threads between colors
+    void run_colored (
+      const std::vector<std::vector<std::size_t>>& colors,
+      const std::function<void(std::size_t, std::size_t)>& kernel
+    );
+
+    /// persistent worker threads 1, 2, ... of the pool, thread 0
+    /// is the calling thread
+    std::vector<std::thread> _workers;
+    std::size_t _pool_threads = 1;
+    void start_workers (
+      const std::size_t num_threads
+    );
+    void stop_workers ();
+    void worker_loop (
+      const std::size_t thread,
+      std::size_t generation
+    );
+
+    /// share of one thread in the current run_colored
+    void run_colors (
+      const std::size_t thread
+    );
+
+    /// work of the current run_colored and its synchronization:
+    /// a new generation wakes the workers, the barrier separates
+    /// the colors, and the caller waits until no worker is active
+    std::mutex _pool_mutex;
+    std::condition_variable _pool_start;
+    std::condition_variable _pool_barrier;
+    std::condition_variable _pool_idle;
+    std::size_t _pool_generation = 0;
+    bool _pool_stop = false;
+    const std::vector<std::vector<std::size_t>>* _pool_colors = NULL;
+    const std::function<void(std::size_t, std::size_t)>* _pool_kernel = NULL;
+    std::size_t _pool_waiting = 0;
+    std::size_t _pool_finished_colors = 0;
+    std::size_t _pool_active = 0;
+};
+
+#endif
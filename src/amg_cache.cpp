@@ -0,0 +1,117 @@
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include "amg_cache.h"
+#include "phase_timer.h"
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+//--------------------------------------
+AMG_Cache::AMG_Cache (
+  const AMG_param &amg,
+  const double iteration_growth
+) : Lagged_Preconditioner("AMG", iteration_growth) {
+  _amg = amg;
+}
+//--------------------------------------
+AMG_Cache::~AMG_Cache () {
+  AMG_Cache::free_preconditioner();
+}
+//--------------------------------------
+
+
+
+
+//--------------------------------------
+INT AMG_Cache::solve (
+  dCSRmat* matrix,
+  dvector* rhs,
+  dvector* solution,
+  itsolver_param* itsolver
+) {
+  _matrix = matrix;
+  return Lagged_Preconditioner::lagged_solve(
+    matrix->row,
+    matrix->nnz,
+    rhs,
+    solution,
+    itsolver,
+    true
+  );
+}
+//--------------------------------------
+INT AMG_Cache::krylov_solve (
+  dvector* rhs,
+  dvector* solution,
+  itsolver_param* itsolver
+) {
+  return fasp_solver_dcsr_itsolver(
+    _matrix,
+    rhs,
+    solution,
+    &_preconditioner,
+    itsolver
+  );
+}
+//--------------------------------------
+void AMG_Cache::setup () {
+  dCSRmat* matrix = _matrix;
+  AMG_Cache::free_preconditioner();
+
+  printf("\tsetting up AMG hierarchy\n"); fflush(stdout);
+  Phase_Timer timer("FASP AMG setup");
+
+  // the finest level keeps its own copy of the matrix, so later
+  // solves precondition with the matrix of the last setup
+  _amg_data = fasp_amg_data_create(_amg.max_levels);
+  _amg_data[0].A = fasp_dcsr_create(matrix->row, matrix->col, matrix->nnz);
+  fasp_dcsr_cp(matrix, &_amg_data[0].A);
+  _amg_data[0].b = fasp_dvec_create(matrix->row);
+  _amg_data[0].x = fasp_dvec_create(matrix->col);
+
+  SHORT status;
+  switch (_amg.AMG_type) {
+    case SA_AMG:
+      status = fasp_amg_setup_sa(_amg_data, &_amg);
+      break;
+    case UA_AMG:
+      status = fasp_amg_setup_ua(_amg_data, &_amg);
+      break;
+    default:
+      status = fasp_amg_setup_rs(_amg_data, &_amg);
+      break;
+  }
+  if (status < 0) {
+    fasp_chkerr(status, "AMG_Cache::setup");
+  }
+
+  fasp_param_amg_to_prec(&_precond_data, &_amg);
+  _precond_data.max_levels = _amg_data[0].num_levels;
+  _precond_data.mgl_data = _amg_data;
+
+  _preconditioner.data = &_precond_data;
+  switch (_amg.cycle_type) {
+    case AMLI_CYCLE:
+      _preconditioner.fct = fasp_precond_amli;
+      break;
+    case NL_AMLI_CYCLE:
+      _preconditioner.fct = fasp_precond_nl_amli;
+      break;
+    default:
+      _preconditioner.fct = fasp_precond_amg;
+      break;
+  }
+
+  Lagged_Preconditioner::finish_setup(matrix->row, matrix->nnz);
+}
+//--------------------------------------
+void AMG_Cache::free_preconditioner () {
+  if (_amg_data != NULL) {
+    fasp_amg_data_free(_amg_data, &_amg);
+    _amg_data = NULL;
+  }
+  _needs_setup = true;
+}
+//--------------------------------------
@@ -0,0 +1,322 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <string.h>
+#include <vector>
+#include <dolfin.h>
+#include <ufc.h>
+#include "bsr_assembler.h"
+#include "threaded_assembler.h"
+#include "phase_timer.h"
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+//--------------------------------------
+BSR_Assembler::BSR_Assembler (
+  const std::size_t block_size
+) {
+  _block_size = block_size;
+}
+//--------------------------------------
+BSR_Assembler::~BSR_Assembler () {
+  BSR_Assembler::free_matrix();
+}
+//--------------------------------------
+
+
+
+
+//--------------------------------------
+void BSR_Assembler::init_pattern (
+  const dolfin::Form& bilinear_form
+) {
+  const dolfin::Mesh& mesh = *(bilinear_form.mesh());
+  std::shared_ptr<const dolfin::GenericDofMap> row_dofmap = bilinear_form.function_space(0)->dofmap();
+  std::shared_ptr<const dolfin::GenericDofMap> col_dofmap = bilinear_form.function_space(1)->dofmap();
+
+  const int nb = (int) _block_size;
+  const int rows = (int) row_dofmap->global_dimension();
+  const int cols = (int) col_dofmap->global_dimension();
+  if (rows % nb != 0 || cols % nb != 0) {
+    fasp_chkerr(ERROR_INPUT_PAR, "BSR_Assembler::init_pattern");
+  }
+  const int block_rows = rows / nb;
+  const int block_cols = cols / nb;
+
+  // collect the block columns coupled to each block row
+  std::vector<std::vector<int>> block_pattern(block_rows);
+  for (int block_row = 0; block_row < block_rows && block_row < block_cols; block_row++) {
+    block_pattern[block_row].push_back(block_row);
+  }
+  for (dolfin::CellIterator cell(mesh); !cell.end(); ++cell) {
+    dolfin::ArrayView<const dolfin::la_index> row_dofs = row_dofmap->cell_dofs(cell->index());
+    dolfin::ArrayView<const dolfin::la_index> col_dofs = col_dofmap->cell_dofs(cell->index());
+    for (std::size_t i = 0; i < row_dofs.size(); i++) {
+      std::vector<int>& pattern_row = block_pattern[row_dofs[i] / nb];
+      for (std::size_t j = 0; j < col_dofs.size(); j++) {
+        pattern_row.push_back(col_dofs[j] / nb);
+      }
+    }
+  }
+
+  int block_nnz = 0;
+  for (int block_row = 0; block_row < block_rows; block_row++) {
+    std::vector<int>& pattern_row = block_pattern[block_row];
+    std::sort(pattern_row.begin(), pattern_row.end());
+    pattern_row.erase(std::unique(pattern_row.begin(), pattern_row.end()), pattern_row.end());
+    block_nnz += pattern_row.size();
+  }
+
+  BSR_Assembler::free_matrix();
+  fasp_dbsr_alloc(block_rows, block_cols, block_nnz, nb, 0, &_matrix);
+  _matrix_allocated = true;
+
+  int block = 0;
+  _matrix.IA[0] = 0;
+  for (int block_row = 0; block_row < block_rows; block_row++) {
+    for (std::size_t k = 0; k < block_pattern[block_row].size(); k++) {
+      _matrix.JA[block++] = block_pattern[block_row][k];
+    }
+    _matrix.IA[block_row + 1] = block;
+  }
+
+  _pattern_mesh_id = mesh.id();
+  _pattern_dimension = rows;
+  _pattern_count++;
+}
+//--------------------------------------
+void BSR_Assembler::assemble (
+  const dolfin::Form& bilinear_form
+) {
+  const dolfin::Mesh& mesh = *(bilinear_form.mesh());
+  std::shared_ptr<const dolfin::GenericDofMap> row_dofmap = bilinear_form.function_space(0)->dofmap();
+  std::shared_ptr<const dolfin::GenericDofMap> col_dofmap = bilinear_form.function_space(1)->dofmap();
+
+  if (!_matrix_allocated
+    || _pattern_mesh_id != mesh.id()
+    || _pattern_dimension != row_dofmap->global_dimension()
+  ) {
+    BSR_Assembler::init_pattern(bilinear_form);
+  }
+
+  Phase_Timer timer("BSR_Assembler::assemble");
+  const int nb = (int) _block_size;
+  fasp_darray_set(_matrix.NNZ * nb * nb, _matrix.val, 0.0);
+
+  // only the default cell integral is assembled, which
+  // covers the dx-only Jacobians of the PNP forms
+  dolfin::UFC ufc(bilinear_form);
+  ufc::cell_integral* integral = ufc.default_cell_integral.get();
+  if (!integral) {
+    return;
+  }
+
+  ufc::cell ufc_cell;
+  std::vector<double> coordinate_dofs;
+  for (dolfin::CellIterator cell(mesh); !cell.end(); ++cell) {
+    cell->get_cell_data(ufc_cell);
+    cell->get_coordinate_dofs(coordinate_dofs);
+    ufc.update(*cell, coordinate_dofs, ufc_cell, integral->enabled_coefficients());
+    integral->tabulate_tensor(
+      ufc.A.data(),
+      ufc.w(),
+      coordinate_dofs.data(),
+      ufc_cell.orientation
+    );
+
+    dolfin::ArrayView<const dolfin::la_index> row_dofs = row_dofmap->cell_dofs(cell->index());
+    dolfin::ArrayView<const dolfin::la_index> col_dofs = col_dofmap->cell_dofs(cell->index());
+    const std::size_t local_cols = col_dofs.size();
+    for (std::size_t i = 0; i < row_dofs.size(); i++) {
+      for (std::size_t j = 0; j < local_cols; j++) {
+        *(BSR_Assembler::entry(row_dofs[i], col_dofs[j])) += ufc.A[i * local_cols + j];
+      }
+    }
+  }
+}
+//--------------------------------------
+void BSR_Assembler::assemble (
+  const dolfin::Form& bilinear_form,
+  Threaded_Assembler& threaded_assembler
+) {
+  const dolfin::Mesh& mesh = *(bilinear_form.mesh());
+  std::shared_ptr<const dolfin::GenericDofMap> row_dofmap = bilinear_form.function_space(0)->dofmap();
+
+  if (!_matrix_allocated
+    || _pattern_mesh_id != mesh.id()
+    || _pattern_dimension != row_dofmap->global_dimension()
+  ) {
+    BSR_Assembler::init_pattern(bilinear_form);
+  }
+
+  Phase_Timer timer("BSR_Assembler::assemble");
+  const int nb = (int) _block_size;
+  fasp_darray_set(_matrix.NNZ * nb * nb, _matrix.val, 0.0);
+
+  // the block pattern holds the cell couplings only
+  if (bilinear_form.ufc_form()->has_exterior_facet_integrals()
+    || bilinear_form.ufc_form()->has_interior_facet_integrals()
+  ) {
+    fasp_chkerr(ERROR_INPUT_PAR, "BSR_Assembler::assemble");
+  }
+
+  auto add_tensor = [&] (
+    const std::size_t thread,
+    const double* tensor,
+    const std::vector<dolfin::ArrayView<const dolfin::la_index>>& dofs
+  ) {
+    const std::size_t local_cols = dofs[1].size();
+    for (std::size_t i = 0; i < dofs[0].size(); i++) {
+      for (std::size_t j = 0; j < local_cols; j++) {
+        *(BSR_Assembler::entry(dofs[0][i], dofs[1][j])) += tensor[i * local_cols + j];
+      }
+    }
+  };
+  threaded_assembler.assemble_form(bilinear_form, add_tensor);
+}
+//--------------------------------------
+void BSR_Assembler::apply (
+  const std::vector<std::shared_ptr<dolfin::DirichletBC>>& dirichletBC
+) {
+  const int nb = (int) _block_size;
+  const int block_entries = nb * nb;
+
+  for (std::size_t i = 0; i < dirichletBC.size(); i++) {
+    dolfin::DirichletBC::Map boundary_values;
+    dirichletBC[i]->get_boundary_values(boundary_values);
+
+    dolfin::DirichletBC::Map::const_iterator bv;
+    for (bv = boundary_values.begin(); bv != boundary_values.end(); ++bv) {
+      const int row = (int) bv->first;
+      const int block_row = row / nb;
+      const int local_row = row % nb;
+      for (int k = _matrix.IA[block_row]; k < _matrix.IA[block_row + 1]; k++) {
+        double* block_values = _matrix.val + k * block_entries + local_row * nb;
+        for (int c = 0; c < nb; c++) {
+          block_values[c] = 0.0;
+        }
+      }
+      *(BSR_Assembler::entry(row, row)) = 1.0;
+    }
+  }
+
+  // check for rows of zeros and add a unit diagonal entry
+  for (int block_row = 0; block_row < _matrix.ROW; block_row++) {
+    for (int local_row = 0; local_row < nb; local_row++) {
+      bool nonzero_entry = false;
+      for (int k = _matrix.IA[block_row]; k < _matrix.IA[block_row + 1] && !nonzero_entry; k++) {
+        const double* block_values = _matrix.val + k * block_entries + local_row * nb;
+        for (int c = 0; c < nb; c++) {
+          if (block_values[c] != 0.0) {
+            nonzero_entry = true;
+          }
+        }
+      }
+
+      if (nonzero_entry == false) {
+        const std::size_t row = block_row * nb + local_row;
+        printf(" Row %lu has only zeros! Setting diagonal entry to 1.0 \n", row);
+        *(BSR_Assembler::entry(row, row)) = 1.0;
+      }
+    }
+  }
+}
+//--------------------------------------
+double* BSR_Assembler::entry (
+  const std::size_t row,
+  const std::size_t col
+) {
+  const int offset = BSR_Assembler::value_offset(row, col);
+  if (offset < 0) {
+    return NULL;
+  }
+
+  return _matrix.val + offset;
+}
+//--------------------------------------
+int BSR_Assembler::value_offset (
+  const std::size_t row,
+  const std::size_t col
+) {
+  const int nb = (int) _block_size;
+  const int block_row = row / nb;
+  const int block_col = col / nb;
+
+  for (int k = _matrix.IA[block_row]; k < _matrix.IA[block_row + 1]; k++) {
+    if (_matrix.JA[k] == block_col) {
+      return k * nb * nb + (row % nb) * nb + (col % nb);
+    }
+  }
+
+  return -1;
+}
+//--------------------------------------
+void BSR_Assembler::extract_block (
+  const std::vector<dolfin::la_index>& dofs,
+  dCSRmat& block,
+  std::vector<int>& offsets
+) {
+  const int nb = (int) _block_size;
+  const std::size_t size = dofs.size();
+
+  if (offsets.empty()) {
+    std::vector<int> subset_index(_matrix.ROW * nb, -1);
+    for (std::size_t i = 0; i < size; i++) {
+      subset_index[dofs[i]] = i;
+    }
+
+    // columns of each row in increasing order, with the offset
+    // of their value in the block matrix
+    std::vector<INT> row_start(size + 1, 0);
+    std::vector<std::pair<INT, int>> row_entries;
+    std::vector<INT> columns;
+    for (std::size_t i = 0; i < size; i++) {
+      const int block_row = dofs[i] / nb;
+      const int local_row = dofs[i] % nb;
+      row_entries.clear();
+      for (int k = _matrix.IA[block_row]; k < _matrix.IA[block_row + 1]; k++) {
+        for (int local_col = 0; local_col < nb; local_col++) {
+          const int col = subset_index[_matrix.JA[k] * nb + local_col];
+          if (col >= 0) {
+            row_entries.push_back(std::make_pair(col, k * nb * nb + local_row * nb + local_col));
+          }
+        }
+      }
+      std::sort(row_entries.begin(), row_entries.end());
+      for (std::size_t j = 0; j < row_entries.size(); j++) {
+        columns.push_back(row_entries[j].first);
+        offsets.push_back(row_entries[j].second);
+      }
+      row_start[i + 1] = columns.size();
+    }
+
+    fasp_dcsr_alloc(size, size, columns.size(), &block);
+    std::copy(row_start.begin(), row_start.end(), block.IA);
+    std::copy(columns.begin(), columns.end(), block.JA);
+  }
+
+  const REAL* values = _matrix.val;
+  const int* offset = offsets.data();
+  const std::size_t nnz = offsets.size();
+  for (std::size_t j = 0; j < nnz; j++) {
+    block.val[j] = values[offset[j]];
+  }
+}
+//--------------------------------------
+std::size_t BSR_Assembler::pattern_count () {
+  return _pattern_count;
+}
+//--------------------------------------
+dBSRmat* BSR_Assembler::matrix () {
+  return &_matrix;
+}
+//--------------------------------------
+void BSR_Assembler::free_matrix () {
+  if (_matrix_allocated) {
+    fasp_dbsr_free(&_matrix);
+    _matrix_allocated = false;
+  }
+}
+//--------------------------------------
@@ -0,0 +1,209 @@
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <cmath>
+#include <map>
+#include <vector>
+#include <dolfin.h>
+#include "bsr_assembler.h"
+#include "eafe_assembler.h"
+#include "phase_timer.h"
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+//--------------------------------------
+EAFE_Assembler::EAFE_Assembler () {}
+//--------------------------------------
+EAFE_Assembler::~EAFE_Assembler () {}
+//--------------------------------------
+
+
+
+
+//--------------------------------------
+void EAFE_Assembler::init_edges (
+  const dolfin::FunctionSpace& function_space
+) {
+  const dolfin::Mesh& mesh = *(function_space.mesh());
+  std::shared_ptr<const dolfin::GenericDofMap> dofmap = function_space.dofmap();
+  if (mesh.topology().dim() != 3 || dofmap->max_element_dofs() != 4) {
+    fasp_chkerr(ERROR_INPUT_PAR, "EAFE_Assembler::init_edges");
+  }
+  mesh.init(1);
+  mesh.init(3, 1);
+
+  const std::size_t num_edges = mesh.num_edges();
+  _edge_start.assign(num_edges, 0);
+  _edge_end.assign(num_edges, 0);
+  _edge_stiffness.assign(num_edges, 0.0);
+  _num_dofs = dofmap->global_dimension();
+
+  std::vector<double> coordinate_dofs;
+  double J[9], K[9], gradients[12];
+  for (dolfin::CellIterator cell(mesh); !cell.end(); ++cell) {
+    cell->get_coordinate_dofs(coordinate_dofs);
+    const double* x = coordinate_dofs.data();
+
+    // Jacobian of the affine map from the reference tetrahedron
+    for (std::size_t i = 0; i < 3; i++) {
+      for (std::size_t k = 0; k < 3; k++) {
+        J[i * 3 + k] = x[(k + 1) * 3 + i] - x[i];
+      }
+    }
+    const double det = J[0] * (J[4] * J[8] - J[5] * J[7])
+      - J[1] * (J[3] * J[8] - J[5] * J[6])
+      + J[2] * (J[3] * J[7] - J[4] * J[6]);
+    K[0] = (J[4] * J[8] - J[5] * J[7]) / det;
+    K[1] = (J[2] * J[7] - J[1] * J[8]) / det;
+    K[2] = (J[1] * J[5] - J[2] * J[4]) / det;
+    K[3] = (J[5] * J[6] - J[3] * J[8]) / det;
+    K[4] = (J[0] * J[8] - J[2] * J[6]) / det;
+    K[5] = (J[2] * J[3] - J[0] * J[5]) / det;
+    K[6] = (J[3] * J[7] - J[4] * J[6]) / det;
+    K[7] = (J[1] * J[6] - J[0] * J[7]) / det;
+    K[8] = (J[0] * J[4] - J[1] * J[3]) / det;
+    const double volume = std::fabs(det) / 6.0;
+
+    // gradients of the barycentric coordinates
+    for (std::size_t i = 0; i < 3; i++) {
+      gradients[(i + 1) * 3 + 0] = K[i * 3 + 0];
+      gradients[(i + 1) * 3 + 1] = K[i * 3 + 1];
+      gradients[(i + 1) * 3 + 2] = K[i * 3 + 2];
+    }
+    for (std::size_t d = 0; d < 3; d++) {
+      gradients[d] = -gradients[3 + d] - gradients[6 + d] - gradients[9 + d];
+    }
+
+    // P1 dofs sit on the cell vertices in local vertex order
+    const unsigned int* cell_vertices = cell->entities(0);
+    dolfin::ArrayView<const dolfin::la_index> cell_dofs = dofmap->cell_dofs(cell->index());
+    for (dolfin::EdgeIterator edge(*cell); !edge.end(); ++edge) {
+      const unsigned int* edge_vertices = edge->entities(0);
+      std::size_t a = 0, b = 0;
+      for (std::size_t k = 0; k < 4; k++) {
+        if (cell_vertices[k] == edge_vertices[0]) a = k;
+        if (cell_vertices[k] == edge_vertices[1]) b = k;
+      }
+
+      const std::size_t e = edge->index();
+      _edge_start[e] = cell_dofs[a];
+      _edge_end[e] = cell_dofs[b];
+      _edge_stiffness[e] += volume * (
+        gradients[a * 3 + 0] * gradients[b * 3 + 0]
+        + gradients[a * 3 + 1] * gradients[b * 3 + 1]
+        + gradients[a * 3 + 2] * gradients[b * 3 + 2]
+      );
+    }
+  }
+
+  _alpha.resize(_num_dofs);
+  _eta.resize(_num_dofs);
+  _beta.resize(_num_dofs);
+  _exp_eta.resize(_num_dofs);
+  _fermi.resize(_num_dofs);
+  _forward_weight.resize(num_edges);
+  _backward_weight.resize(num_edges);
+
+  // offsets into the block matrix refer to the old edges
+  _block_offsets.clear();
+  _edge_mesh_id = mesh.id();
+  _edges_uninitialized = false;
+}
+//--------------------------------------
+void EAFE_Assembler::init_offsets (
+  BSR_Assembler& bsr_assembler,
+  const std::vector<dolfin::la_index>& dof_map,
+  Block_Offsets& offsets
+) {
+  const std::size_t num_edges = _edge_start.size();
+  offsets.forward.resize(num_edges);
+  offsets.backward.resize(num_edges);
+  offsets.diagonal.resize(_num_dofs);
+
+  bool outside_pattern = false;
+  for (std::size_t e = 0; e < num_edges; e++) {
+    const dolfin::la_index start = dof_map[_edge_start[e]];
+    const dolfin::la_index end = dof_map[_edge_end[e]];
+    offsets.forward[e] = bsr_assembler.value_offset(start, end);
+    offsets.backward[e] = bsr_assembler.value_offset(end, start);
+    outside_pattern |= (offsets.forward[e] < 0 || offsets.backward[e] < 0);
+  }
+  for (std::size_t dof = 0; dof < _num_dofs; dof++) {
+    offsets.diagonal[dof] = bsr_assembler.value_offset(dof_map[dof], dof_map[dof]);
+    outside_pattern |= (offsets.diagonal[dof] < 0);
+  }
+  if (outside_pattern) {
+    fasp_chkerr(ERROR_DATA_STRUCTURE, "EAFE_Assembler::init_offsets");
+  }
+
+  offsets.pattern = bsr_assembler.pattern_count();
+}
+//--------------------------------------
+void EAFE_Assembler::assemble (
+  BSR_Assembler& bsr_assembler,
+  const std::size_t species,
+  const std::vector<dolfin::la_index>& dof_map,
+  const dolfin::Function& alpha,
+  const dolfin::Function& eta,
+  const dolfin::Function& beta
+) {
+  if (_edges_uninitialized || _edge_mesh_id != eta.function_space()->mesh()->id()) {
+    EAFE_Assembler::init_edges(*(eta.function_space()));
+  }
+
+  Block_Offsets& offsets = _block_offsets[species];
+  if (offsets.pattern != bsr_assembler.pattern_count()) {
+    EAFE_Assembler::init_offsets(bsr_assembler, dof_map, offsets);
+  }
+
+  Phase_Timer timer("EAFE_Assembler::assemble");
+  alpha.vector()->get_local(_alpha);
+  eta.vector()->get_local(_eta);
+  beta.vector()->get_local(_beta);
+
+  // nodal quantities, one exponential per dof
+  const std::size_t num_dofs = _num_dofs;
+  for (std::size_t dof = 0; dof < num_dofs; dof++) {
+    _exp_eta[dof] = std::exp(_eta[dof]);
+    _fermi[dof] = _eta[dof] - _beta[dof];
+  }
+
+  // edge weights, using B(-x) = B(x) + x for the reverse edge
+  const std::size_t num_edges = _edge_start.size();
+  const dolfin::la_index* start = _edge_start.data();
+  const dolfin::la_index* end = _edge_end.data();
+  for (std::size_t e = 0; e < num_edges; e++) {
+    const double difference = _fermi[end[e]] - _fermi[start[e]];
+    const double weight = EAFE_Assembler::bernoulli(difference);
+    const double edge_alpha = 0.5 * (_alpha[start[e]] + _alpha[end[e]]) * _edge_stiffness[e];
+    _forward_weight[e] = edge_alpha * _exp_eta[end[e]] * weight;
+    _backward_weight[e] = edge_alpha * _exp_eta[start[e]] * (weight + difference);
+  }
+
+  // overwrite the species block; columns sum to zero
+  double* values = bsr_assembler.matrix()->val;
+  const int* diagonal = offsets.diagonal.data();
+  for (std::size_t dof = 0; dof < num_dofs; dof++) {
+    values[diagonal[dof]] = 0.0;
+  }
+  for (std::size_t e = 0; e < num_edges; e++) {
+    values[offsets.forward[e]] = _forward_weight[e];
+    values[offsets.backward[e]] = _backward_weight[e];
+    values[diagonal[end[e]]] -= _forward_weight[e];
+    values[diagonal[start[e]]] -= _backward_weight[e];
+  }
+}
+//--------------------------------------
+double EAFE_Assembler::bernoulli (
+  const double x
+) {
+  // expm1 keeps B accurate for small x; exp(x) overflow gives B = 0
+  if (std::fabs(x) < DOLFIN_EPS) {
+    return 1.0 - 0.5 * x;
+  }
+
+  return x / std::expm1(x);
+}
+//--------------------------------------
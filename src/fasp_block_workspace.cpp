@@ -0,0 +1,200 @@
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <vector>
+#include "fasp_block_workspace.h"
+#include "phase_timer.h"
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_block.h"
+  #include "fasp_functs.h"
+}
+
+//--------------------------------------
+FASP_Block_Workspace::FASP_Block_Workspace () {
+  _first_dofs.row = 0;
+  _first_dofs.val = NULL;
+  _second_dofs.row = 0;
+  _second_dofs.val = NULL;
+
+  _matrix.brow = 2;
+  _matrix.bcol = 2;
+  _matrix.blocks = (dCSRmat **) fasp_mem_calloc(4, sizeof(dCSRmat *));
+  for (int i = 0; i < 4; i++) {
+    _matrix.blocks[i] = (dCSRmat *) fasp_mem_calloc(1, sizeof(dCSRmat));
+  }
+}
+//--------------------------------------
+FASP_Block_Workspace::~FASP_Block_Workspace () {
+  FASP_Block_Workspace::free_workspace();
+  for (int i = 0; i < 4; i++) {
+    fasp_mem_free(_matrix.blocks[i]);
+  }
+  fasp_mem_free(_matrix.blocks);
+}
+//--------------------------------------
+
+
+
+
+//--------------------------------------
+void FASP_Block_Workspace::init (
+  const ivector& first_dofs,
+  const ivector& second_dofs
+) {
+  const int size = first_dofs.row + second_dofs.row;
+  if (_vectors_allocated && _rhs.row != size) {
+    fasp_dvec_free(&_rhs);
+    fasp_dvec_free(&_solution);
+    _vectors_allocated = false;
+  }
+  if (!_vectors_allocated) {
+    fasp_dvec_alloc(size, &_rhs);
+    fasp_dvec_alloc(size, &_solution);
+    _vectors_allocated = true;
+  }
+
+  if (_first_dofs.row != first_dofs.row) {
+    fasp_ivec_free(&_first_dofs);
+    fasp_ivec_alloc(first_dofs.row, &_first_dofs);
+  }
+  if (_second_dofs.row != second_dofs.row) {
+    fasp_ivec_free(&_second_dofs);
+    fasp_ivec_alloc(second_dofs.row, &_second_dofs);
+  }
+  memcpy(_first_dofs.val, first_dofs.val, first_dofs.row * sizeof(INT));
+  memcpy(_second_dofs.val, second_dofs.val, second_dofs.row * sizeof(INT));
+
+  // blocks of the old layout cannot be refilled
+  FASP_Block_Workspace::free_blocks();
+}
+//--------------------------------------
+void FASP_Block_Workspace::gather_rhs (
+  const double* values
+) {
+  const int first_size = _first_dofs.row;
+  for (int i = 0; i < first_size; i++) {
+    _rhs.val[i] = values[_first_dofs.val[i]];
+  }
+  for (int i = 0; i < _second_dofs.row; i++) {
+    _rhs.val[first_size + i] = values[_second_dofs.val[i]];
+  }
+
+  fasp_dvec_set(_solution.row, &_solution, 0.0);
+}
+//--------------------------------------
+void FASP_Block_Workspace::extract_blocks (
+  dCSRmat* matrix
+) {
+  if (!_blocks_allocated || _plan_rows != matrix->row || _plan_nnz != matrix->nnz) {
+    FASP_Block_Workspace::init_plan(matrix);
+  }
+
+  // one pass over the nonzeros scatters them into the blocks
+  Phase_Timer timer("FASP_Block_Workspace::extract_blocks");
+  double* block_values[4];
+  for (int b = 0; b < 4; b++) {
+    block_values[b] = _matrix.blocks[b]->val;
+  }
+  const int* plan_block = _plan_block.data();
+  const int* plan_offset = _plan_offset.data();
+  const double* values = matrix->val;
+  for (INT k = 0; k < matrix->nnz; k++) {
+    block_values[plan_block[k]][plan_offset[k]] = values[k];
+  }
+}
+//--------------------------------------
+void FASP_Block_Workspace::init_plan (
+  const dCSRmat* matrix
+) {
+  FASP_Block_Workspace::free_blocks();
+
+  // block and position within it of every dof
+  std::vector<int> dof_block(matrix->row, -1);
+  std::vector<int> dof_index(matrix->row, -1);
+  const ivector* dofs[2] = {&_first_dofs, &_second_dofs};
+  for (int b = 0; b < 2; b++) {
+    for (int i = 0; i < dofs[b]->row; i++) {
+      dof_block[dofs[b]->val[i]] = b;
+      dof_index[dofs[b]->val[i]] = i;
+    }
+  }
+  for (INT row = 0; row < matrix->row; row++) {
+    if (dof_block[row] < 0) {
+      fasp_chkerr(ERROR_DATA_STRUCTURE, "FASP_Block_Workspace::init_plan");
+    }
+  }
+
+  // count the nonzeros of each block row
+  std::vector<std::vector<int>> row_nnz(4);
+  for (int b = 0; b < 4; b++) {
+    row_nnz[b].assign(dofs[b / 2]->row + 1, 0);
+  }
+  for (INT row = 0; row < matrix->row; row++) {
+    for (INT k = matrix->IA[row]; k < matrix->IA[row + 1]; k++) {
+      const int b = dof_block[row] * 2 + dof_block[matrix->JA[k]];
+      row_nnz[b][dof_index[row] + 1]++;
+    }
+  }
+
+  for (int b = 0; b < 4; b++) {
+    const int rows = dofs[b / 2]->row;
+    const int cols = dofs[b % 2]->row;
+    for (int i = 0; i < rows; i++) {
+      row_nnz[b][i + 1] += row_nnz[b][i];
+    }
+    fasp_dcsr_alloc(rows, cols, row_nnz[b][rows], _matrix.blocks[b]);
+    memcpy(_matrix.blocks[b]->IA, row_nnz[b].data(), (rows + 1) * sizeof(INT));
+  }
+  _blocks_allocated = true;
+
+  // columns keep the order of the matrix rows, as in fasp_dcsr_getblk
+  _plan_block.resize(matrix->nnz);
+  _plan_offset.resize(matrix->nnz);
+  for (INT row = 0; row < matrix->row; row++) {
+    for (INT k = matrix->IA[row]; k < matrix->IA[row + 1]; k++) {
+      const int col = matrix->JA[k];
+      const int b = dof_block[row] * 2 + dof_block[col];
+      const int offset = row_nnz[b][dof_index[row]]++;
+      _matrix.blocks[b]->JA[offset] = dof_index[col];
+      _plan_block[k] = b;
+      _plan_offset[k] = offset;
+    }
+  }
+
+  _plan_rows = matrix->row;
+  _plan_nnz = matrix->nnz;
+}
+//--------------------------------------
+dvector* FASP_Block_Workspace::rhs () {
+  return &_rhs;
+}
+//--------------------------------------
+dvector* FASP_Block_Workspace::solution () {
+  return &_solution;
+}
+//--------------------------------------
+block_dCSRmat* FASP_Block_Workspace::matrix () {
+  return &_matrix;
+}
+//--------------------------------------
+void FASP_Block_Workspace::free_blocks () {
+  if (_blocks_allocated) {
+    for (int i = 0; i < 4; i++) {
+      fasp_dcsr_free(_matrix.blocks[i]);
+    }
+    _blocks_allocated = false;
+  }
+}
+//--------------------------------------
+void FASP_Block_Workspace::free_workspace () {
+  FASP_Block_Workspace::free_blocks();
+  if (_vectors_allocated) {
+    fasp_dvec_free(&_rhs);
+    fasp_dvec_free(&_solution);
+    _vectors_allocated = false;
+  }
+  fasp_ivec_free(&_first_dofs);
+  fasp_ivec_free(&_second_dofs);
+}
+//--------------------------------------
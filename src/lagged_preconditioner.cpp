@@ -0,0 +1,126 @@
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include "lagged_preconditioner.h"
+#include "phase_timer.h"
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+//--------------------------------------
+Lagged_Preconditioner::Lagged_Preconditioner (
+  const std::string name,
+  const double iteration_growth
+) {
+  _name = name;
+  _iteration_growth = iteration_growth;
+}
+//--------------------------------------
+Lagged_Preconditioner::~Lagged_Preconditioner () {
+  if (_initial_guess_allocated) {
+    fasp_dvec_free(&_initial_guess);
+  }
+}
+//--------------------------------------
+
+
+
+
+//--------------------------------------
+INT Lagged_Preconditioner::lagged_solve (
+  const INT rows,
+  const INT nnz,
+  dvector* rhs,
+  dvector* solution,
+  itsolver_param* itsolver,
+  const bool retry
+) {
+  bool layout_changed = rows != _setup_rows || nnz != _setup_nnz;
+  if (_needs_setup || layout_changed) {
+    setup();
+  } else {
+    printf("\treusing %s preconditioner (%lu setups in %lu solves)\n",
+      _name.c_str(), setup_count, solve_count
+    );
+  }
+
+  // kept for a retry, sized once per layout
+  if (retry) {
+    if (_initial_guess_allocated && _initial_guess.row != solution->row) {
+      fasp_dvec_free(&_initial_guess);
+      _initial_guess_allocated = false;
+    }
+    if (!_initial_guess_allocated) {
+      fasp_dvec_alloc(solution->row, &_initial_guess);
+      _initial_guess_allocated = true;
+    }
+    fasp_dvec_cp(solution, &_initial_guess);
+  }
+
+  bool fresh_setup = _setup_iterations < 0;
+  Phase_Timer solve_timer("FASP Krylov solve");
+  INT status = krylov_solve(rhs, solution, itsolver);
+  solve_timer.stop();
+  solve_count++;
+
+  // a stale setup may be the reason the solve failed
+  if (retry && status < 0 && !fresh_setup) {
+    printf("\tKrylov solver failed with reused %s... rebuilding\n", _name.c_str());
+    setup();
+    fasp_dvec_cp(&_initial_guess, solution);
+    Phase_Timer retry_timer("FASP Krylov solve");
+    status = krylov_solve(rhs, solution, itsolver);
+    retry_timer.stop();
+    solve_count++;
+    fresh_setup = true;
+  }
+
+  return Lagged_Preconditioner::finish_solve(status, fresh_setup);
+}
+//--------------------------------------
+INT Lagged_Preconditioner::finish_solve (
+  const INT status,
+  const bool fresh_setup
+) {
+  last_iterations = status;
+  if (status > 0) {
+    Phase_Registry::count("Krylov iterations", status);
+  }
+  if (status < 0) {
+    _needs_setup = true;
+    return status;
+  }
+
+  if (fresh_setup) {
+    _setup_iterations = status > 0 ? status : 1;
+  }
+  else if (status > _iteration_growth * _setup_iterations) {
+    printf("\tKrylov iterations grew from %d to %d... rebuild %s next solve\n",
+      _setup_iterations, status, _name.c_str()
+    );
+    _needs_setup = true;
+  }
+
+  return status;
+}
+//--------------------------------------
+void Lagged_Preconditioner::finish_setup (
+  const INT rows,
+  const INT nnz
+) {
+  _setup_rows = rows;
+  _setup_nnz = nnz;
+  _setup_iterations = -1;
+  _needs_setup = false;
+  setup_count++;
+}
+//--------------------------------------
+bool Lagged_Preconditioner::needs_setup () {
+  return _needs_setup;
+}
+//--------------------------------------
+void Lagged_Preconditioner::reset () {
+  _needs_setup = true;
+}
+//--------------------------------------
@@ -0,0 +1,107 @@
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+#include <dolfin.h>
+#include <ufc.h>
+
+#include "pde.h"
+#include "line_search.h"
+
+using namespace std;
+
+//--------------------------------------
+Line_Search::Line_Search (
+  const std::size_t max_backtracks,
+  const double sufficient_decrease,
+  const double contraction
+) {
+  _max_backtracks = max_backtracks;
+  _sufficient_decrease = sufficient_decrease;
+  _contraction = contraction;
+}
+//--------------------------------------
+Line_Search::~Line_Search () {};
+//--------------------------------------
+
+//--------------------------------------
+void Line_Search::use_trust_region (
+  const double initial_radius,
+  const double min_radius,
+  const double max_radius
+) {
+  trust_region = true;
+  trust_radius = initial_radius;
+  _min_radius = min_radius;
+  _max_radius = max_radius;
+}
+//--------------------------------------
+double Line_Search::search (
+  PDE& problem,
+  const dolfin::Function& previous_solution,
+  const dolfin::Function& computed_solution,
+  const double previous_residual,
+  const double residual_scale
+) {
+  dolfin::Function update(computed_solution.function_space());
+  *(update.vector()) = *(computed_solution.vector());
+  *(update.vector()) -= *(previous_solution.vector());
+  const double update_size = update.vector()->norm("linf");
+
+  step_length = 1.0;
+  if (trust_region && update_size > trust_radius) {
+    step_length = trust_radius / update_size;
+    printf("\tupdate of size %5.3e limited to trust radius %5.3e\n",
+      update_size, trust_radius
+    );
+  }
+
+  dolfin::Function trial_solution(computed_solution.function_space());
+  double residual = previous_residual;
+  backtracks = 0;
+  accepted = false;
+  while (true) {
+    *(trial_solution.vector()) = *(previous_solution.vector());
+    trial_solution.vector()->axpy(step_length, *(update.vector()));
+    problem.set_solution(trial_solution);
+    residual = problem.compute_residual("l2") / residual_scale;
+
+    if (!std::isnan(residual)
+      && residual <= (1.0 - _sufficient_decrease * step_length) * previous_residual
+    ) {
+      accepted = true;
+      break;
+    }
+    if (backtracks == _max_backtracks) {
+      break;
+    }
+
+    printf("\tresidual did not decrease enough : %e -> %e, step length %5.3e\n",
+      previous_residual, residual, step_length
+    );
+    step_length *= _contraction;
+    backtracks++;
+  }
+
+  search_count++;
+  total_backtracks += backtracks;
+  if (!accepted) {
+    printf("\tline search failed after %lu backtracks\n", backtracks);
+  }
+
+  // shrink the region to the accepted step after a poor
+  // step and expand it after a full step with good decrease
+  if (trust_region) {
+    const double step_size = step_length * update_size;
+    if (!accepted || backtracks > 0) {
+      trust_radius = std::max(_min_radius, accepted ? step_size : 0.5 * step_size);
+    }
+    else if (residual < 0.25 * previous_residual && step_size >= 0.9 * trust_radius) {
+      trust_radius = std::min(_max_radius, 2.0 * trust_radius);
+    }
+  }
+
+  return residual;
+}
+//--------------------------------------
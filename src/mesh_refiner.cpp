@@ -1,12 +1,19 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include <string.h>
 #include <dolfin.h>
 #include <ufc.h>
 #include "domain.h"
 #include "dirichlet.h"
 #include "mesh_refiner.h"
+#include "phase_timer.h"
 extern "C" {
   #include "fasp.h"
   #include "fasp_functs.h"
@@ -16,6 +23,65 @@ extern "C" {
 #include "SemiH1error.h"
 #include "poisson_cell_marker.h"
 
+// hash of vertex coordinates, matched exactly across a refinement
+struct Point_Hash {
+  std::size_t operator() (const std::array<double, 3>& point) const {
+    std::hash<double> hash;
+    std::size_t seed = hash(point[0]);
+    seed ^= hash(point[1]) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    seed ^= hash(point[2]) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    return seed;
+  }
+};
+
+// a function on one cell of its mesh, evaluated from its expansion
+// in the element basis at points inside that cell
+class Cell_Expansion : public ufc::function {
+  public:
+    Cell_Expansion (
+      const dolfin::FiniteElement& element
+    ) : _element(element) {
+      _value_size = 1;
+      for (std::size_t r = 0; r < element.value_rank(); r++) {
+        _value_size *= element.value_dimension(r);
+      }
+      _basis_values.resize(element.space_dimension() * _value_size);
+    }
+
+    void set_cell (
+      const double* coefficients,
+      const double* coordinate_dofs,
+      const int cell_orientation
+    ) {
+      _coefficients = coefficients;
+      _coordinate_dofs = coordinate_dofs;
+      _cell_orientation = cell_orientation;
+    }
+
+    void evaluate (
+      double* values,
+      const double* x,
+      const ufc::cell& cell
+    ) const {
+      _element.evaluate_basis_all(_basis_values.data(), x, _coordinate_dofs, _cell_orientation);
+      const std::size_t space_dimension = _element.space_dimension();
+      for (std::size_t v = 0; v < _value_size; v++) {
+        values[v] = 0.0;
+        for (std::size_t i = 0; i < space_dimension; i++) {
+          values[v] += _coefficients[i] * _basis_values[i * _value_size + v];
+        }
+      }
+    }
+
+  private:
+    const dolfin::FiniteElement& _element;
+    std::size_t _value_size;
+    mutable std::vector<double> _basis_values;
+    const double* _coefficients = NULL;
+    const double* _coordinate_dofs = NULL;
+    int _cell_orientation = -1;
+};
+
 //--------------------------------
 Mesh_Refiner::Mesh_Refiner (
   const std::shared_ptr<const dolfin::Mesh> initial_mesh,
@@ -52,7 +118,14 @@ std::shared_ptr<const dolfin::Mesh> Mesh_Refiner::multilevel_refinement (
 ) {
   std::size_t num_cells = _mesh->num_cells();
 
+  // the fields are gathered once on this mesh and then prolonged
+  // through the refinements that follow
+  _fields_uninitialized = true;
+  _refinement_history.clear();
+
   printf("Entering mesh adaptation routine\n");
+  // timed here since recursive_refinement calls itself
+  Phase_Timer refinement_timer("Mesh_Refiner::recursive_refinement");
   auto refined_mesh = Mesh_Refiner::recursive_refinement(
     diffusivity_vector,
     entropy_potential_vector,
@@ -60,6 +133,7 @@ std::shared_ptr<const dolfin::Mesh> Mesh_Refiner::multilevel_refinement (
     Mesh_Refiner::entropy_tolerance_per_cell,
     0
   );
+  refinement_timer.stop();
 
   if (num_cells == refined_mesh->num_cells()) {
     printf("Refinement algorithm propsed no refinement\n");
@@ -102,12 +176,14 @@ std::shared_ptr<const dolfin::Mesh> Mesh_Refiner::recursive_refinement (
   // count cells in resulting mesh
   Mesh_Refiner::needs_to_solve = true;
   auto temp_mesh = std::make_shared<dolfin::Mesh>(*_mesh);
+  Phase_Timer adapt_timer("dolfin::adapt");
   auto adapted_mesh = dolfin::adapt(*temp_mesh, *_cell_marker);
+  adapt_timer.stop();
   std::size_t adapted_mesh_size = adapted_mesh->num_cells();
   bool accept_refinement = adapted_mesh_size < (max_element_iterate + 1);
 
   if (accept_refinement) {
-    _mesh = adapted_mesh;
+    Mesh_Refiner::accept_refinement(adapted_mesh);
     return Mesh_Refiner::recursive_refinement(
       diffusivity_vector,
       entropy_potential_vector,
@@ -120,8 +196,18 @@ std::shared_ptr<const dolfin::Mesh> Mesh_Refiner::recursive_refinement (
   // aim for a twenty percent update in mesh size
   printf("\tmesh refinement is too aggressive... ");
   printf("mark elements to have proportional refinement\n");
-  auto conservative_mesh = std::make_shared<dolfin::Mesh>(*_mesh);
-  std::size_t target_size = max_element_iterate;
+
+  // scale predictions by how far the rejected marking outgrew its own
+  std::vector<bool> rejected_cells(_mesh->num_cells(), false);
+  for (std::size_t index = 0; index < rejected_cells.size(); index++) {
+    rejected_cells[index] = (*_cell_marker)[index];
+  }
+  const double rejected_growth = (double) Mesh_Refiner::predict_refined_size(rejected_cells)
+    - (double) _mesh->num_cells();
+  const double growth_scale = rejected_growth > 0.0
+    ? ((double) adapted_mesh_size - (double) _mesh->num_cells()) / rejected_growth
+    : 1.0;
+  printf("\tpredicted refinement scaled by %e\n", growth_scale); fflush(stdout);
 
   // compute error vector of interpolant
   dolfin::EigenVector entropy_vector = Mesh_Refiner::compute_entropy_error_vector(
@@ -130,46 +216,93 @@ std::shared_ptr<const dolfin::Mesh> Mesh_Refiner::recursive_refinement (
     entropy_log_weight_vector
   );
   printf("\tmaximum entropy value is %e\n", entropy_vector.max()); fflush(stdout);
-  std::vector<double> error_vector;
-  for (std::size_t i = 0; i < entropy_vector.size(); i++) {
-    error_vector.push_back(entropy_vector[i]);
-  }
-  std::sort(error_vector.begin(), error_vector.end());
-  printf("\tsorted entropy values\n"); fflush(stdout);
 
-
-  while (!accept_refinement) {
-    target_size = (std::size_t) std::round(0.95 * ((double) target_size));
-    Mesh_Refiner::mark_for_refinement_with_target_size(entropy_vector, error_vector, target_size);
+  // the prediction makes one adapt enough, the target only
+  // shrinks if the refined mesh still overshoots
+  std::size_t target_size = max_element_iterate;
+  std::shared_ptr<dolfin::Mesh> conservative_mesh;
+  do {
+    Mesh_Refiner::mark_for_refinement_with_target_size(entropy_vector, target_size, growth_scale);
+    if (!Mesh_Refiner::needs_refinement) {
+      Mesh_Refiner::needs_to_solve = depth > 0;
+      return _mesh;
+    }
 
     dolfin::Mesh conservative_temp_mesh(*_mesh);
+    Phase_Timer adapt_timer("dolfin::adapt");
     conservative_mesh = dolfin::adapt(conservative_temp_mesh, *_cell_marker);
-    accept_refinement = accept_refinement ? accept_refinement : conservative_mesh->num_cells() < (max_element_iterate + 1);
-  }
+    adapt_timer.stop();
+    target_size = (std::size_t) std::round(0.95 * ((double) target_size));
+  } while (conservative_mesh->num_cells() > max_element_iterate);
 
-  _mesh.reset(new dolfin::Mesh(*conservative_mesh));
+  Mesh_Refiner::accept_refinement(conservative_mesh);
   return _mesh;
 
 }
 //--------------------------------
 std::size_t Mesh_Refiner::mark_for_refinement_with_target_size (
-  dolfin::EigenVector entropy_vector,
-  std::vector<double> error_vector,
-  std::size_t target_size
+  const dolfin::EigenVector& entropy_vector,
+  const std::size_t target_size,
+  const double growth_scale
 ) {
+  const std::size_t num_cells = _mesh->num_cells();
+  const double* values = entropy_vector.data();
+
+  // only cells above the tolerance per cell are worth refining
+  std::vector<double> candidates;
+  for (std::size_t index = 0; index < num_cells; index++) {
+    if (values[index] > Mesh_Refiner::entropy_tolerance_per_cell) {
+      candidates.push_back(values[index]);
+    }
+  }
 
-  std::size_t permissible_cells = _mesh->num_cells() > target_size ? 1 : target_size - _mesh->num_cells();
-  std::size_t toleranceIndex = permissible_cells > error_vector.size() ? error_vector.size() : error_vector.size() - permissible_cells;
-  printf("\ttolerance index: %lu %lu %lu %lu\n", _mesh->num_cells(), target_size, error_vector.size(), permissible_cells); fflush(stdout);
-  printf("\ttolerance index: %lu\n", toleranceIndex); fflush(stdout);
-  const double entropy_tolerance = std::max(error_vector[toleranceIndex], Mesh_Refiner::entropy_tolerance_per_cell);
+  // the k largest errors by selection, marked with their closure
+  std::vector<double> selection;
+  std::vector<bool> marked_cells(num_cells, false);
+  double entropy_tolerance = Mesh_Refiner::entropy_tolerance_per_cell;
+  auto mark_largest = [&] (const std::size_t k) {
+    entropy_tolerance = Mesh_Refiner::entropy_tolerance_per_cell;
+    if (k > 0) {
+      selection = candidates;
+      std::nth_element(
+        selection.begin(),
+        selection.begin() + (k - 1),
+        selection.end(),
+        std::greater<double>()
+      );
+      entropy_tolerance = selection[k - 1];
+    }
+    for (std::size_t index = 0; index < num_cells; index++) {
+      marked_cells[index] = k > 0 && values[index] >= entropy_tolerance;
+    }
+    const double growth = (double) Mesh_Refiner::predict_refined_size(marked_cells) - (double) num_cells;
+    return (double) num_cells + growth_scale * growth < (double) target_size + 1.0;
+  };
+
+  // bisect on the number of marked cells, the predicted size
+  // grows with it
+  std::size_t fits = 0;
+  std::size_t overshoots = candidates.size();
+  if (mark_largest(overshoots)) {
+    fits = overshoots;
+  }
+  while (overshoots > fits + 1) {
+    const std::size_t k = (fits + overshoots) / 2;
+    if (mark_largest(k)) {
+      fits = k;
+    }
+    else {
+      overshoots = k;
+    }
+  }
+  mark_largest(fits);
   printf("\tentropy tolerance: %e\n", entropy_tolerance); fflush(stdout);
 
   // mark cells according to entropic error
   std::size_t marked_count = 0;
   _cell_marker.reset( new dolfin::MeshFunction<bool>(_mesh, _mesh->topology().dim(), false) );
-  for (std::size_t index = 0; index < entropy_vector.size(); index++) {
-    if (entropy_vector[index] > entropy_tolerance) {
+  for (std::size_t index = 0; index < num_cells; index++) {
+    if (marked_cells[index]) {
       _cell_marker->set_value(index, true);
       marked_count++;
     }
@@ -180,6 +313,82 @@ std::size_t Mesh_Refiner::mark_for_refinement_with_target_size (
   return marked_count;
 };
 //--------------------------------
+std::size_t Mesh_Refiner::predict_refined_size (
+  const std::vector<bool>& marked_cells
+) {
+  if (_edges_uninitialized || _edges_mesh_id != _mesh->id()) {
+    Mesh_Refiner::init_edges();
+  }
+  const std::size_t tdim = _mesh->topology().dim();
+  const dolfin::MeshConnectivity& cell_edges = _mesh->topology()(tdim, 1);
+  const dolfin::MeshConnectivity& edge_faces = _mesh->topology()(1, 2);
+
+  // edges of marked cells, closed over the longest edge of
+  // every face with a marked edge
+  std::vector<bool> marked_edges(_mesh->num_edges(), false);
+  std::vector<std::size_t> new_edges;
+  for (std::size_t cell = 0; cell < marked_cells.size(); cell++) {
+    if (!marked_cells[cell]) {
+      continue;
+    }
+    const unsigned int* edges = cell_edges(cell);
+    for (std::size_t e = 0; e < cell_edges.size(cell); e++) {
+      if (!marked_edges[edges[e]]) {
+        marked_edges[edges[e]] = true;
+        new_edges.push_back(edges[e]);
+      }
+    }
+  }
+  while (!new_edges.empty()) {
+    const std::size_t edge = new_edges.back();
+    new_edges.pop_back();
+    const unsigned int* faces = edge_faces(edge);
+    for (std::size_t f = 0; f < edge_faces.size(edge); f++) {
+      const std::size_t longest = _face_longest_edge[faces[f]];
+      if (!marked_edges[longest]) {
+        marked_edges[longest] = true;
+        new_edges.push_back(longest);
+      }
+    }
+  }
+
+  // a simplex with m bisected edges splits into about m + 1
+  // children, a tetrahedron with all edges into 8
+  std::size_t refined_size = 0;
+  for (std::size_t cell = 0; cell < marked_cells.size(); cell++) {
+    const unsigned int* edges = cell_edges(cell);
+    std::size_t marked = 0;
+    for (std::size_t e = 0; e < cell_edges.size(cell); e++) {
+      marked += marked_edges[edges[e]] ? 1 : 0;
+    }
+    refined_size += (tdim == 3 && marked == 6) ? 8 : marked + 1;
+  }
+
+  return refined_size;
+}
+//--------------------------------
+void Mesh_Refiner::init_edges () {
+  const std::size_t tdim = _mesh->topology().dim();
+  _mesh->init(1);
+  _mesh->init(tdim, 1);
+  _mesh->init(1, 2);
+  _mesh->init(2, 1);
+
+  _face_longest_edge.resize(_mesh->num_entities(2));
+  for (dolfin::MeshEntityIterator face(*_mesh, 2); !face.end(); ++face) {
+    double longest_length = -1.0;
+    for (dolfin::EdgeIterator edge(*face); !edge.end(); ++edge) {
+      if (edge->length() > longest_length) {
+        longest_length = edge->length();
+        _face_longest_edge[face->index()] = edge->index();
+      }
+    }
+  }
+
+  _edges_mesh_id = _mesh->id();
+  _edges_uninitialized = false;
+}
+//--------------------------------
 std::size_t Mesh_Refiner::mark_for_refinement (
   std::vector<std::shared_ptr<const dolfin::Function>> diffusivity_vector,
   std::vector<std::shared_ptr<const dolfin::Function>> entropy_potential_vector,
@@ -214,65 +423,497 @@ dolfin::EigenVector Mesh_Refiner::compute_entropy_error_vector (
   std::vector<std::shared_ptr<const dolfin::Function>> entropy_potential_vector,
   std::vector<std::shared_ptr<const dolfin::Function>> entropy_log_weight_vector
 ) {
-  // setup forms for cell marker
-  auto DG = std::make_shared<poisson_cell_marker::FunctionSpace>(_mesh);
-  poisson_cell_marker::BilinearForm entropy_bilinear_form(DG, DG);
-  poisson_cell_marker::LinearForm entropy_linear_form(DG);
-
-  auto mass_matrix = std::make_shared<dolfin::EigenMatrix>();
-  auto entropy_vector = std::make_shared<dolfin::EigenVector>();
-  dolfin::assemble(*mass_matrix, entropy_bilinear_form);
-
-  // loop over subfunctions of entropy potential
-  std::size_t component_count = entropy_potential_vector.size();
-  dolfin::File entropy_error_file("./entropy.pvd");
-
-  for (std::size_t comp = 0; comp < component_count; comp++) {
-    auto potential_interpolant = std::make_shared<dolfin::Function>(
-      dolfin::adapt(*(entropy_potential_vector[comp]->function_space()), _mesh)
+  if (_geometry_uninitialized || _geometry_mesh_id != _mesh->id()) {
+    Mesh_Refiner::init_cell_geometry();
+  }
+  if (_fields_uninitialized || _fields_mesh_id != _mesh->id()) {
+    Mesh_Refiner::init_vertex_fields(
+      diffusivity_vector,
+      entropy_potential_vector,
+      entropy_log_weight_vector
     );
-    potential_interpolant->interpolate( *(entropy_potential_vector[comp]) );
-    entropy_linear_form.entropy_potential = potential_interpolant;
+  }
+  const std::size_t num_cells = _mesh->num_cells();
+  const std::size_t num_vertices = _mesh->num_vertices();
+  const std::size_t species = _field_species;
 
-    auto log_weight_interpolant = std::make_shared<dolfin::Function>(
-      dolfin::adapt(*(entropy_log_weight_vector[comp]->function_space()), _mesh)
+  std::vector<double> weight(species * num_vertices);
+  for (std::size_t i = 0; i < weight.size(); i++) {
+    weight[i] = std::exp(_vertex_log_weight[i]);
+  }
+  const double* potential = _vertex_potential.data();
+  const double* diffusivity = _vertex_diffusivity.data();
+
+  // all species in one pass over contiguous chunks of cells
+  std::vector<double> component_entropy(species * num_cells);
+  Phase_Timer kernel_timer("Mesh_Refiner::entropy_kernel");
+  const std::size_t available_threads = max_threads > 0 ?
+    max_threads : std::thread::hardware_concurrency();
+  const std::size_t num_threads = std::max<std::size_t>(1, std::min<std::size_t>(
+    available_threads, num_cells / 4096
+  ));
+  const std::size_t chunk = (num_cells + num_threads - 1) / num_threads;
+  std::vector<std::thread> threads;
+  for (std::size_t thread = 1; thread < num_threads; thread++) {
+    threads.emplace_back(
+      &Mesh_Refiner::entropy_kernel, this,
+      std::min(thread * chunk, num_cells), std::min((thread + 1) * chunk, num_cells),
+      species, potential, weight.data(), diffusivity, component_entropy.data()
     );
-    log_weight_interpolant->interpolate( *(entropy_log_weight_vector[comp]) );
-    entropy_linear_form.log_weight = log_weight_interpolant;
+  }
+  Mesh_Refiner::entropy_kernel(
+    0, std::min(chunk, num_cells),
+    species, potential, weight.data(), diffusivity, component_entropy.data()
+  );
+  for (std::size_t i = 0; i < threads.size(); i++) {
+    threads[i].join();
+  }
+  kernel_timer.stop();
+
+  // entropy error of each cell, summed over species
+  std::vector<double> entropy(num_cells, 0.0);
+  for (std::size_t comp = 0; comp < species; comp++) {
+    const double* values = component_entropy.data() + comp * num_cells;
+    for (std::size_t cell = 0; cell < num_cells; cell++) {
+      entropy[cell] += values[cell];
+    }
+
+    if (Mesh_Refiner::write_entropy) {
+      Phase_Timer output_timer("file output");
+      dolfin::Function component_function(_marker_space);
+      double* function_values = dolfin::as_type<dolfin::EigenVector>(*(component_function.vector())).data();
+      for (std::size_t cell = 0; cell < num_cells; cell++) {
+        function_values[_marker_dofs[cell]] = values[cell];
+      }
+      if (!_entropy_file) {
+        _entropy_file.reset(new dolfin::File("./entropy.pvd"));
+      }
+      *_entropy_file << component_function;
+      output_timer.stop();
+    }
+  }
+
+  // indexed by cell, as the markers are
+  dolfin::EigenVector entropy_vector(_mesh->mpi_comm(), num_cells);
+  entropy_vector.set_local(entropy);
+  return entropy_vector;
+};
+//--------------------------------
+void Mesh_Refiner::entropy_kernel (
+  const std::size_t begin,
+  const std::size_t end,
+  const std::size_t species,
+  const double* potential,
+  const double* weight,
+  const double* diffusivity,
+  double* component_entropy
+) const {
+  const std::size_t n = _mesh->num_cells();
+  const std::size_t num_vertices = _mesh->num_vertices();
+  const unsigned int* v0 = _cell_vertices.data();
+  const unsigned int* v1 = v0 + n;
+  const unsigned int* v2 = v1 + n;
+  const unsigned int* v3 = v2 + n;
+  const double* G = _cell_gradients.data();
+
+  for (std::size_t comp = 0; comp < species; comp++) {
+    const double* phi = potential + comp * num_vertices;
+    const double* e = weight + comp * num_vertices;
+    const double* D = diffusivity + comp * num_vertices;
+    double* entropy = component_entropy + comp * n;
+
+    // diffusivity * exp(log_weight) * |grad(phi)|^2 averaged over
+    // the cell, with exp(log_weight) interpolated by P1 so that
+    // integral(D e) = volume / 20 * (sum(D) sum(e) + sum(D e))
+    for (std::size_t c = begin; c < end; c++) {
+      const double phi0 = phi[v0[c]], phi1 = phi[v1[c]], phi2 = phi[v2[c]], phi3 = phi[v3[c]];
+      const double grad_x = phi0 * G[0 * n + c] + phi1 * G[3 * n + c] + phi2 * G[6 * n + c] + phi3 * G[9 * n + c];
+      const double grad_y = phi0 * G[1 * n + c] + phi1 * G[4 * n + c] + phi2 * G[7 * n + c] + phi3 * G[10 * n + c];
+      const double grad_z = phi0 * G[2 * n + c] + phi1 * G[5 * n + c] + phi2 * G[8 * n + c] + phi3 * G[11 * n + c];
+
+      const double e0 = e[v0[c]], e1 = e[v1[c]], e2 = e[v2[c]], e3 = e[v3[c]];
+      const double D0 = D[v0[c]], D1 = D[v1[c]], D2 = D[v2[c]], D3 = D[v3[c]];
+      const double weighted_diffusivity = (
+        (D0 + D1 + D2 + D3) * (e0 + e1 + e2 + e3)
+        + D0 * e0 + D1 * e1 + D2 * e2 + D3 * e3
+      ) / 20.0;
+
+      entropy[c] = weighted_diffusivity * (grad_x * grad_x + grad_y * grad_y + grad_z * grad_z);
+    }
+  }
+}
+//--------------------------------
+void Mesh_Refiner::init_cell_geometry () {
+  if (_mesh->topology().dim() != 3) {
+    fasp_chkerr(ERROR_INPUT_PAR, "Mesh_Refiner::init_cell_geometry");
+  }
+  _marker_space = std::make_shared<poisson_cell_marker::FunctionSpace>(_mesh);
+  std::shared_ptr<const dolfin::GenericDofMap> dofmap = _marker_space->dofmap();
+
+  const std::size_t n = _mesh->num_cells();
+  _marker_dofs.resize(n);
+  _cell_vertices.resize(4 * n);
+  _cell_gradients.resize(12 * n);
+
+  double J[9];
+  for (dolfin::CellIterator cell(*_mesh); !cell.end(); ++cell) {
+    const std::size_t c = cell->index();
+    const unsigned int* vertices = cell->entities(0);
+    const double* x[4];
+    for (std::size_t a = 0; a < 4; a++) {
+      _cell_vertices[a * n + c] = vertices[a];
+      x[a] = _mesh->geometry().x(vertices[a]);
+    }
+
+    // gradients of the barycentric coordinates from the inverse
+    // Jacobian of the map from the reference tetrahedron
+    for (std::size_t i = 0; i < 3; i++) {
+      for (std::size_t k = 0; k < 3; k++) {
+        J[i * 3 + k] = x[k + 1][i] - x[0][i];
+      }
+    }
+    const double det = J[0] * (J[4] * J[8] - J[5] * J[7])
+      - J[1] * (J[3] * J[8] - J[5] * J[6])
+      + J[2] * (J[3] * J[7] - J[4] * J[6]);
+    const double K[9] = {
+      (J[4] * J[8] - J[5] * J[7]) / det,
+      (J[2] * J[7] - J[1] * J[8]) / det,
+      (J[1] * J[5] - J[2] * J[4]) / det,
+      (J[5] * J[6] - J[3] * J[8]) / det,
+      (J[0] * J[8] - J[2] * J[6]) / det,
+      (J[2] * J[3] - J[0] * J[5]) / det,
+      (J[3] * J[7] - J[4] * J[6]) / det,
+      (J[1] * J[6] - J[0] * J[7]) / det,
+      (J[0] * J[4] - J[1] * J[3]) / det
+    };
+    for (std::size_t d = 0; d < 3; d++) {
+      double sum = 0.0;
+      for (std::size_t a = 1; a < 4; a++) {
+        _cell_gradients[(a * 3 + d) * n + c] = K[(a - 1) * 3 + d];
+        sum += K[(a - 1) * 3 + d];
+      }
+      _cell_gradients[d * n + c] = -sum;
+    }
+
+    _marker_dofs[c] = dofmap->cell_dofs(c)[0];
+  }
 
-    auto diffusivity_interpolant = std::make_shared<dolfin::Function>(
-      dolfin::adapt(*(diffusivity_vector[comp]->function_space()), _mesh)
+  _geometry_mesh_id = _mesh->id();
+  _geometry_uninitialized = false;
+}
+//--------------------------------
+void Mesh_Refiner::init_vertex_fields (
+  std::vector<std::shared_ptr<const dolfin::Function>> diffusivity_vector,
+  std::vector<std::shared_ptr<const dolfin::Function>> entropy_potential_vector,
+  std::vector<std::shared_ptr<const dolfin::Function>> entropy_log_weight_vector
+) {
+  const std::size_t num_vertices = _mesh->num_vertices();
+  _field_species = entropy_potential_vector.size();
+  _vertex_potential.resize(_field_species * num_vertices);
+  _vertex_log_weight.resize(_field_species * num_vertices);
+  _vertex_diffusivity.resize(_field_species * num_vertices);
+
+  for (std::size_t comp = 0; comp < _field_species; comp++) {
+    Mesh_Refiner::gather_vertex_values(
+      *(entropy_potential_vector[comp]),
+      _vertex_potential.data() + comp * num_vertices
     );
-    diffusivity_interpolant->interpolate( *(diffusivity_vector[comp]) );
-    entropy_linear_form.diffusivity = diffusivity_interpolant;
+    Mesh_Refiner::gather_vertex_values(
+      *(entropy_log_weight_vector[comp]),
+      _vertex_log_weight.data() + comp * num_vertices
+    );
+    Mesh_Refiner::gather_vertex_values(
+      *(diffusivity_vector[comp]),
+      _vertex_diffusivity.data() + comp * num_vertices
+    );
+  }
 
-    auto zeros_ptr = std::make_shared<dolfin::Constant>(0.0, 0.0, 0.0);
-    entropy_linear_form.entropy = zeros_ptr;
+  _fields_mesh_id = _mesh->id();
+  _fields_uninitialized = false;
+}
+//--------------------------------
+void Mesh_Refiner::gather_vertex_values (
+  const dolfin::Function& function,
+  double* values
+) {
+  std::vector<double> vertex_values;
+  if (function.function_space()->mesh()->id() == _mesh->id()) {
+    function.compute_vertex_values(vertex_values, *_mesh);
+  }
+  else {
+    // a mesh outside the refinement history needs point location
+    dolfin::Function interpolant(dolfin::adapt(*(function.function_space()), _mesh));
+    interpolant.interpolate(function);
+    interpolant.compute_vertex_values(vertex_values, *_mesh);
+  }
+  std::copy(vertex_values.begin(), vertex_values.end(), values);
+}
+//--------------------------------
+void Mesh_Refiner::accept_refinement (
+  std::shared_ptr<const dolfin::Mesh> refined_mesh
+) {
+  const bool nested = Mesh_Refiner::record_refinement(*_mesh, *refined_mesh);
+
+  // P1 fields are prolonged exactly by averaging over parent edges
+  if (nested && !_fields_uninitialized && _fields_mesh_id == _mesh->id()) {
+    const Refinement_Level& level = _refinement_history.back();
+    Mesh_Refiner::prolong_vertex_values(level, _field_species, _vertex_potential);
+    Mesh_Refiner::prolong_vertex_values(level, _field_species, _vertex_log_weight);
+    Mesh_Refiner::prolong_vertex_values(level, _field_species, _vertex_diffusivity);
+    _fields_mesh_id = refined_mesh->id();
+  }
 
-    auto component_entropy_vector = std::make_shared<dolfin::EigenVector>();
-    dolfin::assemble(*component_entropy_vector, entropy_linear_form);
+  _mesh = refined_mesh;
+}
+//--------------------------------
+bool Mesh_Refiner::record_refinement (
+  const dolfin::Mesh& parent_mesh,
+  const dolfin::Mesh& child_mesh
+) {
+  Phase_Timer timer("Mesh_Refiner::record_refinement");
 
-    auto component_entropy = std::make_shared<dolfin::Function>(DG);
-    Mesh_Refiner::mass_lumping_solver(mass_matrix, component_entropy_vector, component_entropy);
-    entropy_error_file << *component_entropy;
+  // levels chain from the mesh the history started on
+  if (!_refinement_history.empty() && _refinement_history.back().child_mesh_id != parent_mesh.id()) {
+    _refinement_history.clear();
+  }
 
-    if (entropy_vector->empty()) {
-      entropy_vector->init(
-        component_entropy_vector->mpi_comm(),
-        component_entropy_vector->size()
-      );
-      entropy_vector->zero();
+  Refinement_Level level;
+  level.parent_mesh_id = parent_mesh.id();
+  level.child_mesh_id = child_mesh.id();
+  level.parent_vertices = parent_mesh.num_vertices();
+  level.parent_cells = parent_mesh.num_cells();
+
+  // the refinement keeps the parent vertices and adds edge midpoints,
+  // both found by their exact coordinates
+  const std::size_t gdim = parent_mesh.geometry().dim();
+  parent_mesh.init(1);
+  std::unordered_map<std::array<double, 3>, std::pair<std::size_t, std::size_t>, Point_Hash> parents;
+  parents.reserve(parent_mesh.num_vertices() + parent_mesh.num_edges());
+  for (dolfin::VertexIterator vertex(parent_mesh); !vertex.end(); ++vertex) {
+    std::array<double, 3> point = {0.0, 0.0, 0.0};
+    for (std::size_t d = 0; d < gdim; d++) {
+      point[d] = vertex->x(d);
     }
+    parents[point] = std::make_pair(vertex->index(), vertex->index());
+  }
+  for (dolfin::EdgeIterator edge(parent_mesh); !edge.end(); ++edge) {
+    const unsigned int* vertices = edge->entities(0);
+    std::array<double, 3> point = {0.0, 0.0, 0.0};
+    for (std::size_t d = 0; d < gdim; d++) {
+      point[d] = (parent_mesh.geometry().x(vertices[0])[d] + parent_mesh.geometry().x(vertices[1])[d]) / 2.0;
+    }
+    parents[point] = std::make_pair(vertices[0], vertices[1]);
+  }
 
-    *(entropy_vector) += *(component_entropy->vector());
+  level.vertex_parents.resize(2 * child_mesh.num_vertices());
+  for (dolfin::VertexIterator vertex(child_mesh); !vertex.end(); ++vertex) {
+    std::array<double, 3> point = {0.0, 0.0, 0.0};
+    for (std::size_t d = 0; d < gdim; d++) {
+      point[d] = vertex->x(d);
+    }
+    auto found = parents.find(point);
+    if (found == parents.end()) {
+      printf("\trefined mesh is not nested... transfers fall back to interpolation\n");
+      _refinement_history.clear();
+      return false;
+    }
+    level.vertex_parents[2 * vertex->index()] = found->second.first;
+    level.vertex_parents[2 * vertex->index() + 1] = found->second.second;
   }
 
-  return *entropy_vector;
-};
+  // the parent cell of a child is the one holding all the parent
+  // vertices of its vertices, which span it
+  const std::size_t tdim = parent_mesh.topology().dim();
+  parent_mesh.init(0, tdim);
+  const dolfin::MeshConnectivity& vertex_cells = parent_mesh.topology()(0, tdim);
+  const dolfin::MeshConnectivity& parent_cell_vertices = parent_mesh.topology()(tdim, 0);
+  level.cell_parents.resize(child_mesh.num_cells());
+  std::vector<std::size_t> ancestors;
+  for (dolfin::CellIterator cell(child_mesh); !cell.end(); ++cell) {
+    ancestors.clear();
+    const unsigned int* vertices = cell->entities(0);
+    for (std::size_t a = 0; a < cell->num_entities(0); a++) {
+      ancestors.push_back(level.vertex_parents[2 * vertices[a]]);
+      ancestors.push_back(level.vertex_parents[2 * vertices[a] + 1]);
+    }
+
+    bool found_parent = false;
+    const unsigned int* candidates = vertex_cells(ancestors[0]);
+    for (std::size_t k = 0; k < vertex_cells.size(ancestors[0]); k++) {
+      const unsigned int* candidate_vertices = parent_cell_vertices(candidates[k]);
+      const std::size_t num_candidate_vertices = parent_cell_vertices.size(candidates[k]);
+      bool contains = true;
+      for (std::size_t i = 0; i < ancestors.size() && contains; i++) {
+        contains = std::find(
+          candidate_vertices,
+          candidate_vertices + num_candidate_vertices,
+          ancestors[i]
+        ) != candidate_vertices + num_candidate_vertices;
+      }
+      if (contains) {
+        level.cell_parents[cell->index()] = candidates[k];
+        found_parent = true;
+        break;
+      }
+    }
+
+    // a child spanning several parents is no nested refinement
+    if (!found_parent) {
+      printf("\trefined cell has no parent cell... transfers fall back to interpolation\n");
+      _refinement_history.clear();
+      return false;
+    }
+  }
+
+  _refinement_history.push_back(level);
+  return true;
+}
+//--------------------------------
+void Mesh_Refiner::prolong_vertex_values (
+  const Refinement_Level& level,
+  const std::size_t components,
+  std::vector<double>& values
+) {
+  const std::size_t parent_size = level.parent_vertices;
+  const std::size_t child_size = level.vertex_parents.size() / 2;
+  const std::size_t* vertex_parents = level.vertex_parents.data();
+
+  std::vector<double> child_values(components * child_size);
+  for (std::size_t comp = 0; comp < components; comp++) {
+    const double* parent = values.data() + comp * parent_size;
+    double* child = child_values.data() + comp * child_size;
+    for (std::size_t vertex = 0; vertex < child_size; vertex++) {
+      child[vertex] = 0.5 * (parent[vertex_parents[2 * vertex]] + parent[vertex_parents[2 * vertex + 1]]);
+    }
+  }
+
+  values.swap(child_values);
+}
+//--------------------------------
+std::shared_ptr<dolfin::Function> Mesh_Refiner::prolong (
+  const dolfin::Function& function
+) {
+  Phase_Timer timer("Mesh_Refiner::prolong");
+  std::shared_ptr<const dolfin::FunctionSpace> source_space = function.function_space();
+  const dolfin::Mesh& source_mesh = *(source_space->mesh());
+  if (source_mesh.id() == _mesh->id()) {
+    return std::make_shared<dolfin::Function>(function);
+  }
+
+  // the levels leading from the mesh of the function to this one
+  std::size_t first_level = _refinement_history.size();
+  for (std::size_t l = 0; l < _refinement_history.size(); l++) {
+    if (_refinement_history[l].parent_mesh_id == source_mesh.id()) {
+      first_level = l;
+      break;
+    }
+  }
+  if (first_level == _refinement_history.size() || _refinement_history.back().child_mesh_id != _mesh->id()) {
+    printf("\tfunction is outside the refinement history... interpolating\n");
+    return dolfin::adapt(function, _mesh);
+  }
+
+  auto target = std::make_shared<dolfin::Function>(dolfin::adapt(*source_space, _mesh));
+  std::shared_ptr<const dolfin::FunctionSpace> target_space = target->function_space();
+  std::shared_ptr<const dolfin::GenericDofMap> source_dofmap = source_space->dofmap();
+  std::shared_ptr<const dolfin::GenericDofMap> target_dofmap = target_space->dofmap();
+  std::vector<double> source_values;
+  function.vector()->get_local(source_values);
+  std::vector<double> target_values(target->vector()->local_size(), 0.0);
+
+  const std::size_t tdim = _mesh->topology().dim();
+  bool vertex_dofs_only = source_dofmap->num_entity_dofs(0) > 0;
+  for (std::size_t d = 1; d <= tdim; d++) {
+    vertex_dofs_only = vertex_dofs_only && source_dofmap->num_entity_dofs(d) == 0;
+  }
+
+  if (vertex_dofs_only) {
+    // vertex values of all components, vertex after vertex, averaged
+    // over the parent edge of each new vertex level by level
+    const std::size_t block = source_dofmap->num_entity_dofs(0);
+    std::vector<dolfin::la_index> source_vertex_dofs = dolfin::vertex_to_dof_map(*source_space);
+    std::vector<double> vertex_values(source_vertex_dofs.size());
+    for (std::size_t i = 0; i < vertex_values.size(); i++) {
+      vertex_values[i] = source_values[source_vertex_dofs[i]];
+    }
+
+    std::vector<double> child_values;
+    for (std::size_t l = first_level; l < _refinement_history.size(); l++) {
+      const std::size_t* vertex_parents = _refinement_history[l].vertex_parents.data();
+      const std::size_t child_size = _refinement_history[l].vertex_parents.size() / 2;
+      child_values.resize(child_size * block);
+      for (std::size_t vertex = 0; vertex < child_size; vertex++) {
+        const double* first = vertex_values.data() + vertex_parents[2 * vertex] * block;
+        const double* second = vertex_values.data() + vertex_parents[2 * vertex + 1] * block;
+        for (std::size_t c = 0; c < block; c++) {
+          child_values[vertex * block + c] = 0.5 * (first[c] + second[c]);
+        }
+      }
+      vertex_values.swap(child_values);
+    }
+
+    std::vector<dolfin::la_index> target_vertex_dofs = dolfin::vertex_to_dof_map(*target_space);
+    for (std::size_t i = 0; i < target_vertex_dofs.size(); i++) {
+      target_values[target_vertex_dofs[i]] = vertex_values[i];
+    }
+  }
+  else {
+    // the cell of the source mesh holding each cell
+    std::vector<std::size_t> ancestors = _refinement_history[first_level].cell_parents;
+    for (std::size_t l = first_level + 1; l < _refinement_history.size(); l++) {
+      const std::vector<std::size_t>& cell_parents = _refinement_history[l].cell_parents;
+      std::vector<std::size_t> child_ancestors(cell_parents.size());
+      for (std::size_t cell = 0; cell < cell_parents.size(); cell++) {
+        child_ancestors[cell] = ancestors[cell_parents[cell]];
+      }
+      ancestors.swap(child_ancestors);
+    }
+
+    // the parent field lies in the element space of each child, as
+    // for RT and DG0, so interpolating it cell by cell is exact
+    const dolfin::FiniteElement& source_element = *(source_space->element());
+    const dolfin::FiniteElement& target_element = *(target_space->element());
+    Cell_Expansion expansion(source_element);
+    std::vector<double> coefficients(source_element.space_dimension());
+    std::vector<double> dof_values(target_element.space_dimension());
+    std::vector<double> source_coordinates, target_coordinates;
+    ufc::cell source_ufc_cell, target_ufc_cell;
+    for (dolfin::CellIterator cell(*_mesh); !cell.end(); ++cell) {
+      const dolfin::Cell parent(source_mesh, ancestors[cell->index()]);
+      parent.get_coordinate_dofs(source_coordinates);
+      parent.get_cell_data(source_ufc_cell);
+      dolfin::ArrayView<const dolfin::la_index> parent_dofs = source_dofmap->cell_dofs(parent.index());
+      for (std::size_t i = 0; i < coefficients.size(); i++) {
+        coefficients[i] = source_values[parent_dofs[i]];
+      }
+      expansion.set_cell(coefficients.data(), source_coordinates.data(), source_ufc_cell.orientation);
+
+      cell->get_coordinate_dofs(target_coordinates);
+      cell->get_cell_data(target_ufc_cell);
+      target_element.evaluate_dofs(
+        dof_values.data(),
+        expansion,
+        target_coordinates.data(),
+        target_ufc_cell.orientation,
+        target_ufc_cell
+      );
+      dolfin::ArrayView<const dolfin::la_index> dofs = target_dofmap->cell_dofs(cell->index());
+      for (std::size_t i = 0; i < dof_values.size(); i++) {
+        target_values[dofs[i]] = dof_values[i];
+      }
+    }
+  }
+
+  target->vector()->set_local(target_values);
+  target->vector()->apply("insert");
+  return target;
+}
 //--------------------------------
 std::shared_ptr<const dolfin::Mesh> Mesh_Refiner::refine_mesh () {
+  Phase_Timer adapt_timer("dolfin::adapt");
   auto refined_mesh = dolfin::adapt(*_mesh, *_cell_marker);
-  _mesh = refined_mesh;
+  adapt_timer.stop();
+  Mesh_Refiner::accept_refinement(refined_mesh);
 
   _l2_form.reset(new L2Error::Functional(_mesh));
   _semi_h1_form.reset(new SemiH1error::Functional(_mesh));
@@ -283,8 +924,10 @@ std::shared_ptr<const dolfin::Mesh> Mesh_Refiner::refine_mesh () {
 };
 //--------------------------------
 std::shared_ptr<const dolfin::Mesh> Mesh_Refiner::refine_uniformly () {
+  Phase_Timer adapt_timer("dolfin::adapt");
   auto refined_mesh = dolfin::adapt(*_mesh);
-  _mesh = refined_mesh;
+  adapt_timer.stop();
+  Mesh_Refiner::accept_refinement(refined_mesh);
 
   _l2_form.reset(new L2Error::Functional(_mesh));
   _semi_h1_form.reset(new SemiH1error::Functional(_mesh));
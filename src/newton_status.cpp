@@ -1,6 +1,8 @@
 #include <iostream>
 #include <fstream>
 #include <string.h>
+#include <cmath>
+#include <algorithm>
 #include <dolfin.h>
 #include <ufc.h>
 
@@ -23,6 +25,8 @@ Newton_Status::Newton_Status (
   iteration = 1;
   relative_residual = 1.0;
   max_residual = max_residual_tol + 1;
+
+  residual_history.push_back(initial_residual);
 }
 //--------------------------------------
 Newton_Status::~Newton_Status () {};
@@ -52,6 +56,11 @@ void Newton_Status::update_rel_residual (
 ) {
   residual = residual_in;
   relative_residual = residual / initial_residual;
+
+  residual_history.push_back(residual);
+  if (inexact_newton) {
+    Newton_Status::update_forcing_term();
+  }
 }
 //--------------------------------------
 bool Newton_Status::needs_to_iterate () {
@@ -99,6 +108,72 @@ void Newton_Status::print_status () {
   }
 }
 //--------------------------------------
+void Newton_Status::use_inexact_newton (
+  const double initial_forcing_in,
+  const double min_forcing_in,
+  const double max_forcing_in
+) {
+  inexact_newton = true;
+  forcing_term = initial_forcing_in;
+  min_forcing = min_forcing_in;
+  max_forcing = max_forcing_in;
+}
+//--------------------------------------
+void Newton_Status::reset_residual_history (
+  const double residual_in
+) {
+  residual_history.clear();
+  residual_history.push_back(residual_in);
+}
+//--------------------------------------
+double Newton_Status::linear_tolerance (
+  const double fixed_tolerance
+) {
+  return inexact_newton ? forcing_term : fixed_tolerance;
+}
+//--------------------------------------
+void Newton_Status::update_forcing_term () {
+  std::size_t history = residual_history.size();
+  if (history < 2 || residual_history[history - 2] <= 0.0) {
+    return;
+  }
+
+  const double gamma = 0.9;
+  const double alpha = 2.0;
+  double ratio = residual_history[history - 1] / residual_history[history - 2];
+  double previous_forcing = forcing_term;
+  forcing_term = gamma * std::pow(ratio, alpha);
+
+  // do not let the forcing term drop too fast
+  double safeguard = gamma * std::pow(previous_forcing, alpha);
+  if (safeguard > 0.1) {
+    forcing_term = std::max(forcing_term, safeguard);
+  }
+
+  // do not solve past the nonlinear tolerance
+  if (relative_residual > 0.0) {
+    forcing_term = std::max(forcing_term, 0.5 * rel_residual_tol / relative_residual);
+  }
+
+  forcing_term = std::min(std::max(forcing_term, min_forcing), max_forcing);
+}
+//--------------------------------------
+void Newton_Status::update_krylov_iterations (
+  const int krylov_iterations_in
+) {
+  krylov_iterations.push_back(krylov_iterations_in);
+}
+//--------------------------------------
+void Newton_Status::print_krylov_iterations () {
+  int total_iterations = 0;
+  printf("Krylov iterations per Newton step:\n");
+  for (std::size_t i = 0; i < krylov_iterations.size(); i++) {
+    printf("\tNewton step %lu : %d\n", i + 1, krylov_iterations[i]);
+    total_iterations += krylov_iterations[i] > 0 ? krylov_iterations[i] : 0;
+  }
+  printf("\ttotal : %d\n", total_iterations);
+}
+//--------------------------------------
 // void update_solution ();
 // void update_residual_vector ();
 // dolfin::Function damp_update ();
@@ -1,11 +1,14 @@
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 #include <string.h>
 #include <dolfin.h>
 #include <ufc.h>
 #include "pde.h"
 #include "domain.h"
 #include "dirichlet.h"
+#include "threaded_assembler.h"
+#include "phase_timer.h"
 extern "C" {
   #include "fasp.h"
   #include "fasp_functs.h"
@@ -22,6 +25,7 @@ PDE::PDE (
   const std::string variable
 ) {
   PDE::update_mesh(mesh);
+  _threaded_assembler.reset(new Threaded_Assembler(0));
   _function_space = function_space;
   _bilinear_form = bilinear_form;
   _linear_form = linear_form;
@@ -43,6 +47,7 @@ PDE::PDE (
   const std::vector<std::string> variables
 ) {
   PDE::update_mesh(mesh);
+  _threaded_assembler.reset(new Threaded_Assembler(0));
   _function_space = function_space;
   _functions_space = functions_space;
   _bilinear_form = bilinear_form;
@@ -84,6 +89,11 @@ void PDE::update_mesh (
       _mesh_min[d] = coord_value < _mesh_min[d] ? coord_value : _mesh_min[d];
     }
   }
+
+  // the sparsity pattern belongs to the old mesh
+  _eigen_matrix.reset();
+
+  PDE::invalidate_residual();
 }
 //--------------------------------------
 dolfin::Mesh PDE::get_mesh () {
@@ -117,6 +127,7 @@ void PDE::set_solution (
 
   _bilinear_form->set_coefficient(_variable, (_solution_function));
   _linear_form->set_coefficient(_variable, (_solution_function));
+  PDE::invalidate_residual();
 }
 //--------------------------------------
 void PDE::set_solution (
@@ -139,6 +150,7 @@ void PDE::set_solution (
 
   _bilinear_form->set_coefficient(_variable, (_solution_function));
   _linear_form->set_coefficient(_variable, (_solution_function));
+  PDE::invalidate_residual();
 }
 //--------------------------------------
 void PDE::set_solution (
@@ -179,6 +191,7 @@ void PDE::set_solution (
 
   _bilinear_form->set_coefficient(_variable, _solution_function);
   _linear_form->set_coefficient(_variable, _solution_function);
+  PDE::invalidate_residual();
 }
 //--------------------------------------
 void PDE::set_solutions (
@@ -196,7 +209,7 @@ void PDE::set_solutions (
     }
     _bilinear_form->set_coefficient(_variables[0], _solution_functions[0]);
     _bilinear_form->set_coefficient(_variables[1], _solution_functions[1]);
-
+    PDE::invalidate_residual();
   }
   else {
     printf("Dimension mismatch!!\n");
@@ -218,7 +231,7 @@ void PDE::set_solutions (
     }
     _bilinear_form->set_coefficient(_variables[0], _solution_functions[0]);
     _bilinear_form->set_coefficient(_variables[1], _solution_functions[1]);
-
+    PDE::invalidate_residual();
   }
   else {
     printf("Dimension mismatch!!\n");
@@ -240,7 +253,7 @@ void PDE::set_solutions (
     }
     _bilinear_form->set_coefficient(_variables[0], _solution_functions[0]);
     _bilinear_form->set_coefficient(_variables[1], _solution_functions[1]);
-
+    PDE::invalidate_residual();
   }
   else {
     printf("Dimension mismatch!!\n");
@@ -268,12 +281,39 @@ void PDE::set_solution (
 
   _bilinear_form->set_coefficient(_variable, _solution_function);
   _linear_form->set_coefficient(_variable, _solution_function);
+  PDE::invalidate_residual();
 }
 //--------------------------------------
 dolfin::Function PDE::get_solution () {
   return *(_solution_function);
 }
 //--------------------------------------
+std::shared_ptr<const dolfin::Function> PDE::get_solution_function () {
+  return _solution_function;
+}
+//--------------------------------------
+void PDE::add_to_solution (
+  const double* update
+) {
+  double* values = dolfin::as_type<dolfin::EigenVector>(*(_solution_function->vector())).data();
+  const std::size_t size = _solution_function->vector()->local_size();
+  for (std::size_t dof = 0; dof < size; dof++) {
+    values[dof] += update[dof];
+  }
+
+  PDE::invalidate_residual();
+}
+//--------------------------------------
+void PDE::set_solution_values (
+  const double* values
+) {
+  double* solution = dolfin::as_type<dolfin::EigenVector>(*(_solution_function->vector())).data();
+  const std::size_t size = _solution_function->vector()->local_size();
+  std::copy(values, values + size, solution);
+
+  PDE::invalidate_residual();
+}
+//--------------------------------------
 std::vector<dolfin::Function> PDE::get_solutions () {
   std::vector<dolfin::Function> solutions;
   for (int i=0;i<_solution_functions.size();i++)
@@ -329,6 +369,8 @@ void PDE::set_coefficients (
     _linear_coefficient.emplace(lc->first, constant_fn);
   }
 
+  PDE::invalidate_residual();
+  coefficients_changed();
 }
 //--------------------------------------
 void PDE::set_coefficients (
@@ -350,6 +392,8 @@ void PDE::set_coefficients (
     _linear_coefficient.emplace(bc->first, constant_fn);
   }
 
+  PDE::invalidate_residual();
+  coefficients_changed();
 }
 //--------------------------------------
 void PDE::set_coefficients (
@@ -372,30 +416,115 @@ void PDE::set_coefficients (
 
     _linear_form->set_coefficient(lc->first, fn);
   }
+
+  PDE::invalidate_residual();
+  coefficients_changed();
 }
 //--------------------------------------
 double PDE::compute_residual (
   std::string norm_type
 ) {
-  dolfin::EigenVector eigen_vector;
-  dolfin::assemble(eigen_vector, *_linear_form);
-  for (std::size_t i = 0; i < _dirichletBC.size(); i++) {
-    _dirichletBC[i]->apply(eigen_vector);
-  }
+  Phase_Timer timer("PDE::compute_residual");
+  std::shared_ptr<const dolfin::EigenVector> residual_vector = PDE::get_residual_vector();
 
   if (norm_type == "max" || norm_type == "infinity") {
-    double max = eigen_vector.max();
-    double min = - eigen_vector.min();
+    double max = residual_vector->max();
+    double min = - residual_vector->min();
     return max > min ? max : min;
   }
 
-  double residual = eigen_vector.norm(norm_type);
+  return residual_vector->norm(norm_type);
+}
+//--------------------------------------
+double PDE::compute_residual (
+  std::string norm_type,
+  std::size_t component
+) {
+  std::shared_ptr<const dolfin::EigenVector> residual_vector = PDE::get_residual_vector();
+  const double* values = residual_vector->data();
+
+  // the dof map is built on demand, a missing entry is never
+  // read as an empty component with zero residual
+  std::map<std::size_t, std::vector<dolfin::la_index>>::const_iterator dof_entry;
+  dof_entry = _dof_map.find(component);
+  if (dof_entry == _dof_map.end()) {
+    PDE::get_dofs();
+    dof_entry = _dof_map.find(component);
+  }
+  if (dof_entry == _dof_map.end()) {
+    printf("\tsolution has no component %lu\n", component);
+    fasp_chkerr(ERROR_INPUT_PAR, "PDE::compute_residual");
+  }
+  const std::vector<dolfin::la_index>& dofs = dof_entry->second;
+
+  bool max_norm = (norm_type == "max" || norm_type == "infinity" || norm_type == "linf");
+  double residual = 0.0;
+  for (std::size_t index = 0; index < dofs.size(); index++) {
+    double value = std::abs(values[dofs[index]]);
+    if (max_norm) {
+      residual = value > residual ? value : residual;
+    }
+    else if (norm_type == "l1") {
+      residual += value;
+    }
+    else {
+      residual += value * value;
+    }
+  }
 
-  _eigen_vector.reset(new dolfin::EigenVector(eigen_vector));
+  if (!max_norm && norm_type != "l1") {
+    residual = std::sqrt(residual);
+  }
 
   return residual;
 }
 //--------------------------------------
+std::shared_ptr<const dolfin::EigenVector> PDE::get_residual_vector () {
+  if (_residual_vector && _residual_version == _solution_version) {
+    Phase_Registry::count("residual cache hits", 1);
+    return _residual_vector;
+  }
+
+  auto residual_vector = std::make_shared<dolfin::EigenVector>();
+  PDE::assemble_residual(*residual_vector);
+
+  _residual_vector = residual_vector;
+  _residual_version = _solution_version;
+
+  // drivers read the system size from _eigen_vector, and solvers
+  // may overwrite it, so it must not share the cached residual
+  _eigen_vector.reset(new dolfin::EigenVector(*_residual_vector));
+
+  return _residual_vector;
+}
+//--------------------------------------
+void PDE::assemble_residual (
+  dolfin::EigenVector& residual_vector
+) {
+  Phase_Timer timer("PDE::assemble_residual");
+  _threaded_assembler->assemble(residual_vector, *_linear_form);
+  for (std::size_t i = 0; i < _dirichletBC.size(); i++) {
+    _dirichletBC[i]->apply(residual_vector);
+  }
+}
+//--------------------------------------
+void PDE::invalidate_residual () {
+  _solution_version++;
+}
+//--------------------------------------
+void PDE::coefficients_changed () {
+}
+//--------------------------------------
+void PDE::set_assembly_threads (
+  const std::size_t num_threads
+) {
+  _threaded_assembler->set_num_threads(num_threads);
+}
+//--------------------------------------
+std::size_t PDE::get_assembly_threads () {
+  return _threaded_assembler->num_threads();
+}
+//--------------------------------------
 
 
 
@@ -458,6 +587,8 @@ void PDE::remove_Dirichlet_dof (
       new dolfin::DirichletBC((*_function_space)[i], zero_constant, _dirichlet_SubDomain[i])
     );
   }
+
+  PDE::invalidate_residual();
 }
 //--------------------------------------
 void PDE::set_DirichletBC (
@@ -502,6 +633,8 @@ void PDE::add_DirichletBC (
       _dirichlet_SubDomain.back()
     ));
   }
+
+  PDE::invalidate_residual();
 }
 //--------------------------------------
 std::vector<std::shared_ptr<dolfin::SubDomain>> PDE::get_Dirichlet_SubDomain () {
@@ -528,6 +661,7 @@ dolfin::Function PDE::dolfin_solve () {
 
   _bilinear_form->set_coefficient(_variable, _solution_function);
   _linear_form->set_coefficient(_variable, _solution_function);
+  PDE::invalidate_residual();
 
   return *_solution_function;
 }
@@ -540,18 +674,27 @@ dolfin::Function PDE::dolfin_solve () {
 
 //--------------------------------------
 void PDE::setup_linear_algebra () {
-  dolfin::EigenMatrix eigen_matrix;
-  dolfin::EigenVector eigen_vector;
-  dolfin::assemble(eigen_matrix, *_bilinear_form);
-  dolfin::assemble(eigen_vector, *_linear_form);
+  Phase_Timer timer("PDE::setup_linear_algebra");
+  // the assembler only zeros and refills the values of a non-empty
+  // tensor, so the sparsity pattern is built once per mesh
+  if (!_eigen_matrix || _eigen_matrix->empty()) {
+    _eigen_matrix.reset(new dolfin::EigenMatrix());
+    _matrix_pattern_version++;
+  }
+  std::size_t pattern_nnz = _eigen_matrix->empty() ? 0 : _eigen_matrix->nnz();
 
+  _threaded_assembler->assemble(*_eigen_matrix, *_bilinear_form);
   for (std::size_t i = 0; i < _dirichletBC.size(); i++) {
-    _dirichletBC[i]->apply(eigen_matrix);
-    _dirichletBC[i]->apply(eigen_vector);
+    _dirichletBC[i]->apply(*_eigen_matrix);
+  }
+
+  // boundary conditions may insert missing diagonal entries
+  if (_eigen_matrix->nnz() != pattern_nnz) {
+    _matrix_pattern_version++;
   }
 
-  _eigen_matrix.reset(new dolfin::EigenMatrix(eigen_matrix));
-  _eigen_vector.reset(new dolfin::EigenVector(eigen_vector));
+  // the right-hand side is the residual of the current solution
+  _eigen_vector.reset(new dolfin::EigenVector(*PDE::get_residual_vector()));
 }
 //--------------------------------------
 dolfin::Function PDE::_convert_EigenVector_to_Function (
@@ -563,11 +706,14 @@ dolfin::Function PDE::_convert_EigenVector_to_Function (
   //   printf("Cannot convert EigenVector to Function...\n");
   //   printf("\tincompatible dimensions!\n");
   // }
+  double* values = dolfin::as_type<dolfin::EigenVector>(*(fn.vector())).data();
+  const double* eigen_values = eigen_vector.data();
   dolfin::la_index dof_index;
   for (std::size_t component = 0; component < _dof_map.size(); component++) {
-    for (std::size_t index = 0; index < _dof_map[component].size(); index++) {
-      dof_index = _dof_map[component][index];
-      fn.vector()->setitem(dof_index, eigen_vector[dof_index]);
+    const std::vector<dolfin::la_index>& dofs = _dof_map[component];
+    for (std::size_t index = 0; index < dofs.size(); index++) {
+      dof_index = dofs[index];
+      values[dof_index] = eigen_values[dof_index];
     }
   }
 
@@ -578,6 +724,7 @@ void PDE::EigenMatrix_to_dCSRmat (
   std::shared_ptr<const dolfin::EigenMatrix> eigen_matrix,
   dCSRmat* dCSR_matrix
 ) {
+  Phase_Timer timer("PDE::EigenMatrix_to_dCSRmat");
 
   int row = eigen_matrix->size(0);
   int col = eigen_matrix->size(1);
@@ -632,6 +779,7 @@ void PDE::EigenMatrix_to_dCSRmat (
 //--------------------------------------
 void PDE::EigenMatrix_to_dCSRmat(const dolfin::EigenMatrix* mat_A, dCSRmat* dCSR_A)
 {
+  Phase_Timer timer("PDE::EigenMatrix_to_dCSRmat");
   // dimensions of matrix
   int nrows = mat_A->size(0);
   int ncols = mat_A->size(1);
@@ -676,3 +824,45 @@ void PDE::EigenVector_to_dvector (
   vector->val = (double*) eigen_vector->data();
 }
 //--------------------------------------
+//--------------------------------------
+void PDE::dCSRmat_to_dBSRmat (
+  const dCSRmat* dCSR_matrix,
+  const int block_size,
+  dBSRmat* dBSR_matrix
+) {
+  const int* IA = dCSR_matrix->IA;
+  const int* JA = dCSR_matrix->JA;
+  const double* val = dCSR_matrix->val;
+
+  if (_bsr_pattern_version == _matrix_pattern_version
+    && _bsr_value_map.size() == (std::size_t) dCSR_matrix->nnz) {
+    // same pattern: scatter the new values into the existing blocks
+    for (std::size_t k = 0; k < _bsr_value_map.size(); k++) {
+      dBSR_matrix->val[_bsr_value_map[k]] = val[k];
+    }
+    return;
+  }
+
+  // new pattern: build the block layout and the CSR to BSR value map
+  if (_bsr_pattern_version > 0) {
+    fasp_dbsr_free(dBSR_matrix);
+  }
+  *dBSR_matrix = fasp_format_dcsr_dbsr(dCSR_matrix, block_size);
+
+  const int block_entries = block_size * block_size;
+  _bsr_value_map.resize(dCSR_matrix->nnz);
+  for (int row = 0; row < dCSR_matrix->row; row++) {
+    int block_row = row / block_size;
+    for (int k = IA[row]; k < IA[row + 1]; k++) {
+      int block_col = JA[k] / block_size;
+      int block = dBSR_matrix->IA[block_row];
+      while (dBSR_matrix->JA[block] != block_col) block++;
+
+      _bsr_value_map[k] = block * block_entries
+        + (row % block_size) * block_size + (JA[k] % block_size);
+    }
+  }
+
+  _bsr_pattern_version = _matrix_pattern_version;
+}
+//--------------------------------------
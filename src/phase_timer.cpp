@@ -0,0 +1,136 @@
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <string>
+#include <map>
+#include <chrono>
+#include "phase_timer.h"
+
+//--------------------------------------
+Phase_Timer::Phase_Timer (
+  const std::string phase
+) {
+  _phase = phase;
+  _start = std::chrono::steady_clock::now();
+}
+//--------------------------------------
+Phase_Timer::~Phase_Timer () {
+  if (_running) {
+    Phase_Timer::stop();
+  }
+}
+//--------------------------------------
+double Phase_Timer::stop () {
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - _start;
+  if (_running) {
+    Phase_Registry::record(_phase, elapsed.count());
+    _running = false;
+  }
+
+  return elapsed.count();
+}
+//--------------------------------------
+
+
+
+
+//--------------------------------------
+std::map<std::string, Phase_Registry::Phase>& Phase_Registry::_phases () {
+  static std::map<std::string, Phase> phases;
+  return phases;
+}
+//--------------------------------------
+std::map<std::string, long>& Phase_Registry::_counters () {
+  static std::map<std::string, long> counters;
+  return counters;
+}
+//--------------------------------------
+void Phase_Registry::record (
+  const std::string phase,
+  const double seconds
+) {
+  Phase& entry = _phases()[phase];
+  entry.calls++;
+  entry.total_seconds += seconds;
+  if (seconds > entry.max_seconds) {
+    entry.max_seconds = seconds;
+  }
+}
+//--------------------------------------
+void Phase_Registry::count (
+  const std::string counter,
+  const long increment
+) {
+  _counters()[counter] += increment;
+}
+//--------------------------------------
+void Phase_Registry::print_table () {
+  printf("\n%-40s %10s %14s %14s\n", "phase", "calls", "total [s]", "max [s]");
+  std::map<std::string, Phase>::const_iterator phase;
+  for (phase = _phases().begin(); phase != _phases().end(); ++phase) {
+    printf("%-40s %10lu %14.6e %14.6e\n",
+      phase->first.c_str(),
+      phase->second.calls,
+      phase->second.total_seconds,
+      phase->second.max_seconds
+    );
+  }
+
+  if (!_counters().empty()) {
+    printf("\n%-40s %10s\n", "counter", "value");
+    std::map<std::string, long>::const_iterator counter;
+    for (counter = _counters().begin(); counter != _counters().end(); ++counter) {
+      printf("%-40s %10ld\n", counter->first.c_str(), counter->second);
+    }
+  }
+  printf("\n");
+  fflush(stdout);
+}
+//--------------------------------------
+void Phase_Registry::write_json (
+  const std::string filename
+) {
+  std::ofstream json_file;
+  json_file.open(filename);
+  json_file.precision(9);
+  json_file << std::scientific;
+
+  json_file << "{\n  \"phases\": {";
+  std::map<std::string, Phase>::const_iterator phase;
+  for (phase = _phases().begin(); phase != _phases().end(); ++phase) {
+    json_file << (phase == _phases().begin() ? "\n" : ",\n");
+    json_file << "    \"" << phase->first << "\": {";
+    json_file << "\"calls\": " << phase->second.calls << ", ";
+    json_file << "\"total_seconds\": " << phase->second.total_seconds << ", ";
+    json_file << "\"max_seconds\": " << phase->second.max_seconds << "}";
+  }
+  json_file << "\n  },\n  \"counters\": {";
+  std::map<std::string, long>::const_iterator counter;
+  for (counter = _counters().begin(); counter != _counters().end(); ++counter) {
+    json_file << (counter == _counters().begin() ? "\n" : ",\n");
+    json_file << "    \"" << counter->first << "\": " << counter->second;
+  }
+  json_file << "\n  }\n}\n";
+
+  json_file.close();
+}
+//--------------------------------------
+double Phase_Registry::total_seconds (
+  const std::string phase
+) {
+  std::map<std::string, Phase>::const_iterator entry = _phases().find(phase);
+  return entry == _phases().end() ? 0.0 : entry->second.total_seconds;
+}
+//--------------------------------------
+long Phase_Registry::counter_value (
+  const std::string counter
+) {
+  std::map<std::string, long>::const_iterator entry = _counters().find(counter);
+  return entry == _counters().end() ? 0 : entry->second;
+}
+//--------------------------------------
+void Phase_Registry::reset () {
+  _phases().clear();
+  _counters().clear();
+}
+//--------------------------------------
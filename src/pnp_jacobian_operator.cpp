@@ -0,0 +1,292 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+#include <vector>
+#include <dolfin.h>
+#include "pnp_jacobian_operator.h"
+#include "phase_timer.h"
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+//--------------------------------------
+PNP_Jacobian_Operator::PNP_Jacobian_Operator () {}
+//--------------------------------------
+PNP_Jacobian_Operator::~PNP_Jacobian_Operator () {}
+//--------------------------------------
+
+
+
+
+//--------------------------------------
+void PNP_Jacobian_Operator::init_geometry (
+  const dolfin::FunctionSpace& function_space
+) {
+  const dolfin::Mesh& mesh = *(function_space.mesh());
+  std::shared_ptr<const dolfin::GenericDofMap> dofmap = function_space.dofmap();
+  if (mesh.topology().dim() != 3 || dofmap->max_element_dofs() != 12) {
+    fasp_chkerr(ERROR_INPUT_PAR, "PNP_Jacobian_Operator::init_geometry");
+  }
+
+  _num_cells = mesh.num_cells();
+  _padded_cells = ((_num_cells + _batch - 1) / _batch) * _batch;
+  _num_dofs = dofmap->global_dimension();
+  const std::size_t n = _padded_cells;
+
+  // padding cells have no volume and add zeros to dof 0
+  _volume.assign(n, 0.0);
+  _gradients.assign(12 * n, 0.0);
+  _cell_dofs.assign(12 * n, 0);
+
+  std::vector<double> coordinate_dofs;
+  double J[9], K[9];
+  for (dolfin::CellIterator cell(mesh); !cell.end(); ++cell) {
+    const std::size_t c = cell->index();
+    cell->get_coordinate_dofs(coordinate_dofs);
+    const double* x = coordinate_dofs.data();
+
+    // Jacobian of the affine map from the reference tetrahedron
+    for (std::size_t i = 0; i < 3; i++) {
+      for (std::size_t k = 0; k < 3; k++) {
+        J[i * 3 + k] = x[(k + 1) * 3 + i] - x[i];
+      }
+    }
+    const double det = J[0] * (J[4] * J[8] - J[5] * J[7])
+      - J[1] * (J[3] * J[8] - J[5] * J[6])
+      + J[2] * (J[3] * J[7] - J[4] * J[6]);
+    K[0] = (J[4] * J[8] - J[5] * J[7]) / det;
+    K[1] = (J[2] * J[7] - J[1] * J[8]) / det;
+    K[2] = (J[1] * J[5] - J[2] * J[4]) / det;
+    K[3] = (J[5] * J[6] - J[3] * J[8]) / det;
+    K[4] = (J[0] * J[8] - J[2] * J[6]) / det;
+    K[5] = (J[2] * J[3] - J[0] * J[5]) / det;
+    K[6] = (J[3] * J[7] - J[4] * J[6]) / det;
+    K[7] = (J[1] * J[6] - J[0] * J[7]) / det;
+    K[8] = (J[0] * J[4] - J[1] * J[3]) / det;
+    _volume[c] = std::fabs(det) / 6.0;
+
+    // gradients of the barycentric coordinates
+    for (std::size_t d = 0; d < 3; d++) {
+      double sum = 0.0;
+      for (std::size_t a = 1; a < 4; a++) {
+        _gradients[(a * 3 + d) * n + c] = K[(a - 1) * 3 + d];
+        sum += K[(a - 1) * 3 + d];
+      }
+      _gradients[d * n + c] = -sum;
+    }
+
+    // mixed dofs are ordered by component, then local vertex
+    dolfin::ArrayView<const dolfin::la_index> cell_dofs = dofmap->cell_dofs(c);
+    for (std::size_t k = 0; k < 12; k++) {
+      _cell_dofs[k * n + c] = cell_dofs[k];
+    }
+  }
+
+  _solution.resize(_num_dofs);
+  _exp_solution.resize(_num_dofs);
+
+  _geometry_mesh_id = mesh.id();
+  _geometry_uninitialized = false;
+}
+//--------------------------------------
+void PNP_Jacobian_Operator::set_coefficients (
+  const double permittivity,
+  const std::vector<double>& diffusivity,
+  const std::vector<double>& valency
+) {
+  if (diffusivity.size() != 3 || valency.size() != 3) {
+    fasp_chkerr(ERROR_INPUT_PAR, "PNP_Jacobian_Operator::set_coefficients");
+  }
+
+  _permittivity = permittivity;
+  for (std::size_t i = 0; i < 3; i++) {
+    _diffusivity[i] = diffusivity[i];
+    _valency[i] = valency[i];
+  }
+}
+//--------------------------------------
+void PNP_Jacobian_Operator::set_dirichlet_dofs (
+  const std::vector<dolfin::la_index>& dofs
+) {
+  _dirichlet_dofs = dofs;
+}
+//--------------------------------------
+void PNP_Jacobian_Operator::update (
+  const dolfin::Function& solution
+) {
+  if (_geometry_uninitialized || _geometry_mesh_id != solution.function_space()->mesh()->id()) {
+    PNP_Jacobian_Operator::init_geometry(*(solution.function_space()));
+  }
+
+  solution.vector()->get_local(_solution);
+  for (std::size_t dof = 0; dof < _num_dofs; dof++) {
+    _exp_solution[dof] = std::exp(_solution[dof]);
+  }
+}
+//--------------------------------------
+void PNP_Jacobian_Operator::apply (
+  const double* x,
+  double* y
+) {
+  Phase_Timer timer("PNP_Jacobian_Operator::apply");
+  const std::size_t B = _batch;
+  const std::size_t n = _padded_cells;
+  const double* volume = _volume.data();
+  const double* gradients = _gradients.data();
+  const dolfin::la_index* cell_dofs = _cell_dofs.data();
+  const double* u = _solution.data();
+  const double* exp_u = _exp_solution.data();
+  const double eps = _permittivity;
+
+  std::fill(y, y + _num_dofs, 0.0);
+
+  // batch local values as [component][vertex][lane]
+  double x_local[3][4][B], u_local[3][4][B], e_local[3][4][B], y_local[3][4][B];
+  // per-lane temporaries of the cell kernel
+  double V[B], G[4][3][B], grad_x0[3][B], grad_phi[3][B];
+  double s_e[B], s_x[B], s_ex[B], flux[3][B];
+  for (std::size_t c0 = 0; c0 < n; c0 += B) {
+    for (std::size_t k = 0; k < 12; k++) {
+      const dolfin::la_index* dofs = cell_dofs + k * n + c0;
+      for (std::size_t l = 0; l < B; l++) {
+        x_local[k / 4][k % 4][l] = x[dofs[l]];
+        u_local[k / 4][k % 4][l] = u[dofs[l]];
+        e_local[k / 4][k % 4][l] = exp_u[dofs[l]];
+      }
+    }
+
+    // the cell kernel: every stage loops over the lanes of the
+    // batch innermost, on per-lane temporaries
+    #pragma omp simd
+    for (std::size_t l = 0; l < B; l++) {
+      V[l] = volume[c0 + l];
+    }
+    for (std::size_t a = 0; a < 4; a++) {
+      for (std::size_t d = 0; d < 3; d++) {
+        const double* gradient = gradients + (a * 3 + d) * n + c0;
+        #pragma omp simd
+        for (std::size_t l = 0; l < B; l++) {
+          G[a][d][l] = gradient[l];
+        }
+      }
+    }
+
+    for (std::size_t d = 0; d < 3; d++) {
+      #pragma omp simd
+      for (std::size_t l = 0; l < B; l++) {
+        double sum_x = 0.0, sum_u = 0.0;
+        for (std::size_t a = 0; a < 4; a++) {
+          sum_x += x_local[0][a][l] * G[a][d][l];
+          sum_u += u_local[0][a][l] * G[a][d][l];
+        }
+        grad_x0[d][l] = sum_x;
+        grad_phi[d][l] = sum_u;
+      }
+    }
+
+    // permittivity * grad(u0) . grad(v0)
+    for (std::size_t b = 0; b < 4; b++) {
+      #pragma omp simd
+      for (std::size_t l = 0; l < B; l++) {
+        y_local[0][b][l] = V[l] * eps * (
+          G[b][0][l] * grad_x0[0][l] + G[b][1][l] * grad_x0[1][l] + G[b][2][l] * grad_x0[2][l]
+        );
+      }
+    }
+
+    for (std::size_t i = 1; i < 3; i++) {
+      const double z = _valency[i];
+      const double D = _diffusivity[i];
+      #pragma omp simd
+      for (std::size_t l = 0; l < B; l++) {
+        double sum_e = 0.0, sum_x = 0.0, sum_ex = 0.0;
+        for (std::size_t a = 0; a < 4; a++) {
+          sum_e += e_local[i][a][l];
+          sum_x += x_local[i][a][l];
+          sum_ex += e_local[i][a][l] * x_local[i][a][l];
+        }
+        s_e[l] = sum_e;
+        s_x[l] = sum_x;
+        s_ex[l] = sum_ex;
+      }
+
+      // exp(uu) * (grad(u) + grad(uu + z phi) u + z grad(u0)) . grad(v)
+      // with the integrals of the P1 interpolant of exp(uu)
+      for (std::size_t d = 0; d < 3; d++) {
+        #pragma omp simd
+        for (std::size_t l = 0; l < B; l++) {
+          double grad_xi = 0.0, grad_eta = 0.0;
+          for (std::size_t a = 0; a < 4; a++) {
+            grad_xi += x_local[i][a][l] * G[a][d][l];
+            grad_eta += u_local[i][a][l] * G[a][d][l];
+          }
+          const double flux_scale = 0.25 * s_e[l];
+          const double drift_scale = 0.05 * (s_e[l] * s_x[l] + s_ex[l]);
+          flux[d][l] = flux_scale * (grad_xi + z * grad_x0[d][l])
+            + drift_scale * (grad_eta + z * grad_phi[d][l]);
+        }
+      }
+      for (std::size_t b = 0; b < 4; b++) {
+        #pragma omp simd
+        for (std::size_t l = 0; l < B; l++) {
+          y_local[i][b][l] = V[l] * D * (
+            G[b][0][l] * flux[0][l] + G[b][1][l] * flux[1][l] + G[b][2][l] * flux[2][l]
+          );
+        }
+      }
+
+      // -z exp(uu) u v0, from the integrals of three P1 functions
+      for (std::size_t b = 0; b < 4; b++) {
+        #pragma omp simd
+        for (std::size_t l = 0; l < B; l++) {
+          const double e_b = e_local[i][b][l];
+          const double x_b = x_local[i][b][l];
+          y_local[0][b][l] += -z * V[l] / 120.0 * (
+            s_e[l] * s_x[l] + x_b * s_e[l] + e_b * s_x[l] + s_ex[l] + 2.0 * e_b * x_b
+          );
+        }
+      }
+    }
+
+    for (std::size_t k = 0; k < 12; k++) {
+      const dolfin::la_index* dofs = cell_dofs + k * n + c0;
+      for (std::size_t l = 0; l < B; l++) {
+        y[dofs[l]] += y_local[k / 4][k % 4][l];
+      }
+    }
+  }
+
+  // Dirichlet rows of the Jacobian are identity rows
+  for (std::size_t i = 0; i < _dirichlet_dofs.size(); i++) {
+    const dolfin::la_index dof = _dirichlet_dofs[i];
+    y[dof] = x[dof];
+  }
+}
+//--------------------------------------
+void PNP_Jacobian_Operator::apply (
+  const void* data,
+  const REAL* x,
+  REAL* y
+) {
+  const PNP_Jacobian_Operator* jacobian = static_cast<const PNP_Jacobian_Operator*>(data);
+  const_cast<PNP_Jacobian_Operator*>(jacobian)->apply(x, y);
+}
+//--------------------------------------
+void PNP_Jacobian_Operator::shell_matrix (
+  mxv_matfree& shell
+) {
+  shell.data = this;
+  shell.fct = PNP_Jacobian_Operator::apply;
+}
+//--------------------------------------
+std::size_t PNP_Jacobian_Operator::memory_bytes () {
+  // cell arrays, the linearization point and x, y
+  return _volume.size() * sizeof(double)
+    + _gradients.size() * sizeof(double)
+    + _cell_dofs.size() * sizeof(dolfin::la_index)
+    + 4 * _num_dofs * sizeof(double);
+}
+//--------------------------------------
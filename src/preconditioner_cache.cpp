@@ -0,0 +1,115 @@
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include "preconditioner_cache.h"
+#include "phase_timer.h"
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+//--------------------------------------
+Preconditioner_Cache::Preconditioner_Cache (
+  const ILU_param &ilu,
+  const double iteration_growth
+) : Lagged_Preconditioner("ILU", iteration_growth) {
+  _ilu = ilu;
+}
+//--------------------------------------
+Preconditioner_Cache::~Preconditioner_Cache () {
+  Preconditioner_Cache::free_preconditioner();
+}
+//--------------------------------------
+
+
+
+
+//--------------------------------------
+INT Preconditioner_Cache::solve (
+  dBSRmat* matrix,
+  dvector* rhs,
+  dvector* solution,
+  itsolver_param* itsolver
+) {
+  _matrix = matrix;
+  _jacobian = NULL;
+  return Lagged_Preconditioner::lagged_solve(
+    matrix->ROW,
+    matrix->NNZ,
+    rhs,
+    solution,
+    itsolver,
+    true
+  );
+}
+//--------------------------------------
+INT Preconditioner_Cache::solve (
+  mxv_matfree* jacobian,
+  dBSRmat* matrix,
+  dvector* rhs,
+  dvector* solution,
+  itsolver_param* itsolver
+) {
+  _matrix = matrix;
+  _jacobian = jacobian;
+  INT status = Lagged_Preconditioner::lagged_solve(
+    matrix->ROW,
+    matrix->NNZ,
+    rhs,
+    solution,
+    itsolver,
+    false
+  );
+  _jacobian = NULL;
+  return status;
+}
+//--------------------------------------
+INT Preconditioner_Cache::krylov_solve (
+  dvector* rhs,
+  dvector* solution,
+  itsolver_param* itsolver
+) {
+  if (_jacobian != NULL) {
+    return fasp_solver_itsolver(
+      _jacobian,
+      rhs,
+      solution,
+      &_preconditioner,
+      itsolver
+    );
+  }
+
+  return fasp_solver_dbsr_itsolver(
+    _matrix,
+    rhs,
+    solution,
+    &_preconditioner,
+    itsolver
+  );
+}
+//--------------------------------------
+void Preconditioner_Cache::setup () {
+  Preconditioner_Cache::free_preconditioner();
+
+  printf("\tsetting up ILU preconditioner\n"); fflush(stdout);
+  Phase_Timer timer("FASP ILU setup");
+  SHORT status = fasp_ilu_dbsr_setup(_matrix, &_ilu_data, &_ilu);
+  if (status < 0) {
+    fasp_chkerr(status, "Preconditioner_Cache::setup");
+  }
+  _ilu_allocated = true;
+
+  _preconditioner.data = &_ilu_data;
+  _preconditioner.fct = fasp_precond_dbsr_ilu;
+
+  Lagged_Preconditioner::finish_setup(_matrix->ROW, _matrix->NNZ);
+}
+//--------------------------------------
+void Preconditioner_Cache::free_preconditioner () {
+  if (_ilu_allocated) {
+    fasp_ilu_data_free(&_ilu_data);
+    _ilu_allocated = false;
+  }
+  _needs_setup = true;
+}
+//--------------------------------------
@@ -0,0 +1,510 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <dolfin.h>
+#include <ufc.h>
+#include "threaded_assembler.h"
+#include "phase_timer.h"
+extern "C" {
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+//--------------------------------------
+Threaded_Assembler::Threaded_Assembler (
+  const std::size_t num_threads
+) {
+  Threaded_Assembler::set_num_threads(num_threads);
+}
+//--------------------------------------
+Threaded_Assembler::~Threaded_Assembler () {
+  Threaded_Assembler::stop_workers();
+}
+//--------------------------------------
+
+
+
+
+//--------------------------------------
+void Threaded_Assembler::set_num_threads (
+  const std::size_t num_threads
+) {
+  _num_threads = num_threads;
+  if (_num_threads == 0) {
+    _num_threads = std::thread::hardware_concurrency();
+  }
+  if (_num_threads == 0) {
+    _num_threads = 1;
+  }
+}
+//--------------------------------------
+std::size_t Threaded_Assembler::num_threads () {
+  return _num_threads;
+}
+//--------------------------------------
+std::size_t Threaded_Assembler::num_cell_colors () {
+  return _cell_colors.size();
+}
+//--------------------------------------
+std::size_t Threaded_Assembler::num_facet_colors () {
+  return _facet_colors.size();
+}
+//--------------------------------------
+void Threaded_Assembler::init_coloring (
+  const dolfin::Mesh& mesh
+) {
+  const std::size_t D = mesh.topology().dim();
+  mesh.init(D - 1);
+  mesh.init(D - 1, D);
+  mesh.init(D, D - 1);
+
+  // cells conflict when they share a vertex
+  std::vector<std::size_t> item_ids;
+  std::vector<std::size_t> item_offsets(1, 0);
+  std::vector<unsigned int> item_vertices;
+  for (dolfin::CellIterator cell(mesh); !cell.end(); ++cell) {
+    const unsigned int* vertices = cell->entities(0);
+    item_vertices.insert(item_vertices.end(), vertices, vertices + cell->num_entities(0));
+    item_offsets.push_back(item_vertices.size());
+    item_ids.push_back(cell->index());
+  }
+  Threaded_Assembler::color_items(
+    item_ids, item_offsets, item_vertices, mesh.num_vertices(), _cell_colors
+  );
+
+  // exterior facets are assembled with their cell
+  _cell_facet_offsets.assign(mesh.num_cells() + 1, 0);
+  for (dolfin::FacetIterator facet(mesh); !facet.end(); ++facet) {
+    if (facet->num_entities(D) == 1) {
+      _cell_facet_offsets[facet->entities(D)[0] + 1]++;
+    }
+  }
+  for (std::size_t cell = 0; cell < mesh.num_cells(); cell++) {
+    _cell_facet_offsets[cell + 1] += _cell_facet_offsets[cell];
+  }
+  _cell_facets.resize(_cell_facet_offsets.back());
+  std::vector<std::size_t> next_facet(_cell_facet_offsets.begin(), _cell_facet_offsets.end() - 1);
+
+  // interior facets conflict through the vertices of both cells
+  item_ids.clear();
+  item_offsets.assign(1, 0);
+  item_vertices.clear();
+  for (dolfin::FacetIterator facet(mesh); !facet.end(); ++facet) {
+    if (facet->num_entities(D) == 1) {
+      const dolfin::Cell cell(mesh, facet->entities(D)[0]);
+      _cell_facets[next_facet[cell.index()]++] = cell.index(*facet);
+      continue;
+    }
+
+    for (std::size_t side = 0; side < 2; side++) {
+      const dolfin::Cell cell(mesh, facet->entities(D)[side]);
+      const unsigned int* vertices = cell.entities(0);
+      item_vertices.insert(item_vertices.end(), vertices, vertices + cell.num_entities(0));
+    }
+    item_offsets.push_back(item_vertices.size());
+    item_ids.push_back(facet->index());
+  }
+  Threaded_Assembler::color_items(
+    item_ids, item_offsets, item_vertices, mesh.num_vertices(), _facet_colors
+  );
+
+  _coloring_mesh_id = mesh.id();
+  _coloring_uninitialized = false;
+}
+//--------------------------------------
+void Threaded_Assembler::color_items (
+  const std::vector<std::size_t>& item_ids,
+  const std::vector<std::size_t>& item_offsets,
+  const std::vector<unsigned int>& item_vertices,
+  const std::size_t num_vertices,
+  std::vector<std::vector<std::size_t>>& colors
+) {
+  colors.clear();
+  std::vector<std::vector<std::size_t>> vertex_colors(num_vertices);
+  std::vector<char> taken;
+
+  // first color not used by an item sharing a vertex
+  for (std::size_t item = 0; item < item_ids.size(); item++) {
+    taken.assign(colors.size() + 1, 0);
+    for (std::size_t k = item_offsets[item]; k < item_offsets[item + 1]; k++) {
+      const std::vector<std::size_t>& used = vertex_colors[item_vertices[k]];
+      for (std::size_t c = 0; c < used.size(); c++) {
+        taken[used[c]] = 1;
+      }
+    }
+    std::size_t color = 0;
+    while (taken[color]) {
+      color++;
+    }
+
+    if (color == colors.size()) {
+      colors.emplace_back();
+    }
+    colors[color].push_back(item_ids[item]);
+    for (std::size_t k = item_offsets[item]; k < item_offsets[item + 1]; k++) {
+      vertex_colors[item_vertices[k]].push_back(color);
+    }
+  }
+}
+//--------------------------------------
+void Threaded_Assembler::run_colored (
+  const std::vector<std::vector<std::size_t>>& colors,
+  const std::function<void(std::size_t, std::size_t)>& kernel
+) {
+  const std::size_t num_threads = _num_threads;
+  if (num_threads == 1) {
+    for (std::size_t c = 0; c < colors.size(); c++) {
+      for (std::size_t k = 0; k < colors[c].size(); k++) {
+        kernel(0, colors[c][k]);
+      }
+    }
+    return;
+  }
+
+  if (_pool_threads != num_threads) {
+    Threaded_Assembler::stop_workers();
+    Threaded_Assembler::start_workers(num_threads);
+  }
+
+  // wake the workers for a new generation of work
+  {
+    std::lock_guard<std::mutex> lock(_pool_mutex);
+    _pool_colors = &colors;
+    _pool_kernel = &kernel;
+    _pool_waiting = 0;
+    _pool_finished_colors = 0;
+    _pool_active = num_threads - 1;
+    _pool_generation++;
+  }
+  _pool_start.notify_all();
+
+  Threaded_Assembler::run_colors(0);
+
+  // the work must outlive every worker still leaving the last barrier
+  std::unique_lock<std::mutex> lock(_pool_mutex);
+  _pool_idle.wait(lock, [&] { return _pool_active == 0; });
+  _pool_colors = NULL;
+  _pool_kernel = NULL;
+}
+//--------------------------------------
+void Threaded_Assembler::run_colors (
+  const std::size_t thread
+) {
+  const std::vector<std::vector<std::size_t>>& colors = *_pool_colors;
+  const std::function<void(std::size_t, std::size_t)>& kernel = *_pool_kernel;
+  const std::size_t num_threads = _pool_threads;
+
+  // all threads meet at a barrier after each color
+  for (std::size_t c = 0; c < colors.size(); c++) {
+    const std::vector<std::size_t>& items = colors[c];
+    for (std::size_t k = thread; k < items.size(); k += num_threads) {
+      kernel(thread, items[k]);
+    }
+
+    std::unique_lock<std::mutex> lock(_pool_mutex);
+    if (++_pool_waiting == num_threads) {
+      _pool_waiting = 0;
+      _pool_finished_colors++;
+      _pool_barrier.notify_all();
+    }
+    else {
+      _pool_barrier.wait(lock, [&] { return _pool_finished_colors > c; });
+    }
+  }
+}
+//--------------------------------------
+void Threaded_Assembler::start_workers (
+  const std::size_t num_threads
+) {
+  _pool_threads = num_threads;
+  for (std::size_t thread = 1; thread < num_threads; thread++) {
+    _workers.emplace_back(&Threaded_Assembler::worker_loop, this, thread, _pool_generation);
+  }
+}
+//--------------------------------------
+void Threaded_Assembler::stop_workers () {
+  {
+    std::lock_guard<std::mutex> lock(_pool_mutex);
+    _pool_stop = true;
+  }
+  _pool_start.notify_all();
+  for (std::size_t i = 0; i < _workers.size(); i++) {
+    _workers[i].join();
+  }
+  _workers.clear();
+  _pool_threads = 1;
+  _pool_stop = false;
+}
+//--------------------------------------
+void Threaded_Assembler::worker_loop (
+  const std::size_t thread,
+  std::size_t generation
+) {
+  // generation is the last one before the worker started
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(_pool_mutex);
+      _pool_start.wait(lock, [&] {
+        return _pool_stop || _pool_generation != generation;
+      });
+      if (_pool_stop) {
+        return;
+      }
+      generation = _pool_generation;
+    }
+
+    Threaded_Assembler::run_colors(thread);
+
+    std::lock_guard<std::mutex> lock(_pool_mutex);
+    if (--_pool_active == 0) {
+      _pool_idle.notify_all();
+    }
+  }
+}
+//--------------------------------------
+void Threaded_Assembler::assemble_form (
+  const dolfin::Form& form,
+  const std::function<void(
+    std::size_t,
+    const double*,
+    const std::vector<dolfin::ArrayView<const dolfin::la_index>>&
+  )>& add_tensor
+) {
+  const dolfin::Mesh& mesh = *(form.mesh());
+  if (_coloring_uninitialized || _coloring_mesh_id != mesh.id()) {
+    Threaded_Assembler::init_coloring(mesh);
+  }
+
+  const std::size_t D = mesh.topology().dim();
+  const std::size_t rank = form.rank();
+  std::vector<std::shared_ptr<const dolfin::GenericDofMap>> dofmaps;
+  for (std::size_t i = 0; i < rank; i++) {
+    dofmaps.push_back(form.function_space(i)->dofmap());
+  }
+
+  std::shared_ptr<const dolfin::MeshFunction<std::size_t>> cell_domains = form.cell_domains();
+  std::shared_ptr<const dolfin::MeshFunction<std::size_t>> exterior_domains = form.exterior_facet_domains();
+  std::shared_ptr<const dolfin::MeshFunction<std::size_t>> interior_domains = form.interior_facet_domains();
+  const bool use_cell_domains = cell_domains && !cell_domains->empty();
+  const bool use_exterior_domains = exterior_domains && !exterior_domains->empty();
+  const bool use_interior_domains = interior_domains && !interior_domains->empty();
+  const bool has_exterior_integrals = form.ufc_form()->has_exterior_facet_integrals();
+
+  // every thread restricts coefficients into its own UFC object
+  struct Thread_Data {
+    std::unique_ptr<dolfin::UFC> ufc;
+    ufc::cell ufc_cell[2];
+    std::vector<double> coordinate_dofs[2];
+    std::vector<std::vector<dolfin::la_index>> macro_dofs;
+    std::vector<dolfin::ArrayView<const dolfin::la_index>> dofs;
+  };
+  std::vector<Thread_Data> thread_data(_num_threads);
+  for (std::size_t thread = 0; thread < _num_threads; thread++) {
+    thread_data[thread].ufc.reset(new dolfin::UFC(form));
+    thread_data[thread].macro_dofs.resize(rank);
+    thread_data[thread].dofs.resize(rank);
+  }
+
+  auto cell_kernel = [&] (const std::size_t thread, const std::size_t cell_index) {
+    Thread_Data& data = thread_data[thread];
+    dolfin::UFC& ufc = *(data.ufc);
+    ufc::cell_integral* integral = use_cell_domains
+      ? ufc.get_cell_integral((*cell_domains)[cell_index])
+      : ufc.default_cell_integral.get();
+    const std::size_t facet_begin = _cell_facet_offsets[cell_index];
+    const std::size_t facet_end = has_exterior_integrals ? _cell_facet_offsets[cell_index + 1] : facet_begin;
+    if (!integral && facet_begin == facet_end) {
+      return;
+    }
+
+    const dolfin::Cell cell(mesh, cell_index);
+    std::vector<double>& coordinate_dofs = data.coordinate_dofs[0];
+    cell.get_coordinate_dofs(coordinate_dofs);
+    for (std::size_t i = 0; i < rank; i++) {
+      data.dofs[i] = dofmaps[i]->cell_dofs(cell_index);
+    }
+
+    if (integral) {
+      cell.get_cell_data(data.ufc_cell[0]);
+      ufc.update(cell, coordinate_dofs, data.ufc_cell[0], integral->enabled_coefficients());
+      integral->tabulate_tensor(
+        ufc.A.data(),
+        ufc.w(),
+        coordinate_dofs.data(),
+        data.ufc_cell[0].orientation
+      );
+      add_tensor(thread, ufc.A.data(), data.dofs);
+    }
+
+    for (std::size_t k = facet_begin; k < facet_end; k++) {
+      const std::size_t local_facet = _cell_facets[k];
+      ufc::exterior_facet_integral* facet_integral = use_exterior_domains
+        ? ufc.get_exterior_facet_integral((*exterior_domains)[cell.entities(D - 1)[local_facet]])
+        : ufc.default_exterior_facet_integral.get();
+      if (!facet_integral) {
+        continue;
+      }
+
+      cell.get_cell_data(data.ufc_cell[0], local_facet);
+      ufc.update(cell, coordinate_dofs, data.ufc_cell[0], facet_integral->enabled_coefficients());
+      facet_integral->tabulate_tensor(
+        ufc.A.data(),
+        ufc.w(),
+        coordinate_dofs.data(),
+        local_facet,
+        data.ufc_cell[0].orientation
+      );
+      add_tensor(thread, ufc.A.data(), data.dofs);
+    }
+  };
+
+  auto facet_kernel = [&] (const std::size_t thread, const std::size_t facet_index) {
+    Thread_Data& data = thread_data[thread];
+    dolfin::UFC& ufc = *(data.ufc);
+    ufc::interior_facet_integral* integral = use_interior_domains
+      ? ufc.get_interior_facet_integral((*interior_domains)[facet_index])
+      : ufc.default_interior_facet_integral.get();
+    if (!integral) {
+      return;
+    }
+
+    const dolfin::Facet facet(mesh, facet_index);
+    const dolfin::Cell cell0(mesh, facet.entities(D)[0]);
+    const dolfin::Cell cell1(mesh, facet.entities(D)[1]);
+    const std::size_t local_facet0 = cell0.index(facet);
+    const std::size_t local_facet1 = cell1.index(facet);
+    cell0.get_cell_data(data.ufc_cell[0], local_facet0);
+    cell1.get_cell_data(data.ufc_cell[1], local_facet1);
+    cell0.get_coordinate_dofs(data.coordinate_dofs[0]);
+    cell1.get_coordinate_dofs(data.coordinate_dofs[1]);
+    ufc.update(
+      cell0, data.coordinate_dofs[0], data.ufc_cell[0],
+      cell1, data.coordinate_dofs[1], data.ufc_cell[1],
+      integral->enabled_coefficients()
+    );
+
+    // macro element dofs are those of cell0 followed by cell1
+    for (std::size_t i = 0; i < rank; i++) {
+      dolfin::ArrayView<const dolfin::la_index> dofs0 = dofmaps[i]->cell_dofs(cell0.index());
+      dolfin::ArrayView<const dolfin::la_index> dofs1 = dofmaps[i]->cell_dofs(cell1.index());
+      std::vector<dolfin::la_index>& macro_dofs = data.macro_dofs[i];
+      macro_dofs.assign(dofs0.begin(), dofs0.end());
+      macro_dofs.insert(macro_dofs.end(), dofs1.begin(), dofs1.end());
+      data.dofs[i] = dolfin::ArrayView<const dolfin::la_index>(macro_dofs.size(), macro_dofs.data());
+    }
+
+    integral->tabulate_tensor(
+      ufc.macro_A.data(),
+      ufc.macro_w(),
+      data.coordinate_dofs[0].data(),
+      data.coordinate_dofs[1].data(),
+      local_facet0,
+      local_facet1,
+      data.ufc_cell[0].orientation,
+      data.ufc_cell[1].orientation
+    );
+    add_tensor(thread, ufc.macro_A.data(), data.dofs);
+  };
+
+  if (form.ufc_form()->has_cell_integrals() || has_exterior_integrals) {
+    Threaded_Assembler::run_colored(_cell_colors, cell_kernel);
+  }
+  if (form.ufc_form()->has_interior_facet_integrals()) {
+    Threaded_Assembler::run_colored(_facet_colors, facet_kernel);
+  }
+}
+//--------------------------------------
+void Threaded_Assembler::assemble (
+  dolfin::EigenMatrix& matrix,
+  const dolfin::Form& bilinear_form
+) {
+  // the pattern comes from dolfin, as do forms with point integrals
+  if (matrix.empty()
+    || bilinear_form.ufc_form()->has_vertex_integrals()
+    || bilinear_form.ufc_form()->has_custom_integrals()
+  ) {
+    dolfin::assemble(matrix, bilinear_form);
+    return;
+  }
+
+  Phase_Timer timer("Threaded_Assembler::assemble_matrix");
+  dolfin::EigenMatrix::eigen_matrix_type& eigen_matrix = matrix.mat();
+  if (!eigen_matrix.isCompressed()) {
+    eigen_matrix.makeCompressed();
+  }
+  const dolfin::la_index* row_offsets = eigen_matrix.outerIndexPtr();
+  const dolfin::la_index* columns = eigen_matrix.innerIndexPtr();
+  double* values = eigen_matrix.valuePtr();
+  std::fill(values, values + eigen_matrix.nonZeros(), 0.0);
+
+  // rows are sorted, so each entry is found by bisection
+  std::atomic<bool> outside_pattern(false);
+  auto add_tensor = [&] (
+    const std::size_t thread,
+    const double* tensor,
+    const std::vector<dolfin::ArrayView<const dolfin::la_index>>& dofs
+  ) {
+    const std::size_t local_cols = dofs[1].size();
+    for (std::size_t i = 0; i < dofs[0].size(); i++) {
+      const dolfin::la_index row = dofs[0][i];
+      const dolfin::la_index* row_begin = columns + row_offsets[row];
+      const dolfin::la_index* row_end = columns + row_offsets[row + 1];
+      for (std::size_t j = 0; j < local_cols; j++) {
+        const dolfin::la_index* column = std::lower_bound(row_begin, row_end, dofs[1][j]);
+        if (column == row_end || *column != dofs[1][j]) {
+          outside_pattern = true;
+          continue;
+        }
+        values[column - columns] += tensor[i * local_cols + j];
+      }
+    }
+  };
+  Threaded_Assembler::assemble_form(bilinear_form, add_tensor);
+
+  if (outside_pattern) {
+    fasp_chkerr(ERROR_DATA_STRUCTURE, "Threaded_Assembler::assemble");
+  }
+}
+//--------------------------------------
+void Threaded_Assembler::assemble (
+  dolfin::EigenVector& vector,
+  const dolfin::Form& linear_form
+) {
+  if (linear_form.ufc_form()->has_vertex_integrals()
+    || linear_form.ufc_form()->has_custom_integrals()
+  ) {
+    dolfin::assemble(vector, linear_form);
+    return;
+  }
+
+  Phase_Timer timer("Threaded_Assembler::assemble_vector");
+  const std::size_t dimension = linear_form.function_space(0)->dim();
+  if (vector.empty()) {
+    vector.init(dimension);
+  }
+  if (vector.size() != dimension) {
+    fasp_chkerr(ERROR_INPUT_PAR, "Threaded_Assembler::assemble");
+  }
+  double* values = vector.data();
+  std::fill(values, values + dimension, 0.0);
+
+  auto add_tensor = [&] (
+    const std::size_t thread,
+    const double* tensor,
+    const std::vector<dolfin::ArrayView<const dolfin::la_index>>& dofs
+  ) {
+    for (std::size_t i = 0; i < dofs[0].size(); i++) {
+      values[dofs[0][i]] += tensor[i];
+    }
+  };
+  Threaded_Assembler::assemble_form(linear_form, add_tensor);
+}
+//--------------------------------------
@@ -0,0 +1,142 @@
+/*! \file test_bsr_assembler.cpp
+ *
+ *  \brief Unit test of BSR_Assembler against dolfin::assemble of the
+ *    linearized PNP Jacobian followed by the conversion to a FASP
+ *    block matrix
+ */
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <dolfin.h>
+#include "bsr_assembler.h"
+#include "vector_linear_pnp_forms.h"
+extern "C"
+{
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+bool DEBUG = false;
+
+// linearization point with nonconstant potential and concentrations
+class Linearization_Point : public dolfin::Expression
+{
+public:
+  Linearization_Point() : dolfin::Expression(3) {}
+
+  void eval(dolfin::Array<double>& values, const dolfin::Array<double>& x) const
+  {
+    values[0] = std::sin(x[0]) + x[1] * x[2];
+    values[1] = -1.0 + 0.5 * x[0] * x[1];
+    values[2] = -2.0 + 0.5 * std::cos(x[2]);
+  }
+};
+
+int main(int argc, char** argv)
+{
+
+  if (argc >1)
+  {
+    if (std::string(argv[1])=="DEBUG") DEBUG = true;
+  }
+
+  if (DEBUG) {
+    std::cout << "################################################################# \n";
+    std::cout << "#### Test of BSR_Assembler                                   #### \n";
+    std::cout << "################################################################# \n";
+  }
+
+  // Need to use Eigen for linear algebra
+  dolfin::parameters["linear_algebra_backend"] = "Eigen";
+
+  auto mesh = std::make_shared<dolfin::UnitCubeMesh>(4, 4, 4);
+  auto V = std::make_shared<vector_linear_pnp_forms::FunctionSpace>(mesh);
+  vector_linear_pnp_forms::Form_a a(V, V);
+
+  auto uu = std::make_shared<dolfin::Function>(V);
+  Linearization_Point linearization_point;
+  uu->interpolate(linearization_point);
+  a.uu = uu;
+  a.permittivity = std::make_shared<dolfin::Constant>(1.0E-2);
+  a.diffusivity = std::make_shared<dolfin::Constant>(0.0, 1.0, 2.0);
+  a.valency = std::make_shared<dolfin::Constant>(0.0, 1.0, -1.0);
+
+  // reference: EigenMatrix -> dCSRmat -> dBSRmat
+  dolfin::EigenMatrix A;
+  dolfin::assemble(A, a);
+  dCSRmat csr_matrix;
+  csr_matrix.row = A.size(0);
+  csr_matrix.col = A.size(1);
+  csr_matrix.nnz = A.nnz();
+  csr_matrix.IA = (int*) std::get<0>(A.data());
+  csr_matrix.JA = (int*) std::get<1>(A.data());
+  csr_matrix.val = (double*) std::get<2>(A.data());
+  dBSRmat reference = fasp_format_dcsr_dbsr(&csr_matrix, 3);
+
+  BSR_Assembler bsr_assembler(3);
+  bsr_assembler.assemble(a);
+  dBSRmat* matrix = bsr_assembler.matrix();
+
+  // every entry of the assembled matrix
+  double max_entry = 0.0;
+  double max_difference = 0.0;
+  bool outside_pattern = false;
+  for (int row = 0; row < csr_matrix.row; row++) {
+    for (int k = csr_matrix.IA[row]; k < csr_matrix.IA[row + 1]; k++) {
+      const double* entry = bsr_assembler.entry(row, csr_matrix.JA[k]);
+      if (entry == NULL) {
+        outside_pattern = outside_pattern || csr_matrix.val[k] != 0.0;
+        continue;
+      }
+      max_entry = std::max(max_entry, std::fabs(csr_matrix.val[k]));
+      max_difference = std::max(max_difference, std::fabs(*entry - csr_matrix.val[k]));
+    }
+  }
+
+  // and the action of both block matrices, which also catches
+  // entries of the block pattern missing from the reference
+  const std::size_t size = V->dim();
+  std::vector<double> x(size), y_reference(size, 0.0), y(size, 0.0);
+  for (std::size_t dof = 0; dof < size; dof++) {
+    x[dof] = std::sin(0.1 * dof);
+  }
+  fasp_blas_dbsr_mxv(&reference, x.data(), y_reference.data());
+  fasp_blas_dbsr_mxv(matrix, x.data(), y.data());
+  double difference = 0.0, norm = 0.0;
+  for (std::size_t dof = 0; dof < size; dof++) {
+    difference += (y[dof] - y_reference[dof]) * (y[dof] - y_reference[dof]);
+    norm += y_reference[dof] * y_reference[dof];
+  }
+  const double relative_difference = std::sqrt(difference / norm);
+
+  if (DEBUG) {
+    printf("\tblocks : %d (reference %d)\n", matrix->NNZ, reference.NNZ);
+    printf("\tmax entry difference : %e of %e\n", max_difference, max_entry);
+    printf("\trelative difference of the action : %e\n", relative_difference);
+  }
+  fasp_dbsr_free(&reference);
+
+  double tol = 1E-12;
+  if (!outside_pattern && max_difference < tol * max_entry && relative_difference < tol)
+  {
+    printf("Success... passed BSR assembly\n");
+  }
+  else {
+    printf("***\tERROR IN BSR ASSEMBLER TEST\n");
+    printf("***\n***\n***\n");
+    printf("***\tBSR ASSEMBLER TEST:\n");
+    printf("***\tThe block matrix differs from dolfin::assemble\n");
+    printf("***\n***\n***\n");
+    printf("***\tERROR IN BSR ASSEMBLER TEST\n");
+    fflush(stdout);
+    return -1;
+  }
+
+  if (DEBUG){
+    std::cout << "################################################################# \n";
+    std::cout << "#### End of test of BSR_Assembler                            #### \n";
+    std::cout << "################################################################# \n";
+  }
+  return 0;
+}
@@ -0,0 +1,145 @@
+/*! \file test_eafe_assembler.cpp
+ *
+ *  \brief Unit test of the edge by edge EAFE_Assembler against the
+ *    cell kernel of the UFC form in EAFE.h
+ *
+ *  \note The UFC form is assembled with gamma = 0, as the solvers use it
+ */
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <dolfin.h>
+#include "EAFE.h"
+#include "bsr_assembler.h"
+#include "eafe_assembler.h"
+extern "C"
+{
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+bool DEBUG = false;
+
+class Alpha : public dolfin::Expression
+{
+  void eval(dolfin::Array<double>& values, const dolfin::Array<double>& x) const
+  {
+    values[0] = 1.0 + x[0] * x[1];
+  }
+};
+
+class Eta : public dolfin::Expression
+{
+  void eval(dolfin::Array<double>& values, const dolfin::Array<double>& x) const
+  {
+    values[0] = -1.0 + std::sin(2.0 * x[2]);
+  }
+};
+
+// strong enough to exercise both signs and the small argument
+// branch of the Bernoulli function
+class Beta : public dolfin::Expression
+{
+  void eval(dolfin::Array<double>& values, const dolfin::Array<double>& x) const
+  {
+    values[0] = 10.0 * (x[0] - 0.5) * (x[1] - 0.5) + std::sin(2.0 * x[2]);
+  }
+};
+
+int main(int argc, char** argv)
+{
+
+  if (argc >1)
+  {
+    if (std::string(argv[1])=="DEBUG") DEBUG = true;
+  }
+
+  if (DEBUG) {
+    std::cout << "################################################################# \n";
+    std::cout << "#### Test of EAFE_Assembler                                  #### \n";
+    std::cout << "################################################################# \n";
+  }
+
+  // Need to use Eigen for linear algebra
+  dolfin::parameters["linear_algebra_backend"] = "Eigen";
+
+  auto mesh = std::make_shared<dolfin::UnitCubeMesh>(5, 5, 5);
+  auto V = std::make_shared<EAFE::FunctionSpace>(mesh);
+
+  auto alpha = std::make_shared<dolfin::Function>(V);
+  auto eta = std::make_shared<dolfin::Function>(V);
+  auto beta = std::make_shared<dolfin::Function>(V);
+  Alpha alpha_expression;
+  Eta eta_expression;
+  Beta beta_expression;
+  alpha->interpolate(alpha_expression);
+  eta->interpolate(eta_expression);
+  beta->interpolate(beta_expression);
+
+  // reference: the UFC cell kernel
+  EAFE::Form_a a(V, V);
+  a.alpha = alpha;
+  a.eta = eta;
+  a.beta = beta;
+  a.gamma = std::make_shared<dolfin::Constant>(0.0);
+  dolfin::EigenMatrix A;
+  dolfin::assemble(A, a);
+
+  // the same pattern in a scalar block matrix, values cleared
+  // so that every entry comes from the edge assembly
+  BSR_Assembler bsr_assembler(1);
+  bsr_assembler.assemble(a);
+  dBSRmat* matrix = bsr_assembler.matrix();
+  fasp_darray_set(matrix->NNZ, matrix->val, 0.0);
+
+  std::vector<dolfin::la_index> dof_map(V->dim());
+  for (std::size_t dof = 0; dof < dof_map.size(); dof++) {
+    dof_map[dof] = dof;
+  }
+  EAFE_Assembler eafe_assembler;
+  eafe_assembler.assemble(bsr_assembler, 0, dof_map, *alpha, *eta, *beta);
+
+  const int* IA = (int*) std::get<0>(A.data());
+  const int* JA = (int*) std::get<1>(A.data());
+  const double* values = (double*) std::get<2>(A.data());
+  double max_entry = 0.0;
+  double max_difference = 0.0;
+  for (std::size_t row = 0; row < A.size(0); row++) {
+    for (int k = IA[row]; k < IA[row + 1]; k++) {
+      const double* entry = bsr_assembler.entry(row, JA[k]);
+      const double edge_value = entry == NULL ? 0.0 : *entry;
+      max_entry = std::max(max_entry, std::fabs(values[k]));
+      max_difference = std::max(max_difference, std::fabs(edge_value - values[k]));
+    }
+  }
+
+  if (DEBUG) {
+    printf("\tmax entry difference : %e of %e\n", max_difference, max_entry);
+  }
+
+  // the UFC kernel evaluates B(x) with exp(x) - 1 and the edge
+  // assembly with expm1, which differ in rounding for small x
+  double tol = 1E-8;
+  if (max_difference < tol * max_entry)
+  {
+    printf("Success... passed EAFE assembly\n");
+  }
+  else {
+    printf("***\tERROR IN EAFE ASSEMBLER TEST\n");
+    printf("***\n***\n***\n");
+    printf("***\tEAFE ASSEMBLER TEST:\n");
+    printf("***\tThe edge assembly differs from the UFC form\n");
+    printf("***\n***\n***\n");
+    printf("***\tERROR IN EAFE ASSEMBLER TEST\n");
+    fflush(stdout);
+    return -1;
+  }
+
+  if (DEBUG){
+    std::cout << "################################################################# \n";
+    std::cout << "#### End of test of EAFE_Assembler                           #### \n";
+    std::cout << "################################################################# \n";
+  }
+  return 0;
+}
@@ -0,0 +1,152 @@
+/*! \file test_entropy_kernel.cpp
+ *
+ *  \brief Unit test of the per-cell entropy kernel of Mesh_Refiner
+ *    against the UFC form of poisson_cell_marker
+ *
+ *  \note The log weights are constant per species, so the kernel's
+ *    P1 interpolated exponential is exact and both agree to rounding
+ */
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <dolfin.h>
+#include "mesh_refiner.h"
+#include "poisson_cell_marker.h"
+
+bool DEBUG = false;
+
+class Potential : public dolfin::Expression
+{
+public:
+  Potential(double scale) : _scale(scale) {}
+
+  void eval(dolfin::Array<double>& values, const dolfin::Array<double>& x) const
+  {
+    values[0] = _scale * (std::sin(3.0 * x[0]) + x[1] * x[2]);
+  }
+
+private:
+  double _scale;
+};
+
+class Diffusivity : public dolfin::Expression
+{
+public:
+  Diffusivity(double slope) : _slope(slope) {}
+
+  void eval(dolfin::Array<double>& values, const dolfin::Array<double>& x) const
+  {
+    values[0] = 1.0 + _slope * (x[0] + 2.0 * x[2]);
+  }
+
+private:
+  double _slope;
+};
+
+int main(int argc, char** argv)
+{
+
+  if (argc >1)
+  {
+    if (std::string(argv[1])=="DEBUG") DEBUG = true;
+  }
+
+  if (DEBUG) {
+    std::cout << "################################################################# \n";
+    std::cout << "#### Test of the Mesh_Refiner entropy kernel                 #### \n";
+    std::cout << "################################################################# \n";
+  }
+
+  // Need to use Eigen for linear algebra
+  dolfin::parameters["linear_algebra_backend"] = "Eigen";
+
+  // enough cells for the kernel to split them over two threads
+  auto initial_mesh = std::make_shared<dolfin::UnitCubeMesh>(12, 12, 12);
+  Mesh_Refiner refiner(initial_mesh, 100000, 1, 1E-3);
+  refiner.max_threads = 2;
+  std::shared_ptr<const dolfin::Mesh> mesh = refiner.get_mesh();
+
+  auto P1 = std::make_shared<poisson_cell_marker::CoefficientSpace_entropy_potential>(mesh);
+  auto DG0 = std::make_shared<poisson_cell_marker::Form_L_FunctionSpace_0>(mesh);
+  std::shared_ptr<const dolfin::GenericDofMap> dofmap = DG0->dofmap();
+
+  const std::size_t species = 2;
+  double scales[species] = {1.0, -0.5};
+  double slopes[species] = {0.5, -0.25};
+  double log_weights[species] = {0.3, -0.2};
+
+  std::vector<std::shared_ptr<const dolfin::Function>> diffusivity_vector;
+  std::vector<std::shared_ptr<const dolfin::Function>> potential_vector;
+  std::vector<std::shared_ptr<const dolfin::Function>> log_weight_vector;
+  std::vector<double> reference(mesh->num_cells(), 0.0);
+  for (std::size_t comp = 0; comp < species; comp++) {
+    auto potential = std::make_shared<dolfin::Function>(P1);
+    auto diffusivity = std::make_shared<dolfin::Function>(P1);
+    auto log_weight = std::make_shared<dolfin::Function>(P1);
+    Potential potential_expression(scales[comp]);
+    Diffusivity diffusivity_expression(slopes[comp]);
+    dolfin::Constant log_weight_expression(log_weights[comp]);
+    potential->interpolate(potential_expression);
+    diffusivity->interpolate(diffusivity_expression);
+    log_weight->interpolate(log_weight_expression);
+    potential_vector.push_back(potential);
+    diffusivity_vector.push_back(diffusivity);
+    log_weight_vector.push_back(log_weight);
+
+    // reference: the UFC form with no recovered gradient, averaged
+    // over each cell
+    poisson_cell_marker::Form_L L(DG0);
+    L.entropy_potential = potential;
+    L.entropy = std::make_shared<dolfin::Constant>(0.0, 0.0, 0.0);
+    L.log_weight = log_weight;
+    L.diffusivity = diffusivity;
+    dolfin::EigenVector b;
+    dolfin::assemble(b, L);
+    for (dolfin::CellIterator cell(*mesh); !cell.end(); ++cell) {
+      const std::size_t c = cell->index();
+      reference[c] += b[dofmap->cell_dofs(c)[0]] / cell->volume();
+    }
+  }
+
+  dolfin::EigenVector entropy = refiner.compute_entropy_error_vector(
+    diffusivity_vector,
+    potential_vector,
+    log_weight_vector
+  );
+
+  double max_entry = 0.0;
+  double max_difference = 0.0;
+  for (std::size_t c = 0; c < reference.size(); c++) {
+    max_entry = std::max(max_entry, std::fabs(reference[c]));
+    max_difference = std::max(max_difference, std::fabs(entropy[c] - reference[c]));
+  }
+
+  if (DEBUG) {
+    printf("\tcells : %lu (kernel returned %lu)\n", reference.size(), entropy.size());
+    printf("\tmax cell difference : %e of %e\n", max_difference, max_entry);
+  }
+
+  double tol = 1E-10;
+  if (entropy.size() == reference.size() && max_difference < tol * max_entry)
+  {
+    printf("Success... passed entropy kernel\n");
+  }
+  else {
+    printf("***\tERROR IN ENTROPY KERNEL TEST\n");
+    printf("***\n***\n***\n");
+    printf("***\tENTROPY KERNEL TEST:\n");
+    printf("***\tThe cell entropy differs from the UFC form\n");
+    printf("***\n***\n***\n");
+    printf("***\tERROR IN ENTROPY KERNEL TEST\n");
+    fflush(stdout);
+    return -1;
+  }
+
+  if (DEBUG){
+    std::cout << "################################################################# \n";
+    std::cout << "#### End of test of the Mesh_Refiner entropy kernel          #### \n";
+    std::cout << "################################################################# \n";
+  }
+  return 0;
+}
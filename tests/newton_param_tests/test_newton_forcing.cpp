@@ -0,0 +1,78 @@
+/*! \file test_newton_forcing.cpp
+ *
+ *  \brief Unit test of the inexact Newton forcing term against
+ *    Eisenstat-Walker (choice 2) values computed by hand
+ *
+ *  \note gamma = 0.9 and alpha = 2, with the safeguard applied once
+ *    gamma * previous_forcing^2 exceeds 0.1
+ */
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <dolfin.h>
+#include "newton_status.h"
+
+bool DEBUG = false;
+
+int main(int argc, char** argv)
+{
+
+  if (argc >1)
+  {
+    if (std::string(argv[1])=="DEBUG") DEBUG = true;
+  }
+
+  if (DEBUG) {
+    std::cout << "################################################################# \n";
+    std::cout << "#### Test of inexact Newton forcing terms                    #### \n";
+    std::cout << "################################################################# \n";
+  }
+
+  // the normalized initial residual only scales the relative residual,
+  // the forcing term follows the raw residuals of this mesh
+  Newton_Status newton(10, 1.0, 1E-8, 1E-8);
+  newton.use_inexact_newton(1E-1, 1E-6, 0.5);
+  newton.reset_residual_history(4.0);
+
+  double residuals[4] = {2.0, 0.2, 0.19, 0.019};
+  double expected[5] = {
+    0.1,      // initial forcing term
+    0.225,    // 0.9 * (2.0 / 4.0)^2
+    0.009,    // 0.9 * (0.2 / 2.0)^2, safeguard 0.9 * 0.225^2 < 0.1
+    0.5,      // 0.9 * (0.19 / 0.2)^2 = 0.81225, clamped to the maximum
+    0.225     // 0.9 * (0.019 / 0.19)^2 = 0.009, safeguard 0.9 * 0.5^2
+  };
+
+  double tol = 1E-12;
+  bool passed = std::fabs(newton.linear_tolerance(1E-8) - expected[0]) < tol;
+  if (DEBUG) printf("\tforcing term 0 : %e (expected %e)\n", newton.forcing_term, expected[0]);
+  for (std::size_t i = 0; i < 4; i++) {
+    newton.update_residuals(residuals[i], 1.0);
+    newton.update_iteration();
+    if (DEBUG) printf("\tforcing term %lu : %e (expected %e)\n", i + 1, newton.forcing_term, expected[i + 1]);
+    passed = passed && std::fabs(newton.linear_tolerance(1E-8) - expected[i + 1]) < tol;
+  }
+
+  if (passed)
+  {
+    printf("Success... passed inexact Newton forcing terms\n");
+  }
+  else {
+    printf("***\tERROR IN NEWTON FORCING TEST\n");
+    printf("***\n***\n***\n");
+    printf("***\tNEWTON FORCING TEST:\n");
+    printf("***\tThe forcing terms differ from Eisenstat-Walker\n");
+    printf("***\n***\n***\n");
+    printf("***\tERROR IN NEWTON FORCING TEST\n");
+    fflush(stdout);
+    return -1;
+  }
+
+  if (DEBUG){
+    std::cout << "################################################################# \n";
+    std::cout << "#### End of test of inexact Newton forcing terms             #### \n";
+    std::cout << "################################################################# \n";
+  }
+  return 0;
+}
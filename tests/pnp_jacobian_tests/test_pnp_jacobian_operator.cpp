@@ -0,0 +1,148 @@
+/*! \file test_pnp_jacobian_operator.cpp
+ *
+ *  \brief Unit test of the matrix-free PNP_Jacobian_Operator against
+ *    the action of the assembled Jacobian of vector_linear_pnp_forms
+ *
+ *  \note The log-concentrations of the linearization point are
+ *    constant, so their P1 interpolated exponential is exact and the
+ *    two actions agree to rounding
+ */
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <dolfin.h>
+#include "bsr_assembler.h"
+#include "pnp_jacobian_operator.h"
+#include "vector_linear_pnp_forms.h"
+extern "C"
+{
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+bool DEBUG = false;
+
+// nonconstant potential, constant log-concentrations
+class Linearization_Point : public dolfin::Expression
+{
+public:
+  Linearization_Point() : dolfin::Expression(3) {}
+
+  void eval(dolfin::Array<double>& values, const dolfin::Array<double>& x) const
+  {
+    values[0] = std::sin(2.0 * x[0]) + x[1] * x[2];
+    values[1] = -1.0;
+    values[2] = 0.5;
+  }
+};
+
+// relative l2 difference of the operator and the block matrix actions
+double action_difference (
+  PNP_Jacobian_Operator& jacobian,
+  dBSRmat* matrix,
+  const std::size_t size
+) {
+  std::vector<double> x(size), y_reference(size, 0.0), y(size, 0.0);
+  for (std::size_t dof = 0; dof < size; dof++) {
+    x[dof] = std::sin(0.1 * dof) + 0.5 * std::cos(0.37 * dof);
+  }
+  fasp_blas_dbsr_mxv(matrix, x.data(), y_reference.data());
+  jacobian.apply(x.data(), y.data());
+
+  double difference = 0.0, norm = 0.0;
+  for (std::size_t dof = 0; dof < size; dof++) {
+    difference += (y[dof] - y_reference[dof]) * (y[dof] - y_reference[dof]);
+    norm += y_reference[dof] * y_reference[dof];
+  }
+  return std::sqrt(difference / norm);
+}
+
+int main(int argc, char** argv)
+{
+
+  if (argc >1)
+  {
+    if (std::string(argv[1])=="DEBUG") DEBUG = true;
+  }
+
+  if (DEBUG) {
+    std::cout << "################################################################# \n";
+    std::cout << "#### Test of PNP_Jacobian_Operator                           #### \n";
+    std::cout << "################################################################# \n";
+  }
+
+  // Need to use Eigen for linear algebra
+  dolfin::parameters["linear_algebra_backend"] = "Eigen";
+
+  auto mesh = std::make_shared<dolfin::UnitCubeMesh>(5, 5, 5);
+  auto V = std::make_shared<vector_linear_pnp_forms::FunctionSpace>(mesh);
+  vector_linear_pnp_forms::Form_a a(V, V);
+
+  auto uu = std::make_shared<dolfin::Function>(V);
+  Linearization_Point linearization_point;
+  uu->interpolate(linearization_point);
+  const double permittivity = 1.0E-2;
+  const std::vector<double> diffusivity = {0.0, 1.0, 2.0};
+  const std::vector<double> valency = {0.0, 1.0, -1.0};
+  a.uu = uu;
+  a.permittivity = std::make_shared<dolfin::Constant>(permittivity);
+  a.diffusivity = std::make_shared<dolfin::Constant>(diffusivity);
+  a.valency = std::make_shared<dolfin::Constant>(valency);
+
+  BSR_Assembler bsr_assembler(3);
+  bsr_assembler.assemble(a);
+
+  PNP_Jacobian_Operator jacobian;
+  jacobian.init_geometry(*V);
+  jacobian.set_coefficients(permittivity, diffusivity, valency);
+  jacobian.update(*uu);
+
+  const std::size_t size = V->dim();
+  const double free_difference = action_difference(jacobian, bsr_assembler.matrix(), size);
+
+  // identity rows on the whole boundary
+  auto zero = std::make_shared<dolfin::Constant>(0.0, 0.0, 0.0);
+  auto boundary = std::make_shared<dolfin::DomainBoundary>();
+  std::vector<std::shared_ptr<dolfin::DirichletBC>> dirichletBC;
+  dirichletBC.push_back(std::make_shared<dolfin::DirichletBC>(V, zero, boundary));
+  bsr_assembler.apply(dirichletBC);
+
+  dolfin::DirichletBC::Map boundary_values;
+  dirichletBC[0]->get_boundary_values(boundary_values);
+  std::vector<dolfin::la_index> dirichlet_dofs;
+  dolfin::DirichletBC::Map::const_iterator bv;
+  for (bv = boundary_values.begin(); bv != boundary_values.end(); ++bv) {
+    dirichlet_dofs.push_back(bv->first);
+  }
+  jacobian.set_dirichlet_dofs(dirichlet_dofs);
+  const double dirichlet_difference = action_difference(jacobian, bsr_assembler.matrix(), size);
+
+  if (DEBUG) {
+    printf("\trelative difference of the action : %e\n", free_difference);
+    printf("\twith %lu Dirichlet rows : %e\n", dirichlet_dofs.size(), dirichlet_difference);
+  }
+
+  double tol = 1E-10;
+  if (free_difference < tol && dirichlet_difference < tol)
+  {
+    printf("Success... passed matrix-free PNP Jacobian\n");
+  }
+  else {
+    printf("***\tERROR IN PNP JACOBIAN OPERATOR TEST\n");
+    printf("***\n***\n***\n");
+    printf("***\tPNP JACOBIAN OPERATOR TEST:\n");
+    printf("***\tThe matrix-free action differs from the assembled Jacobian\n");
+    printf("***\n***\n***\n");
+    printf("***\tERROR IN PNP JACOBIAN OPERATOR TEST\n");
+    fflush(stdout);
+    return -1;
+  }
+
+  if (DEBUG){
+    std::cout << "################################################################# \n";
+    std::cout << "#### End of test of PNP_Jacobian_Operator                    #### \n";
+    std::cout << "################################################################# \n";
+  }
+  return 0;
+}
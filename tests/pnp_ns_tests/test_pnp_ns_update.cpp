@@ -0,0 +1,205 @@
+/*! \file test_pnp_ns_update.cpp
+ *
+ *  \brief Unit test of the scatter map of Linear_PNP_NS, which adds a
+ *    FASP block vector to the PNP, velocity and pressure solutions,
+ *    against routing it through the mixed space with a FunctionAssigner
+ *
+ *  \note The reference is the update path fasp_solve used before the
+ *    scatter map: mixed function, collapsed subfunctions, assign
+ */
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <dolfin.h>
+extern "C"
+{
+  #include "fasp.h"
+  #include "fasp_functs.h"
+  #include "fasp4ns.h"
+  #include "fasp4ns_functs.h"
+}
+#include "vector_linear_pnp_ns_forms.h"
+#include "linear_pnp_ns.h"
+
+bool DEBUG = false;
+
+// largest difference of two vectors, relative to the largest entry
+double relative_difference (
+  const dolfin::GenericVector& vector,
+  const dolfin::GenericVector& reference
+) {
+  std::vector<double> values, reference_values;
+  vector.get_local(values);
+  reference.get_local(reference_values);
+  if (values.size() != reference_values.size()) {
+    return 1.0;
+  }
+  double max_entry = 0.0;
+  double max_difference = 0.0;
+  for (std::size_t i = 0; i < values.size(); i++) {
+    max_entry = std::max(max_entry, std::fabs(reference_values[i]));
+    max_difference = std::max(max_difference, std::fabs(values[i] - reference_values[i]));
+  }
+  return max_difference / max_entry;
+}
+
+int main(int argc, char** argv)
+{
+
+  if (argc >1)
+  {
+    if (std::string(argv[1])=="DEBUG") DEBUG = true;
+  }
+
+  if (DEBUG) {
+    std::cout << "################################################################# \n";
+    std::cout << "#### Test of the PNP-Stokes update map                       #### \n";
+    std::cout << "################################################################# \n";
+  }
+
+  // Need to use Eigen for linear algebra
+  dolfin::parameters["linear_algebra_backend"] = "Eigen";
+
+  // solver parameters are only stored by the problem
+  input_param inpar;
+  itsolver_param itpar;
+  AMG_param amgpar;
+  ILU_param ilupar;
+  char fasp_params[] = "./benchmarks/physic_bench/bcsr.dat";
+  fasp_param_input(fasp_params, &inpar);
+  fasp_param_init(&inpar, &itpar, &amgpar, &ilupar, NULL);
+
+  input_param pnp_inpar;
+  itsolver_param pnp_itpar;
+  AMG_param pnp_amgpar;
+  ILU_param pnp_ilupar;
+  Schwarz_param pnp_schpar;
+  char fasp_pnp_params[] = "./benchmarks/physic_bench/bsr.dat";
+  fasp_param_input(fasp_pnp_params, &pnp_inpar);
+  fasp_param_init(&pnp_inpar, &pnp_itpar, &pnp_amgpar, &pnp_ilupar, &pnp_schpar);
+
+  input_ns_param ns_inpar;
+  itsolver_ns_param ns_itpar;
+  AMG_ns_param ns_amgpar;
+  ILU_param ns_ilupar;
+  Schwarz_param ns_schpar;
+  char fasp_ns_params[] = "./benchmarks/physic_bench/ns.dat";
+  fasp_ns_param_input(fasp_ns_params, &ns_inpar);
+  fasp_ns_param_init(&ns_inpar, &ns_itpar, &ns_amgpar, &ns_ilupar, &ns_schpar);
+
+  auto mesh = std::make_shared<dolfin::UnitCubeMesh>(3, 3, 3);
+  std::shared_ptr<dolfin::FunctionSpace> function_space;
+  function_space.reset(new vector_linear_pnp_ns_forms::FunctionSpace(mesh));
+  std::shared_ptr<dolfin::Form> bilinear_form;
+  bilinear_form.reset(new vector_linear_pnp_ns_forms::Form_a(function_space, function_space));
+  std::shared_ptr<dolfin::Form> linear_form;
+  linear_form.reset(new vector_linear_pnp_ns_forms::Form_L(function_space));
+  std::vector<std::shared_ptr<dolfin::FunctionSpace>> functions_space;
+  functions_space.push_back(std::make_shared<vector_linear_pnp_ns_forms::CoefficientSpace_cc>(mesh));
+  functions_space.push_back(std::make_shared<vector_linear_pnp_ns_forms::CoefficientSpace_uu>(mesh));
+  functions_space.push_back(std::make_shared<vector_linear_pnp_ns_forms::CoefficientSpace_pp>(mesh));
+
+  std::map<std::string, std::vector<double>> coefficients = {
+    {"permittivity", {1.0}},
+    {"diffusivity0", {1.0}},
+    {"diffusivity1", {1.0}},
+    {"valency0", {1.0}},
+    {"valency1", {-1.0}},
+    {"mu", {1.0}},
+    {"penalty1", {1.0}},
+    {"penalty2", {1.0}},
+    {"Re", {1.0}},
+  };
+  std::map<std::string, std::vector<double>> sources = {{"g", {0.0}}};
+
+  Linear_PNP_NS pnp_ns_problem (
+    mesh,
+    function_space,
+    functions_space,
+    bilinear_form,
+    linear_form,
+    coefficients,
+    sources,
+    itpar,
+    pnp_itpar,
+    pnp_amgpar,
+    ns_itpar,
+    ns_amgpar,
+    {"cc", "uu", "pp"}
+  );
+  pnp_ns_problem.get_dofs();
+  pnp_ns_problem.get_dofs_fasp({0, 1, 2}, {3, 4});
+
+  std::vector<dolfin::Function> zero_solutions;
+  for (std::size_t f = 0; f < functions_space.size(); f++) {
+    zero_solutions.push_back(dolfin::Function(functions_space[f]));
+  }
+  pnp_ns_problem.set_solutions(zero_solutions);
+
+  // a known block vector, PNP dofs first
+  const int pnp_size = pnp_ns_problem._pnp_dofs.row;
+  const int stokes_size = pnp_ns_problem._stokes_dofs.row;
+  std::vector<double> block_values(pnp_size + stokes_size);
+  for (std::size_t i = 0; i < block_values.size(); i++) {
+    block_values[i] = std::sin(0.1 * i) + 0.5 * std::cos(0.37 * i);
+  }
+
+  pnp_ns_problem.add_block_update(block_values.data());
+  std::vector<dolfin::Function> solutions = pnp_ns_problem.get_solutions();
+
+  // reference: the block vector in the mixed space, split by
+  // collapsed subfunctions and assigned to the PNP function
+  std::vector<double> mixed_values(function_space->dim(), 0.0);
+  for (int i = 0; i < pnp_size; i++) {
+    mixed_values[pnp_ns_problem._pnp_dofs.val[i]] = block_values[i];
+  }
+  for (int i = 0; i < stokes_size; i++) {
+    mixed_values[pnp_ns_problem._stokes_dofs.val[i]] = block_values[pnp_size + i];
+  }
+  dolfin::Function update(function_space);
+  update.vector()->set_local(mixed_values);
+  update.vector()->apply("insert");
+
+  std::vector<std::shared_ptr<const dolfin::Function>> pnp_components;
+  for (std::size_t c = 0; c < 3; c++) {
+    pnp_components.push_back(std::make_shared<dolfin::Function>(update[c]));
+  }
+  auto pnp_update = std::make_shared<dolfin::Function>(functions_space[0]);
+  dolfin::assign(pnp_update, pnp_components);
+  dolfin::Function velocity_update = update[3];
+  dolfin::Function pressure_update = update[4];
+
+  const double pnp_difference = relative_difference(*(solutions[0].vector()), *(pnp_update->vector()));
+  const double velocity_difference = relative_difference(*(solutions[1].vector()), *(velocity_update.vector()));
+  const double pressure_difference = relative_difference(*(solutions[2].vector()), *(pressure_update.vector()));
+
+  if (DEBUG) {
+    printf("\tPNP difference :      %e\n", pnp_difference);
+    printf("\tvelocity difference : %e\n", velocity_difference);
+    printf("\tpressure difference : %e\n", pressure_difference);
+  }
+
+  double tol = 1E-14;
+  if (pnp_difference < tol && velocity_difference < tol && pressure_difference < tol)
+  {
+    printf("Success... passed PNP-Stokes update map\n");
+  }
+  else {
+    printf("***\tERROR IN PNP-STOKES UPDATE TEST\n");
+    printf("***\n***\n***\n");
+    printf("***\tPNP-STOKES UPDATE TEST:\n");
+    printf("***\tThe scatter map differs from the FunctionAssigner update\n");
+    printf("***\n***\n***\n");
+    printf("***\tERROR IN PNP-STOKES UPDATE TEST\n");
+    fflush(stdout);
+    return -1;
+  }
+
+  if (DEBUG){
+    std::cout << "################################################################# \n";
+    std::cout << "#### End of test of the PNP-Stokes update map                #### \n";
+    std::cout << "################################################################# \n";
+  }
+  return 0;
+}
@@ -21,6 +21,13 @@ make test_lin_pnp
 make test_lin_pnp_eafe
 make test_pnp_eafe
 make test_newton_param
+make test_newton_forcing
+make test_bsr_assembler
+make test_eafe_assembler
+make test_threaded_assembler
+make test_pnp_jacobian_operator
+make test_entropy_kernel
+make test_pnp_ns_update
 
 echo
 echo "Running unit tests..."
@@ -38,6 +45,13 @@ if [ "$1"=="DEBUG" ]; then
 	./test_pnp_eafe $1
 	./test_pnp_eafe $1 EAFE
 	./test_newton_param $1
+	./test_newton_forcing $1
+	./test_bsr_assembler $1
+	./test_eafe_assembler $1
+	./test_threaded_assembler $1
+	./test_pnp_jacobian_operator $1
+	./test_entropy_kernel $1
+	./test_pnp_ns_update $1
 else
 	./test_eafe
 	./test_faspfenics
@@ -51,6 +65,13 @@ else
 	./test_pnp_eafe
 	./test_pnp_eafe EAFE
 	./test_newton_param
+	./test_newton_forcing
+	./test_bsr_assembler
+	./test_eafe_assembler
+	./test_threaded_assembler
+	./test_pnp_jacobian_operator
+	./test_entropy_kernel
+	./test_pnp_ns_update
 fi
 
 
@@ -0,0 +1,187 @@
+/*! \file test_threaded_assembler.cpp
+ *
+ *  \brief Unit test of the colored Threaded_Assembler against serial
+ *    assembly of the linearized PNP Jacobian and residual
+ *
+ *  \note The residual has a marked exterior facet integral, so the
+ *    facets assembled with their cells are covered as well
+ */
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <dolfin.h>
+#include "bsr_assembler.h"
+#include "threaded_assembler.h"
+#include "vector_linear_pnp_forms.h"
+extern "C"
+{
+  #include "fasp.h"
+  #include "fasp_functs.h"
+}
+
+bool DEBUG = false;
+
+// linearization point with nonconstant potential and concentrations
+class Linearization_Point : public dolfin::Expression
+{
+public:
+  Linearization_Point() : dolfin::Expression(3) {}
+
+  void eval(dolfin::Array<double>& values, const dolfin::Array<double>& x) const
+  {
+    values[0] = std::sin(x[0]) + x[1] * x[2];
+    values[1] = -1.0 + 0.5 * x[0] * x[1];
+    values[2] = -2.0 + 0.5 * std::cos(x[2]);
+  }
+};
+
+class Left_Boundary : public dolfin::SubDomain
+{
+  bool inside(const dolfin::Array<double>& x, bool on_boundary) const
+  {
+    return on_boundary && x[0] < DOLFIN_EPS;
+  }
+};
+
+// largest difference of two value arrays, relative to the largest entry
+double relative_difference (
+  const double* values,
+  const double* reference,
+  const std::size_t size
+) {
+  double max_entry = 0.0;
+  double max_difference = 0.0;
+  for (std::size_t i = 0; i < size; i++) {
+    max_entry = std::max(max_entry, std::fabs(reference[i]));
+    max_difference = std::max(max_difference, std::fabs(values[i] - reference[i]));
+  }
+  return max_difference / max_entry;
+}
+
+int main(int argc, char** argv)
+{
+
+  if (argc >1)
+  {
+    if (std::string(argv[1])=="DEBUG") DEBUG = true;
+  }
+
+  if (DEBUG) {
+    std::cout << "################################################################# \n";
+    std::cout << "#### Test of Threaded_Assembler                              #### \n";
+    std::cout << "################################################################# \n";
+  }
+
+  // Need to use Eigen for linear algebra
+  dolfin::parameters["linear_algebra_backend"] = "Eigen";
+
+  auto mesh = std::make_shared<dolfin::UnitCubeMesh>(6, 6, 6);
+  auto V = std::make_shared<vector_linear_pnp_forms::FunctionSpace>(mesh);
+  vector_linear_pnp_forms::Form_a a(V, V);
+  vector_linear_pnp_forms::Form_L L(V);
+
+  auto uu = std::make_shared<dolfin::Function>(V);
+  Linearization_Point linearization_point;
+  uu->interpolate(linearization_point);
+  auto permittivity = std::make_shared<dolfin::Constant>(1.0E-2);
+  auto diffusivity = std::make_shared<dolfin::Constant>(0.0, 1.0, 2.0);
+  auto valency = std::make_shared<dolfin::Constant>(0.0, 1.0, -1.0);
+  a.uu = uu;
+  a.permittivity = permittivity;
+  a.diffusivity = diffusivity;
+  a.valency = valency;
+  L.uu = uu;
+  L.permittivity = permittivity;
+  L.diffusivity = diffusivity;
+  L.valency = valency;
+  L.fixed_charge = std::make_shared<dolfin::Constant>(0.5);
+  L.g = std::make_shared<dolfin::Constant>(2.0);
+
+  auto boundary_markers = std::make_shared<dolfin::FacetFunction<std::size_t>>(mesh, 0);
+  Left_Boundary left_boundary;
+  left_boundary.mark(*boundary_markers, 1);
+  L.set_exterior_facet_domains(boundary_markers);
+
+  // serial references
+  dolfin::EigenMatrix A_reference;
+  dolfin::EigenVector b_reference;
+  dolfin::assemble(A_reference, a);
+  dolfin::assemble(b_reference, L);
+  BSR_Assembler bsr_reference(3);
+  bsr_reference.assemble(a);
+  const dBSRmat* bsr_reference_matrix = bsr_reference.matrix();
+
+  bool passed = true;
+  double tol = 1E-12;
+  std::size_t thread_counts[3] = {1, 2, 4};
+  Threaded_Assembler threaded_assembler(1);
+  for (std::size_t i = 0; i < 3; i++) {
+    threaded_assembler.set_num_threads(thread_counts[i]);
+
+    // the first assembly takes its pattern, and values, from
+    // dolfin::assemble, the second refills the values on the threads
+    dolfin::EigenMatrix A;
+    threaded_assembler.assemble(A, a);
+    threaded_assembler.assemble(A, a);
+    const double matrix_difference = relative_difference(
+      (double*) std::get<2>(A.data()),
+      (double*) std::get<2>(A_reference.data()),
+      A_reference.nnz()
+    );
+
+    dolfin::EigenVector b;
+    threaded_assembler.assemble(b, L);
+    const double vector_difference = relative_difference(
+      b.vec().data(),
+      b_reference.vec().data(),
+      b_reference.size()
+    );
+
+    BSR_Assembler bsr_assembler(3);
+    bsr_assembler.assemble(a, threaded_assembler);
+    const dBSRmat* bsr_matrix = bsr_assembler.matrix();
+    const double bsr_difference = relative_difference(
+      bsr_matrix->val,
+      bsr_reference_matrix->val,
+      bsr_reference_matrix->NNZ * bsr_reference_matrix->nb * bsr_reference_matrix->nb
+    );
+
+    if (DEBUG) {
+      printf("\t%lu threads, %lu cell colors\n",
+        threaded_assembler.num_threads(), threaded_assembler.num_cell_colors()
+      );
+      printf("\t\tmatrix difference : %e\n", matrix_difference);
+      printf("\t\tvector difference : %e\n", vector_difference);
+      printf("\t\tblock matrix difference : %e\n", bsr_difference);
+    }
+    passed = passed
+      && A.nnz() == A_reference.nnz()
+      && bsr_matrix->NNZ == bsr_reference_matrix->NNZ
+      && matrix_difference < tol
+      && vector_difference < tol
+      && bsr_difference < tol;
+  }
+
+  if (passed)
+  {
+    printf("Success... passed threaded assembly\n");
+  }
+  else {
+    printf("***\tERROR IN THREADED ASSEMBLER TEST\n");
+    printf("***\n***\n***\n");
+    printf("***\tTHREADED ASSEMBLER TEST:\n");
+    printf("***\tThe threaded assembly differs from the serial one\n");
+    printf("***\n***\n***\n");
+    printf("***\tERROR IN THREADED ASSEMBLER TEST\n");
+    fflush(stdout);
+    return -1;
+  }
+
+  if (DEBUG){
+    std::cout << "################################################################# \n";
+    std::cout << "#### End of test of Threaded_Assembler                       #### \n";
+    std::cout << "################################################################# \n";
+  }
+  return 0;
+}